@@ -37,10 +37,15 @@ static Region* region_alloc(const usize capacity) {
     exit(1);
   }
 #endif
-  *tmp = (Region){.capacity = DEF_REG_CAP};
+  *tmp = (Region){.capacity = capacity};
   return tmp;
 }
 
+static void arena_count(Arena arena[static 1], const usize size) {
+  arena->used += size * sizeof(usize);
+  arena->peak = max(arena->peak, arena->used);
+}
+
 void* arena_alloc(Arena arena[static 1], const usize size_in) {
   const usize size = ELEM_SIZE(size_in);
 
@@ -61,6 +66,7 @@ void* arena_alloc(Arena arena[static 1], const usize size_in) {
 
   void* result = &arena->end->data[arena->end->count];
   arena->end->count += size;
+  arena_count(arena, size);
   return result;
 }
 
@@ -68,11 +74,18 @@ void* arena_realloc(
   Arena arena[static 1], void* old_ptr, const usize old_size,
   const usize new_size
 ) {
+  if (old_ptr == nullptr) {
+    return arena_alloc(arena, new_size);
+  }
   if (new_size <= old_size) {
     return old_ptr;
   }
-  if (old_ptr == &arena->end->data[arena->end->count - ELEM_SIZE(old_size)]) {
-    arena->end->count += ELEM_SIZE(new_size) - ELEM_SIZE(old_size);
+  // The last allocation grows in place while its region has room left
+  const usize grown = ELEM_SIZE(new_size) - ELEM_SIZE(old_size);
+  if (old_ptr == &arena->end->data[arena->end->count - ELEM_SIZE(old_size)] &&
+      arena->end->count + grown <= arena->end->capacity) {
+    arena->end->count += grown;
+    arena_count(arena, grown);
     return old_ptr;
   }
   void* tmp = arena_alloc(arena, new_size);
@@ -86,6 +99,26 @@ void arena_reset(Arena arena[static 1]) {
     region->count = 0;
   }
   arena->end = arena->begin;
+  arena->used = 0;
+}
+
+void arena_adopt(Arena arena[static 1], Arena other[static 1]) {
+  if (other->begin == nullptr) {
+    return;
+  }
+  if (arena->begin == nullptr) {
+    arena->begin = other->begin;
+    arena->end = other->end;
+  } else {
+    Region* last = arena->end;
+    while (last->next != nullptr) {
+      last = last->next;
+    }
+    last->next = other->begin;
+  }
+  arena->peak = max(arena->peak, arena->used + other->peak);
+  arena->used += other->used;
+  *other = (Arena){};
 }
 
 void arena_free(Arena arena[static 1]) {
@@ -95,7 +128,7 @@ void arena_free(Arena arena[static 1]) {
     Region* tmp = region;
     region = region->next;
 #ifdef __linux__
-    if (munmap(tmp, tmp->capacity) == -1) {
+    if (munmap(tmp, sizeof(Region) + sizeof(usize) * tmp->capacity) == -1) {
       perror("munmap");
       exit(1);
     };
@@ -108,4 +141,5 @@ void arena_free(Arena arena[static 1]) {
     free(tmp);
 #endif
   }
+  *arena = (Arena){};
 }
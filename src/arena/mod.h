@@ -11,12 +11,19 @@ struct Region {
   usize data[];
 };
 
+// Bytes handed out since the last reset and the most ever in use at once
 struct Arena {
   Region* begin;
   Region* end;
+  usize used;
+  usize peak;
 };
 
 extern void* arena_alloc(Arena[static 1], const usize);
 extern void* arena_realloc(Arena[static 1], void*, const usize, const usize);
 extern void arena_reset(Arena[static 1]);
+// Moves the regions of the second arena into the first, which releases them
+// with its own. Both were in use together, the high-water mark of the first
+// counts the peak of the second on top of its own use.
+extern void arena_adopt(Arena[static 1], Arena[static 1]);
 extern void arena_free(Arena[static 1]);
@@ -20,14 +20,26 @@ typedef struct MutCLIOptions MutCLIOptions;
 struct MutCLIOptions {
   MutStrView compile;
   MutStrView output;
+  MutStrView cache_dir;
+  MutStrView replay;
   i32 verbosity;
+  i32 threads;
+  i32 error_limit;
+  bool eager;
+  bool no_emit;
 };
 
-#define clio_from_mclio(OUT)                           \
-  (CLIOptions) {                                       \
-    .compile = strview_from_mutstrview((OUT).compile), \
-    .output = strview_from_mutstrview((OUT).output),   \
-    .verbosity = (OUT).verbosity,                      \
+#define clio_from_mclio(OUT)                               \
+  (CLIOptions) {                                           \
+    .compile = strview_from_mutstrview((OUT).compile),     \
+    .output = strview_from_mutstrview((OUT).output),       \
+    .cache_dir = strview_from_mutstrview((OUT).cache_dir), \
+    .replay = strview_from_mutstrview((OUT).replay),       \
+    .verbosity = (OUT).verbosity,                          \
+    .threads = (OUT).threads,                              \
+    .error_limit = (OUT).error_limit,                      \
+    .eager = (OUT).eager,                                  \
+    .no_emit = (OUT).no_emit,                              \
   }
 
 typedef enum ArgFindOption : u32 {
@@ -35,12 +47,19 @@ typedef enum ArgFindOption : u32 {
   AO_Compile,
   AO_Output,
   AO_Verbosity,
+  AO_Threads,
+  AO_ErrorLimit,
+  AO_Eager,
+  AO_CacheDir,
+  AO_Replay,
+  AO_NoEmit,
 } ArgFindOption;
 
 typedef enum ArgFindType : u32 {
   AT_None,
   AT_String,
   AT_Number,
+  AT_Flag,
 } ArgFindType;
 
 typedef struct ArgFindResult {
@@ -60,10 +79,16 @@ DEFINE_VEC_FNS(ArgFindResult, malloc, free)
 #define MAKE_ARG_TABLE(TYPE, NAME) \
   static const TYPE NAME##_table[total_args_size] = { ENTRIES };
 
-#define ENTRIES                            \
-  X(AO_Compile, AT_String, "compile", 'c') \
-  X(AO_Output, AT_String, "output", 'o')   \
-  X(AO_Verbosity, AT_Number, "verbosity", 'v')
+#define ENTRIES                                   \
+  X(AO_Compile, AT_String, "compile", 'c')        \
+  X(AO_Output, AT_String, "output", 'o')          \
+  X(AO_Verbosity, AT_Number, "verbosity", 'v')    \
+  X(AO_Threads, AT_Number, "threads", 'j')        \
+  X(AO_ErrorLimit, AT_Number, "error-limit", 'e') \
+  X(AO_Eager, AT_Flag, "eager", 'E')              \
+  X(AO_CacheDir, AT_String, "cache-dir", 'C')     \
+  X(AO_Replay, AT_String, "replay", 'r')          \
+  X(AO_NoEmit, AT_Flag, "no-emit", 'N')
 
 #define X(OPT, TYPE, LONG, SHORT) LONG,
 MAKE_LONG_ARG_TABLE
@@ -117,6 +142,12 @@ static ArgFindResult argument_parse(usize index, MutStrView option) {
       .type = type,
       .number = atoi(option.pointer),
     };
+  } else if (type == AT_Flag) {
+    return (ArgFindResult){
+      .option = arg_opt_table[index],
+      .type = type,
+      .number = 1,
+    };
   } else {
     return (ArgFindResult){};
   }
@@ -128,13 +159,11 @@ static ArgFindResult argument_parse(usize index, MutStrView option) {
       (ARG).pointer + 2, long_arg_table[IDX], long_arg_size_table[IDX] \
     ) == 0
 
-static ArgFindResult argument_find_separated(
-  StrView argument, MutStrView option
-) {
+static usize argument_find_index(StrView argument) {
   if (argument.length == 2 && argument.pointer[0] == '-') {
     for (usize i = 0; i < total_args_size; ++i) {
       if (argument.pointer[1] == short_arg_table[i]) {
-        return argument_parse(i, option);
+        return i;
       }
     }
   }
@@ -142,11 +171,30 @@ static ArgFindResult argument_find_separated(
       argument.pointer[1] == '-') {
     for (usize i = 0; i < total_args_size; ++i) {
       if (long_arg_found(i, argument)) {
-        return argument_parse(i, option);
+        return i;
       }
     }
   }
-  return (ArgFindResult){};
+  return total_args_size;
+}
+
+static ArgFindResult argument_find_separated(
+  StrView argument, MutStrView option
+) {
+  usize index = argument_find_index(argument);
+  if (index == total_args_size) {
+    return (ArgFindResult){};
+  }
+  return argument_parse(index, option);
+}
+
+// Flags take no option, they are matched before an option is looked for
+static ArgFindResult argument_find_flag(StrView argument) {
+  usize index = argument_find_index(argument);
+  if (index == total_args_size || arg_type_table[index] != AT_Flag) {
+    return (ArgFindResult){};
+  }
+  return argument_parse(index, (MutStrView){});
 }
 
 static CLIOptions argument_build_output(ArgFindResultVector* results) {
@@ -163,6 +211,24 @@ static CLIOptions argument_build_output(ArgFindResultVector* results) {
       case AO_Verbosity:
         out.verbosity = (i32)result.number;
         break;
+      case AO_Threads:
+        out.threads = max((i32)result.number, 0);
+        break;
+      case AO_ErrorLimit:
+        out.error_limit = max((i32)result.number, 0);
+        break;
+      case AO_Eager:
+        out.eager = result.number != 0;
+        break;
+      case AO_CacheDir:
+        out.cache_dir = result.view;
+        break;
+      case AO_Replay:
+        out.replay = result.view;
+        break;
+      case AO_NoEmit:
+        out.no_emit = result.number != 0;
+        break;
       case AO_None:
         eputs("Invalid result received");
         exit(1);
@@ -211,9 +277,24 @@ static const char cli_info[] =
   "  [--compile, -c] <input-file: string>: Input file to be compiled\n"
   "  [--output, -o] <output-file: string>: Output file to be written\n"
   "  [--verbosity, -v] <level: number>: Level of verbosity to output messages\n"
+  "  [--threads, -j] <count: number>: Worker threads for large inputs\n"
+  "  [--error-limit, -e] <count: number>: Errors reported before stopping\n"
+  "  [--eager, -E]: Parse every function body, not only the reachable ones\n"
+  "  [--cache-dir, -C] <directory: string>: Reuse trees of unchanged inputs\n"
+  "  [--replay, -r] <edits-file: string>: Time recorded edits to the input\n"
+  "  [--no-emit, -N]: Build and verify the module without writing it\n"
   "Additional info:\n"
-  "  - Output file defaults to input file with '.o' extension\n"
-  "  - Verbosity level does not affect error output and defaults to 0\n";
+  "  - Output file defaults to input file with '.o' extension, no file is\n"
+  "    written without emitting\n"
+  "  - Verbosity level does not affect error output and defaults to 0\n"
+  "  - Thread count defaults to the number of online processors\n"
+  "  - Error limit defaults to 20\n"
+  "  - Private functions not called from public ones are skipped unless\n"
+  "    parsing eagerly, errors in them are not reported\n"
+  "  - Without a cache directory every input is parsed again\n"
+  "  - Replaying edits analyses the input without compiling it, every line\n"
+  "    of the edits file is '<offset> <removed> <text>'. It exits with 1\n"
+  "    when errors are left after the last edit\n";
 
 CLIOptions cli_options_parse(isize argc, argv_t argv) {
   if (argc < 2) {
@@ -233,6 +314,11 @@ CLIOptions cli_options_parse(isize argc, argv_t argv) {
       .pointer = argv[i],
       .length = strlen(argv[i]),
     };
+    ArgFindResult flag_result = argument_find_flag(full_arg);
+    if (flag_result.type != AT_None) {
+      ArgFindResult_vector_push(&results, flag_result);
+      continue;
+    }
     ArgFindResult combined_result = argument_find_combined(full_arg);
     if (combined_result.type != AT_None) {
       ArgFindResult_vector_push(&results, combined_result);
@@ -5,7 +5,13 @@ typedef struct CLIOptions CLIOptions;
 struct CLIOptions {
   StrView compile;
   StrView output;
+  StrView cache_dir;
+  StrView replay;
   const i32 verbosity;
+  const i32 threads;
+  const i32 error_limit;
+  const bool eager;
+  const bool no_emit;
 };
 
 typedef const rcstr* const restrict argv_t;
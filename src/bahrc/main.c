@@ -1,5 +1,6 @@
 #include <bahrc/cli-options.h>
 #include <bahrc/inputfile.h>
+#include <bahrc/replay.h>
 #include <codegen-llvm/lib.h>
 #include <stdio.h>
 #include <utility/mod.h>
@@ -7,10 +8,22 @@
 int main(int argc, argv_t argv) {
   CLIOptions opts = cli_options_parse(argc, argv);
   Inputfile file = inputfile_make(opts.compile);
+  if (opts.replay.length != 0) {
+    Inputfile edits = inputfile_make(opts.replay);
+    usize errors = replay_edits(file.content, edits.content, opts.verbosity);
+    inputfile_free(edits);
+    inputfile_free(file);
+    return errors != 0 ? 1 : 0;
+  }
 
   compile_string((CompileOptions){
     .verbosity_level = opts.verbosity,
+    .threads = opts.threads,
+    .error_limit = opts.error_limit,
+    .eager = opts.eager,
+    .no_emit = opts.no_emit,
     .output_filename = opts.output,
+    .cache_dir = opts.cache_dir,
     .input_filename = opts.compile,
     .input_string = file.content,
   });
@@ -0,0 +1,144 @@
+#include <bahrc/replay.h>
+#include <parser/ctors.h>
+#include <parser/intern.h>
+#include <parser/session.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utility/mod.h>
+#include <utility/vec.h>
+
+DEFINE_VECTOR(f64)
+DEFINE_VEC_FNS(f64, malloc, free)
+
+// Recorded edits hold one edit per line: "<offset> <removed> <text>". The
+// inserted text runs to the end of the line, with newlines, tabs and
+// backslashes in it written as "\n", "\t" and "\\".
+typedef struct Edit Edit;
+struct Edit {
+  usize offset;
+  usize removed;
+  char* text;
+  usize length;
+};
+
+static const char* parse_number(const char* iter, rcstr end, usize* number) {
+  *number = 0;
+  if (iter == end || *iter < '0' || *iter > '9') {
+    eputs("Invalid edit: expected a number");
+    exit(1);
+  }
+  for (; iter != end && *iter >= '0' && *iter <= '9'; ++iter) {
+    *number = *number * 10 + (usize)(*iter - '0');
+  }
+  return iter != end && *iter == ' ' ? iter + 1 : iter;
+}
+
+static const char* parse_edit(const char* iter, rcstr end, Edit* edit) {
+  iter = parse_number(iter, end, &edit->offset);
+  iter = parse_number(iter, end, &edit->removed);
+  const char* line = memchr(iter, '\n', (usize)(end - iter));
+  line = line != nullptr ? line : end;
+  edit->text = malloc((usize)(line - iter) + 1);
+  if (edit->text == nullptr) {
+    perror("malloc");
+    exit(1);
+  }
+  edit->length = 0;
+  for (; iter != line; ++iter) {
+    char ref = *iter;
+    if (ref == '\\' && iter + 1 != line) {
+      iter += 1;
+      ref = *iter == 'n' ? '\n' : *iter == 't' ? '\t' : *iter;
+    }
+    edit->text[edit->length] = ref;
+    edit->length += 1;
+  }
+  return line != end ? line + 1 : line;
+}
+
+static f64 elapsed_ms(struct timespec start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64)(now.tv_sec - start.tv_sec) * 1e3 +
+         (f64)(now.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+static void print_error(
+  unused void* data, SourceLoc loc, StrView line, rcstr message
+) {
+  i32 chars_written = eprintf("%u: ", loc.line);
+  eprintf("%.*s\n", (i32)line.length, line.pointer);
+  eprintf("%*s", (i32)loc.column - 1 + chars_written, "");
+  eprintln("^ %s", message);
+}
+
+static i32 time_compare(const void* lhs_ptr, const void* rhs_ptr) {
+  f64 lhs = *(const f64*)lhs_ptr;
+  f64 rhs = *(const f64*)rhs_ptr;
+  return lhs < rhs ? -1 : lhs > rhs;
+}
+
+static void skip_error(
+  unused void* data, unused SourceLoc loc, unused StrView line,
+  unused rcstr message
+) {}
+
+// Applies recorded edits to an analysis session one at a time, timing each
+// edit up to its errors being reported, and prints the errors left at the
+// end. The median edit is the one to hold steady over input sizes, the
+// first edit far from the last one shifts the items in between.
+// Returns the number of errors left.
+usize replay_edits(StrView input, StrView edits, i32 verbosity) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  Session session = session_make(input);
+  f64 initial = elapsed_ms(start);
+
+  usize count = 0;
+  f64 total = 0;
+  f64Vector* times = f64_vector_make(64);
+  const char* iter = edits.pointer;
+  rcstr end = edits.pointer + edits.length;
+  while (iter != end) {
+    Edit edit = {};
+    iter = parse_edit(iter, end, &edit);
+    StrView text = {
+      .pointer = edit.text,
+      .length = edit.length,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    session_edit(&session, edit.offset, edit.removed, text);
+    session_report(&session, skip_error, nullptr);
+    f64 time = elapsed_ms(start);
+    free(edit.text);
+
+    count += 1;
+    total += time;
+    f64_vector_push(&times, time);
+    if (verbosity > 0) {
+      eprintln("Edit %zu: %.3f ms, %zu errors", count, time, session.errors);
+    }
+  }
+  if (verbosity > 1) {
+    ParserOutput output = session_output(&session);
+    // The items of a session are parsed apart, the locations of the tree
+    // they are merged into point into no one source
+    print_ast(&output.ast, output.tree, (StrView){});
+    ast_free(&output.ast);
+  }
+  usize errors = session_report(&session, print_error, nullptr);
+  qsort(times->buffer, count, sizeof(f64), time_compare);
+  eprintln(
+    "Replayed %zu edits on %zu bytes: initial %.3f ms, mean %.3f ms, median "
+    "%.3f ms, max %.3f ms, %zu errors",
+    count, session.length, initial, count != 0 ? total / (f64)count : 0.0,
+    count != 0 ? times->buffer[count / 2] : 0.0,
+    count != 0 ? times->buffer[count - 1] : 0.0, errors
+  );
+  free(times);
+  session_free(&session);
+  interner_free();
+  return errors;
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include <utility/mod.h>
+
+extern usize replay_edits(StrView input, StrView edits, i32 verbosity);
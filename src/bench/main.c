@@ -0,0 +1,171 @@
+// fopencookie, printouts are hashed as they are written
+#define _GNU_SOURCE
+#include <arena/mod.h>
+#include <bahrc/inputfile.h>
+#include <parser/ctors.h>
+#include <parser/diag.h>
+#include <parser/intern.h>
+#include <parser/lexer.h>
+#include <parser/mod.h>
+#include <parser/scan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utility/mod.h>
+
+// Times one front-end phase on an input file. The phase runs several times
+// and the fastest run is reported, along with a hash of what the first run
+// produced so builds with other flags or thread counts can be checked to
+// agree with each other. count is the number of tokens or of words in the
+// node buffer.
+typedef struct BenchResult BenchResult;
+struct BenchResult {
+  f64 seconds;
+  usize count;
+  usize peak;
+  u64 hash;
+};
+
+typedef struct BenchPhase BenchPhase;
+struct BenchPhase {
+  rcstr name;
+  fn(BenchResult(StrView, usize, bool)) run;
+};
+
+static f64 now_seconds() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (f64)time.tv_sec + (f64)time.tv_nsec * 1e-9;
+}
+
+static u64 hash_word(u64 hash, u64 word) {
+  return (hash ^ word) * 1099511628211u;
+}
+
+// Tokens are hashed by kind, info, end of line flag and position
+static u64 hash_tokens(const TokenStream* tokens) {
+  u64 hash = 14695981039346656037u;
+  for (TokenId id = 0; id < tokens->length; ++id) {
+    hash = hash_word(hash, tokens->kind[id]);
+    hash = hash_word(hash, tokens->info[id]);
+    hash = hash_word(hash, tokens->offset[id]);
+  }
+  return hash;
+}
+
+static BenchResult bench_lex(StrView input, usize threads, bool hash) {
+  Arena arena = {};
+  f64 start = now_seconds();
+  TokenStream tokens = lex_string_parallel(&arena, input, threads);
+  f64 seconds = now_seconds() - start;
+  BenchResult result = {
+    .seconds = seconds,
+    .count = tokens.length,
+    .peak = arena.peak,
+    .hash = hash == true ? hash_tokens(&tokens) : 0,
+  };
+  arena_free(&arena);
+  return result;
+}
+
+static ssize_t hash_write(void* cookie, const char* buffer, size_t size) {
+  u64* hash = cookie;
+  for (size_t i = 0; i < size; ++i) {
+    *hash = hash_word(*hash, (u8)buffer[i]);
+  }
+  return (ssize_t)size;
+}
+
+// The tree is hashed through its printout. Trees parsed on other thread
+// counts number their nodes differently but print the same.
+static u64 hash_tree(const Ast* ast, NodeList tree, StrView input) {
+  u64 hash = 14695981039346656037u;
+  FILE* printout = fopencookie(
+    &hash, "w", (cookie_io_functions_t){ .write = hash_write }
+  );
+  FILE* saved = stderr;
+  stderr = printout;
+  print_ast(ast, tree, input);
+  stderr = saved;
+  fclose(printout);
+  return hash;
+}
+
+// Lexing and parsing the way bahrc does, reachable bodies only
+static BenchResult bench_parse(StrView input, usize threads, bool hash) {
+  f64 start = now_seconds();
+  ParserOutput output = parse_string((ParserOptions){
+    .input = input,
+    .threads = threads,
+  });
+  f64 seconds = now_seconds() - start;
+  if (diag_flush() != 0) {
+    exit(1);
+  }
+  BenchResult result = {
+    .seconds = seconds,
+    .count = output.ast.length,
+    .peak = output.lex_peak,
+    .hash = hash == true ? hash_tree(&output.ast, output.tree, input) : 0,
+  };
+  ast_free(&output.ast);
+  interner_free();
+  return result;
+}
+
+static const BenchPhase phases[] = {
+  { "lex", bench_lex },
+  { "parse", bench_parse },
+};
+
+static void usage() {
+  eputs("Usage: bahr-bench <phase> <input-file> [threads] [runs]");
+  eputs("  - Phases: lex, parse");
+  eputs("  - Threads default to the number of online processors");
+  eputs("  - Runs default to 5, the fastest one is reported");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+  const BenchPhase* phase = nullptr;
+  for (usize i = 0; i < sizeof_arr(phases); ++i) {
+    if (strcmp(argv[1], phases[i].name) == 0) {
+      phase = &phases[i];
+    }
+  }
+  if (phase == nullptr) {
+    usage();
+    return 1;
+  }
+  usize threads = argc > 3 ? (usize)atoi(argv[3]) : 0;
+  threads = threads != 0 ? threads : hardware_threads();
+  usize runs = argc > 4 ? (usize)atoi(argv[4]) : 5;
+  runs = max(runs, (usize)1);
+
+  Inputfile file = inputfile_make((StrView){
+    .length = strlen(argv[2]),
+    .pointer = argv[2],
+  });
+  BenchResult best = {};
+  for (usize i = 0; i < runs; ++i) {
+    BenchResult result = phase->run(file.content, threads, i == 0);
+    if (i == 0) {
+      best = result;
+    } else if (result.seconds < best.seconds) {
+      best.seconds = result.seconds;
+    }
+  }
+  printf(
+    "%s simd=%d threads=%zu count=%zu hash=%016llx best=%.3f ms "
+    "%.1f MB/s peak=%zu bytes\n",
+    phase->name, SCAN_SIMD, threads, best.count, (unsigned long long)best.hash,
+    best.seconds * 1e3, (f64)file.content.length / best.seconds / 1e6,
+    best.peak
+  );
+  inputfile_free(file);
+  return 0;
+}
@@ -3,7 +3,12 @@
 #include <llvm-c/Core.h>
 #include <llvm-c/TargetMachine.h>
 #include <llvm-c/Types.h>
+#include <parser/cache.h>
+#include <parser/diag.h>
+#include <parser/fold.h>
 #include <parser/mod.h>
+#include <parser/number.h>
+#include <parser/sema.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,8 +19,10 @@ typedef struct CodegenOptions CodegenOptions;
 struct CodegenOptions {
   StrView input_name;
   StrView output_name;
-  Node* tree;
+  const Ast* ast;
+  NodeList tree;
   bool verbose;
+  bool no_emit;
 };
 
 static void codegen_generate(CodegenOptions opts);
@@ -24,16 +31,48 @@ void compile_string(CompileOptions opts) {
   ParserOutput ast = parse_string((ParserOptions){
     .verbose = opts.verbosity_level > 1,
     .input = opts.input_string,
+    .threads = opts.threads,
+    .error_limit = opts.error_limit,
+    .eager = opts.eager,
+    .cache_dir = opts.cache_dir,
   });
+  if (diag_flush() != 0) {
+    ast_free(&ast.ast);
+    interner_free();
+    exit(1);
+  }
+  if (opts.verbosity_level > 0 && opts.cache_dir.length != 0) {
+    CacheStats stats = cache_stats();
+    eprintln("AST cache: %zu hits, %zu misses", stats.hits, stats.misses);
+  }
+  if (opts.verbosity_level > 0) {
+    eprintln("Lex arena peak: %zu bytes", ast.lex_peak);
+  }
+  if (sema_check(&ast.ast, ast.tree, opts.input_string) != 0) {
+    diag_flush();
+    ast_free(&ast.ast);
+    interner_free();
+    exit(1);
+  }
+  usize folded = fold_tree(&ast.ast, ast.tree);
+  if (opts.verbosity_level > 0) {
+    eprintln("Constant folding removed %zu nodes", folded);
+  }
 
   codegen_generate((CodegenOptions){
     .verbose = opts.verbosity_level > 0,
     .input_name = opts.input_filename,
     .output_name = opts.output_filename,
+    .ast = &ast.ast,
     .tree = ast.tree,
+    .no_emit = opts.no_emit,
   });
 
-  arena_free(&ast.arena);
+  if (opts.verbosity_level > 0) {
+    eprintln("AST arena peak: %zu bytes", ast.ast.arena.peak);
+  }
+  ast_free(&ast.ast);
+  interner_free();
 }
 
 DEFINE_VECTOR(LLVMValueRef)
@@ -42,14 +81,13 @@ DEFINE_VEC_FNS(LLVMValueRef, malloc, free)
 DEFINE_VECTOR(LLVMTypeRef)
 DEFINE_VEC_FNS(LLVMTypeRef, malloc, free)
 
-DEFINE_VECTOR(rcstr)
-DEFINE_VEC_FNS(rcstr, malloc, free)
+DEFINE_VEC_FNS(Symbol, malloc, free)
 
 typedef struct {
   LLVMValueRef value;
   LLVMTypeRef type;
-  rcstrVector* arg_names;
-  rcstr name;
+  SymbolVector* arg_names;
+  Symbol name;
 } DeclFn;
 
 DEFINE_VECTOR(DeclFn)
@@ -57,27 +95,25 @@ DEFINE_VEC_FNS(DeclFn, malloc, free)
 
 typedef struct {
   LLVMValueRef variable;
-  rcstr name;
+  Symbol name;
   bool is_ptr;
 } DeclVar;
 
 DEFINE_VECTOR(DeclVar)
 DEFINE_VEC_FNS(DeclVar, malloc, free)
 
-static DeclFn* get_decl_fn(DeclFnVector* funcs, StrNode* name) {
+static DeclFn* get_decl_fn(DeclFnVector* funcs, Symbol name) {
   for (usize i = 0; i < funcs->length; ++i) {
-    if (memcmp(name->array, funcs->buffer[i].name, name->capacity) == 0 &&
-        funcs->buffer[i].name[name->capacity] == 0) {
+    if (funcs->buffer[i].name == name) {
       return &funcs->buffer[i];
     }
   }
   return nullptr;
 }
 
-static DeclVar* get_decl_var(DeclVarVector* vars, StrNode* name) {
+static DeclVar* get_decl_var(DeclVarVector* vars, Symbol name) {
   for (usize i = 0; i < vars->length; ++i) {
-    if (memcmp(name->array, vars->buffer[i].name, name->capacity) == 0 &&
-        vars->buffer[i].name[name->capacity] == 0) {
+    if (vars->buffer[i].name == name) {
       return &vars->buffer[i];
     }
   }
@@ -107,12 +143,44 @@ static void codegen_dispose(Codegen gen) {
   LLVMContextDispose(gen.context);
 }
 
+// How an expression is used once it is built: as it is, loaded when it names
+// a place, or loaded and compared against zero
+typedef enum ValueUse ValueUse;
+enum ValueUse {
+  VU_Place,
+  VU_RValue,
+  VU_Truth,
+};
+
+// An expression waiting for its operands to be built, they are built one at
+// a time in evaluation order and their values pushed on the value stack.
+// stage counts the operands pushed so far, values is where the ones of the
+// frame start. The arguments of a call are built in stage order, the blocks
+// are those of the two sides of "&&" and "||" and the one they join in.
+typedef struct CodegenFrame CodegenFrame;
+struct CodegenFrame {
+  NodeId id;
+  u32 stage;
+  ValueUse use;
+  usize values;
+  LLVMBasicBlockRef lhs_block;
+  LLVMBasicBlockRef end_block;
+};
+
+DEFINE_VECTOR(CodegenFrame)
+DEFINE_VEC_FNS(CodegenFrame, malloc, free)
+
+// Expressions are built from explicit stacks shared by every function of the
+// module, none of the builders recurse into the operands of an expression
 typedef struct CContext CContext;
 struct CContext {
   Codegen gen;
+  const Ast* ast;
   DeclFn* func;
-  DeclFnVector* funcs;
-  DeclVarVector* vars;
+  DeclFnVector** funcs;
+  DeclVarVector** vars;
+  CodegenFrameVector** frames;
+  LLVMValueRefVector** values;
 };
 
 unreturning static void print_cdgn_err(NodeKind kind) {
@@ -137,19 +205,20 @@ unreturning static void print_cdgn_err(NodeKind kind) {
   exit(1);
 }
 
-static bool is_integer(Node* node) {
+static bool is_integer(const Node* node) {
   return node->type.kind == TP_SInt || node->type.kind == TP_UInt;
 }
 
-static LLVMValueRef codegen_reg_fns(CContext cx, Node* node);
-static LLVMValueRef codegen_function(CContext cx, Node* node);
-static LLVMValueRef codegen_parse(CContext cx, Node* node);
-static LLVMValueRef codegen_oper(CContext cx, Node* node);
-static LLVMValueRef codegen_value(CContext cx, Node* node);
-static LLVMValueRef codegen_call(CContext cx, Node* node);
-static LLVMTypeRef codegen_type(CContext cx, Node* node);
+static LLVMValueRef codegen_reg_fns(CContext cx, NodeId id);
+static LLVMValueRef codegen_function(CContext cx, NodeId id);
+static LLVMValueRef codegen_parse(CContext cx, NodeId id);
+static LLVMValueRef codegen_expr(CContext cx, NodeId id, ValueUse use);
+static LLVMValueRef codegen_value(CContext cx, NodeId id);
+static LLVMValueRef codegen_rvalue(CContext cx, NodeId id);
+static LLVMValueRef codegen_truth(CContext cx, NodeId id);
+static LLVMTypeRef codegen_type(CContext cx, NodeId id);
 static LLVMBasicBlockRef codegen_parse_block(
-  CContext cx, Node* node, rcstr name
+  CContext cx, NodeId id, rcstr name
 );
 
 char* alloc_tmp_outname(StrView filename) {
@@ -171,21 +240,30 @@ void codegen_generate(CodegenOptions opts) {
     eputw(opts.input_name);
     exit(1);
   }
+  DeclFnVector* fns = DeclFn_vector_make(8);
+  CodegenFrameVector* frames = CodegenFrame_vector_make(64);
+  LLVMValueRefVector* values = LLVMValueRef_vector_make(64);
   CContext cx = {
     .gen = codegen_make(opts.input_name),
-    .funcs = DeclFn_vector_make(8),
+    .ast = opts.ast,
+    .funcs = &fns,
+    .frames = &frames,
+    .values = &values,
   };
 
-  for (Node* func = opts.tree; func != nullptr; func = func->next) {
-    unused LLVMValueRef ret = codegen_reg_fns(cx, func);
+  const NodeId* funcs = ast_list(cx.ast, opts.tree);
+  for (u32 i = 0; i < opts.tree.count; ++i) {
+    unused LLVMValueRef ret = codegen_reg_fns(cx, funcs[i]);
   }
-  for (Node* func = opts.tree; func != nullptr; func = func->next) {
-    unused LLVMValueRef ret = codegen_function(cx, func);
+  for (u32 i = 0; i < opts.tree.count; ++i) {
+    unused LLVMValueRef ret = codegen_function(cx, funcs[i]);
   }
-  for (usize i = 0; i < cx.funcs->length; ++i) {
-    free(cx.funcs->buffer[i].arg_names);
+  for (usize i = 0; i < fns->length; ++i) {
+    free(fns->buffer[i].arg_names);
   }
-  free(cx.funcs);
+  free(fns);
+  free(frames);
+  free(values);
 
   if (opts.verbose) {
     LLVMDumpModule(cx.gen.module);
@@ -200,6 +278,10 @@ void codegen_generate(CodegenOptions opts) {
     exit(1);
   }
   LLVMDisposeMessage(message);
+  if (opts.no_emit == true) {
+    codegen_dispose(cx.gen);
+    return;
+  }
 
   LLVMInitializeAllTargetInfos();
   LLVMInitializeAllTargets();
@@ -240,30 +322,35 @@ void codegen_generate(CodegenOptions opts) {
   codegen_dispose(cx.gen);
 }
 
-static LLVMValueRef codegen_reg_fns(CContext cx, Node* node) {
-  LLVMTypeRefVector* arg_types = LLVMTypeRef_vector_make(2);
-  rcstrVector* arg_names = rcstr_vector_make(2);
+static LLVMValueRef codegen_reg_fns(CContext cx, NodeId id) {
+  Node* node = ast_get(cx.ast, id);
+  NodeList args = node->function.args;
+  LLVMTypeRefVector* arg_types = LLVMTypeRef_vector_make(args.count);
+  SymbolVector* arg_names = Symbol_vector_make(args.count);
 
-  for (Node* arg = node->function.args; arg != nullptr; arg = arg->next) {
-    LLVMTypeRef type = codegen_type(cx, arg->declaration.type);
-    LLVMTypeRef_vector_push(&arg_types, type);
-    rcstr_vector_push(&arg_names, arg->declaration.name->array);
+  for (u32 i = 0; i < args.count; ++i) {
+    Node* arg = ast_get(cx.ast, ast_list(cx.ast, args)[i]);
+    arg_types->buffer[i] = codegen_type(cx, arg->declaration.type);
+    arg_names->buffer[i] = arg->declaration.name;
   }
+  arg_types->length = args.count;
+  arg_names->length = args.count;
   LLVMTypeRef ret_type = codegen_type(cx, node->function.ret_type);
 
   LLVMTypeRef function_type =
     LLVMFunctionType(ret_type, arg_types->buffer, arg_types->length, false);
-  LLVMValueRef function =
-    LLVMAddFunction(cx.gen.module, node->function.name->array, function_type);
+  LLVMValueRef function = LLVMAddFunction(
+    cx.gen.module, symbol_str(node->function.name), function_type
+  );
 
   if (node->function.linkage == LN_Private) {
     LLVMSetLinkage(function, LLVMInternalLinkage);
   }
 
   DeclFn_vector_push(
-    &cx.funcs,
+    cx.funcs,
     (DeclFn){
-      .name = node->function.name->array,
+      .name = node->function.name,
       .value = function,
       .type = function_type,
       .arg_names = arg_names,
@@ -274,12 +361,14 @@ static LLVMValueRef codegen_reg_fns(CContext cx, Node* node) {
   return function;
 }
 
-static LLVMValueRef codegen_function(CContext cx, Node* node) {
-  if (node->function.body == nullptr) {
+static LLVMValueRef codegen_function(CContext cx, NodeId id) {
+  Node* node = ast_get(cx.ast, id);
+  if (node->function.body == 0) {
     return nullptr;
   }
-  cx.vars = DeclVar_vector_make(8);
-  cx.func = get_decl_fn(cx.funcs, node->function.name);
+  DeclVarVector* vars = DeclVar_vector_make(8);
+  cx.vars = &vars;
+  cx.func = get_decl_fn(*cx.funcs, node->function.name);
 
   usize arg_count = LLVMCountParams(cx.func->value);
   LLVMTypeRefVector* arg_types = LLVMTypeRef_vector_make(arg_count);
@@ -290,14 +379,15 @@ static LLVMValueRef codegen_function(CContext cx, Node* node) {
   LLVMPositionBuilderAtEnd(cx.gen.builder, block);
 
   for (usize i = 0; i < arg_count; ++i) {
-    rcstr name = cx.func->arg_names->buffer[i];
-    LLVMValueRef decl =
-      LLVMBuildAlloca(cx.gen.builder, arg_types->buffer[i], name);
+    Symbol name = cx.func->arg_names->buffer[i];
+    LLVMValueRef decl = LLVMBuildAlloca(
+      cx.gen.builder, arg_types->buffer[i], symbol_str(name)
+    );
     LLVMValueRef val = LLVMGetParam(cx.func->value, i);
     LLVMBuildStore(cx.gen.builder, val, decl);
 
     DeclVar_vector_push(
-      &cx.vars,
+      cx.vars,
       (DeclVar){
         .name = name,
         .variable = decl,
@@ -306,43 +396,42 @@ static LLVMValueRef codegen_function(CContext cx, Node* node) {
     );
   }
 
-  for (Node* branch = node->function.body->unary; branch != nullptr;
-       branch = branch->next) {
-    unused LLVMValueRef ret = codegen_parse(cx, branch);
+  NodeList body = ast_get(cx.ast, node->function.body)->block;
+  for (u32 i = 0; i < body.count; ++i) {
+    unused LLVMValueRef ret = codegen_parse(cx, ast_list(cx.ast, body)[i]);
   }
 
   free(arg_types);
-  free(cx.vars);
+  free(vars);
   return cx.func->value;
 }
 
 static LLVMBasicBlockRef codegen_parse_block(
-  CContext cx, Node* node, rcstr name
+  CContext cx, NodeId id, rcstr name
 ) {
+  Node* node = ast_get(cx.ast, id);
   LLVMBasicBlockRef entry =
     LLVMAppendBasicBlockInContext(cx.gen.context, cx.func->value, name);
   LLVMPositionBuilderAtEnd(cx.gen.builder, entry);
 
-  for (Node* branch = node->unary; branch != nullptr; branch = branch->next) {
-    unused LLVMValueRef ret = codegen_parse(cx, branch);
+  for (u32 i = 0; i < node->block.count; ++i) {
+    unused LLVMValueRef ret =
+      codegen_parse(cx, ast_list(cx.ast, node->block)[i]);
   }
   return entry;
 }
 
-static LLVMValueRef codegen_parse(CContext cx, Node* node) {
-  if (node->kind == ND_Operation) {
-    return codegen_oper(cx, node);
-
-  } else if (node->kind == ND_Negation) {
-    LLVMValueRef value = codegen_parse(cx, node->unary);
-    return LLVMBuildNeg(cx.gen.builder, value, "neg");
+// Statements, expressions are built by codegen_expr
+static LLVMValueRef codegen_parse(CContext cx, NodeId id) {
+  Node* node = ast_get(cx.ast, id);
+  if (node->kind == ND_Operation || node->kind == ND_Negation ||
+      node->kind == ND_Value || node->kind == ND_Variable ||
+      node->kind == ND_Addr || node->kind == ND_Deref ||
+      node->kind == ND_Call) {
+    return codegen_expr(cx, id, VU_Place);
 
   } else if (node->kind == ND_Return) {
-    LLVMValueRef val = codegen_parse(cx, node->unary);
-    if (node->unary->kind == ND_Variable) {
-      LLVMTypeRef val_type = codegen_type(cx, node->unary);
-      val = LLVMBuildLoad2(cx.gen.builder, val_type, val, "");
-    }
+    LLVMValueRef val = codegen_rvalue(cx, node->unary);
     return LLVMBuildRet(cx.gen.builder, val);
 
   } else if (node->kind == ND_Type) {
@@ -351,31 +440,21 @@ static LLVMValueRef codegen_parse(CContext cx, Node* node) {
 
   } else if (node->kind == ND_Decl) {
     LLVMTypeRef type = codegen_type(cx, node->declaration.type);
-    LLVMValueRef decl =
-      LLVMBuildAlloca(cx.gen.builder, type, node->declaration.name->array);
-    LLVMValueRef val = codegen_parse(cx, node->declaration.value);
+    LLVMValueRef decl = LLVMBuildAlloca(
+      cx.gen.builder, type, symbol_str(node->declaration.name)
+    );
+    LLVMValueRef val = codegen_rvalue(cx, node->declaration.value);
     LLVMBuildStore(cx.gen.builder, val, decl);
 
     DeclVar_vector_push(
-      &cx.vars,
+      cx.vars,
       (DeclVar){
         .variable = decl,
-        .name = node->declaration.name->array,
+        .name = node->declaration.name,
       }
     );
     return decl;
 
-  } else if (node->kind == ND_Value) {
-    return codegen_value(cx, node);
-
-  } else if (node->kind == ND_Variable) {
-    DeclVar* decl_var = get_decl_var(cx.vars, node->unary->declaration.name);
-    if (decl_var == nullptr) {
-      eputs("ND_Variable not found");
-      exit(1);
-    }
-    return decl_var->variable;
-
   } else if (node->kind == ND_ArgVar) {
     eputs("Raw ND_ArgVar unimplemented");
     exit(1);
@@ -384,23 +463,12 @@ static LLVMValueRef codegen_parse(CContext cx, Node* node) {
     eputs("Raw ND_Block unimplemented");
     exit(1);
 
-  } else if (node->kind == ND_Addr) {
-    eputs("ND_Addr unimplemented");
-    exit(1);
-
-  } else if (node->kind == ND_Deref) {
-    LLVMTypeRef type = codegen_type(cx, node->unary);
-    LLVMValueRef ptr = codegen_parse(cx, node->unary);
-    LLVMValueRef load =
-      LLVMBuildLoad2(cx.gen.builder, LLVMPointerType(type, 0), ptr, "");
-    return load;
-
   } else if (node->kind == ND_Function) {
     eputs("Raw ND_Function unimplemented");
     exit(1);
 
   } else if (node->kind == ND_If) {
-    LLVMValueRef cond = codegen_parse(cx, node->if_node.cond);
+    LLVMValueRef cond = codegen_truth(cx, node->if_node.cond);
     LLVMBasicBlockRef then =
       codegen_parse_block(cx, node->if_node.then, "if_then");
     LLVMBasicBlockRef elseb =
@@ -411,81 +479,334 @@ static LLVMValueRef codegen_parse(CContext cx, Node* node) {
   } else if (node->kind == ND_While) {
     eputs("ND_While unimplemented");
     exit(1);
-
-  } else if (node->kind == ND_Call) {
-    return codegen_call(cx, node);
   }
   print_cdgn_err(node->kind);
 }
 
-static LLVMValueRef codegen_oper(CContext cx, Node* node) {
-  if (node->operation.kind == OP_Asg) {
-    if (node->operation.lhs->kind != ND_Variable) {
-      eputs("Variable required on left side for assignment");
-      exit(1);
-    }
-    LLVMValueRef lhs = codegen_parse(cx, node->operation.lhs);
-    LLVMValueRef rhs = codegen_parse(cx, node->operation.rhs);
-    if (node->operation.rhs->kind == ND_Variable) {
-      LLVMTypeRef rhs_type = codegen_type(cx, node->operation.rhs);
-      rhs = LLVMBuildLoad2(cx.gen.builder, rhs_type, rhs, "");
+// Places are read with a load of the type semantic analysis gave them
+static LLVMValueRef codegen_rvalue(CContext cx, NodeId id) {
+  return codegen_expr(cx, id, VU_RValue);
+}
+
+static LLVMValueRef codegen_truth(CContext cx, NodeId id) {
+  return codegen_expr(cx, id, VU_Truth);
+}
+
+static LLVMValueRef codegen_use(
+  CContext cx, NodeId id, ValueUse use, LLVMValueRef value
+) {
+  if (use == VU_Place) {
+    return value;
+  }
+  if (ast_get(cx.ast, id)->category == VC_LValue) {
+    LLVMTypeRef type = codegen_type(cx, expr_type(cx.ast, id));
+    value = LLVMBuildLoad2(cx.gen.builder, type, value, "");
+  }
+  if (use != VU_Truth) {
+    return value;
+  }
+  LLVMTypeRef type = LLVMTypeOf(value);
+  if (LLVMGetIntTypeWidth(type) == 1) {
+    return value;
+  }
+  LLVMValueRef zero = LLVMConstInt(type, 0, false);
+  return LLVMBuildICmp(cx.gen.builder, LLVMIntNE, value, zero, "truth");
+}
+
+static void push_expr(CContext cx, NodeId id, ValueUse use) {
+  CodegenFrame frame = {
+    .id = id,
+    .use = use,
+    .values = (*cx.values)->length,
+  };
+  CodegenFrame_vector_push(cx.frames, frame);
+}
+
+static LLVMValueRef pop_value(CContext cx) {
+  (*cx.values)->length -= 1;
+  return (*cx.values)->buffer[(*cx.values)->length];
+}
+
+// "&&" and "||" only evaluate their right side when the left one does not
+// already decide the result
+static bool step_logic(CContext cx, CodegenFrame* frame, LLVMValueRef* value) {
+  Node* node = ast_get(cx.ast, frame->id);
+  bool is_and = node->operation.kind == OP_And;
+  if (frame->stage == 0) {
+    push_expr(cx, node->operation.lhs, VU_Truth);
+    return false;
+  }
+  if (frame->stage == 1) {
+    LLVMValueRef lhs = pop_value(cx);
+    frame->lhs_block = LLVMGetInsertBlock(cx.gen.builder);
+    LLVMBasicBlockRef rhs_block = LLVMAppendBasicBlockInContext(
+      cx.gen.context, cx.func->value, "logic_rhs"
+    );
+    frame->end_block = LLVMAppendBasicBlockInContext(
+      cx.gen.context, cx.func->value, "logic_end"
+    );
+    if (is_and == true) {
+      LLVMBuildCondBr(cx.gen.builder, lhs, rhs_block, frame->end_block);
+    } else {
+      LLVMBuildCondBr(cx.gen.builder, lhs, frame->end_block, rhs_block);
     }
-    return LLVMBuildStore(cx.gen.builder, rhs, lhs);
+    LLVMPositionBuilderAtEnd(cx.gen.builder, rhs_block);
+    push_expr(cx, node->operation.rhs, VU_Truth);
+    return false;
   }
 
-  LLVMValueRef lhs = codegen_parse(cx, node->operation.lhs);
-  if (node->operation.lhs->kind == ND_Variable) {
-    LLVMTypeRef lhs_type = codegen_type(cx, node->operation.lhs);
-    lhs = LLVMBuildLoad2(cx.gen.builder, lhs_type, lhs, "");
+  LLVMValueRef rhs = pop_value(cx);
+  LLVMBasicBlockRef rhs_block = LLVMGetInsertBlock(cx.gen.builder);
+  LLVMBuildBr(cx.gen.builder, frame->end_block);
+
+  LLVMPositionBuilderAtEnd(cx.gen.builder, frame->end_block);
+  LLVMTypeRef bool_type = LLVMInt1TypeInContext(cx.gen.context);
+  LLVMValueRef phi = LLVMBuildPhi(cx.gen.builder, bool_type, "logic");
+  LLVMValueRef values[] = {
+    LLVMConstInt(bool_type, is_and == true ? 0 : 1, false),
+    rhs,
+  };
+  LLVMBasicBlockRef blocks[] = { frame->lhs_block, rhs_block };
+  LLVMAddIncoming(phi, values, blocks, 2);
+  *value = phi;
+  return true;
+}
+
+// The address of an element, of an array in place or through a pointer. The
+// index is built before the indexed value.
+static bool step_index(CContext cx, CodegenFrame* frame, LLVMValueRef* value) {
+  Node* node = ast_get(cx.ast, frame->id);
+  NodeId base = expr_type(cx.ast, node->operation.lhs);
+  bool in_place = ast_get(cx.ast, base)->type.kind == TP_Arr;
+  if (frame->stage == 0) {
+    push_expr(cx, node->operation.rhs, VU_RValue);
+    return false;
+  } else if (frame->stage == 1) {
+    ValueUse use = in_place == true ? VU_Place : VU_RValue;
+    push_expr(cx, node->operation.lhs, use);
+    return false;
   }
-  LLVMValueRef rhs = codegen_parse(cx, node->operation.rhs);
-  if (node->operation.rhs->kind == ND_Variable) {
-    LLVMTypeRef rhs_type = codegen_type(cx, node->operation.rhs);
-    rhs = LLVMBuildLoad2(cx.gen.builder, rhs_type, rhs, "");
+  LLVMValueRef indexed = pop_value(cx);
+  LLVMValueRef index = pop_value(cx);
+  if (in_place == true) {
+    LLVMValueRef indices[] = {
+      LLVMConstInt(LLVMTypeOf(index), 0, false),
+      index,
+    };
+    *value = LLVMBuildInBoundsGEP2(
+      cx.gen.builder, codegen_type(cx, base), indexed, indices, 2, "arr_idx"
+    );
+    return true;
   }
+  LLVMTypeRef element = codegen_type(cx, node->operation.type);
+  *value = LLVMBuildInBoundsGEP2(
+    cx.gen.builder, element, indexed, &index, 1, "arr_idx"
+  );
+  return true;
+}
+
+// Divisions, remainders, right shifts and orderings are signed for signed
+// operands and unsigned otherwise, the way number_binary folds them
+static LLVMValueRef build_binary(
+  CContext cx, const Node* node, LLVMValueRef lhs, LLVMValueRef rhs
+) {
+  NodeId type = expr_type(cx.ast, node->operation.lhs);
+  bool is_signed = ast_get(cx.ast, type)->type.kind == TP_SInt;
+  LLVMBuilderRef builder = cx.gen.builder;
   switch (node->operation.kind) {
     case OP_Add:
-      return LLVMBuildAdd(cx.gen.builder, lhs, rhs, "add");
+      return LLVMBuildAdd(builder, lhs, rhs, "add");
     case OP_Sub:
-      return LLVMBuildSub(cx.gen.builder, lhs, rhs, "sub");
+      return LLVMBuildSub(builder, lhs, rhs, "sub");
     case OP_Mul:
-      return LLVMBuildMul(cx.gen.builder, lhs, rhs, "mul");
+      return LLVMBuildMul(builder, lhs, rhs, "mul");
     case OP_Div:
-      return LLVMBuildUDiv(cx.gen.builder, lhs, rhs, "div");
+      return is_signed == true ? LLVMBuildSDiv(builder, lhs, rhs, "div")
+                               : LLVMBuildUDiv(builder, lhs, rhs, "div");
+    case OP_Mod:
+      return is_signed == true ? LLVMBuildSRem(builder, lhs, rhs, "mod")
+                               : LLVMBuildURem(builder, lhs, rhs, "mod");
+    case OP_Shl:
+      return LLVMBuildShl(builder, lhs, rhs, "shl");
+    case OP_Shr:
+      return is_signed == true ? LLVMBuildAShr(builder, lhs, rhs, "shr")
+                               : LLVMBuildLShr(builder, lhs, rhs, "shr");
+    case OP_BitAnd:
+      return LLVMBuildAnd(builder, lhs, rhs, "bit_and");
+    case OP_BitOr:
+      return LLVMBuildOr(builder, lhs, rhs, "bit_or");
+    case OP_BitXor:
+      return LLVMBuildXor(builder, lhs, rhs, "bit_xor");
     case OP_Eq:
-      return LLVMBuildICmp(cx.gen.builder, LLVMIntEQ, lhs, rhs, "eq");
+      return LLVMBuildICmp(builder, LLVMIntEQ, lhs, rhs, "eq");
     case OP_NEq:
-      return LLVMBuildICmp(cx.gen.builder, LLVMIntNE, lhs, rhs, "neq");
+      return LLVMBuildICmp(builder, LLVMIntNE, lhs, rhs, "neq");
     case OP_Lt:
-      return LLVMBuildICmp(cx.gen.builder, LLVMIntSLT, lhs, rhs, "lt");
+      return LLVMBuildICmp(
+        builder, is_signed == true ? LLVMIntSLT : LLVMIntULT, lhs, rhs, "lt"
+      );
     case OP_Lte:
-      return LLVMBuildICmp(cx.gen.builder, LLVMIntSLE, lhs, rhs, "lte");
+      return LLVMBuildICmp(
+        builder, is_signed == true ? LLVMIntSLE : LLVMIntULE, lhs, rhs, "lte"
+      );
     case OP_Gt:
-      return LLVMBuildICmp(cx.gen.builder, LLVMIntSGT, lhs, rhs, "gt");
+      return LLVMBuildICmp(
+        builder, is_signed == true ? LLVMIntSGT : LLVMIntUGT, lhs, rhs, "gt"
+      );
     case OP_Gte:
-      return LLVMBuildICmp(cx.gen.builder, LLVMIntSGE, lhs, rhs, "gte");
+      return LLVMBuildICmp(
+        builder, is_signed == true ? LLVMIntSGE : LLVMIntUGE, lhs, rhs, "gte"
+      );
     case OP_Asg:
-      print_cdgn_err(node->kind);
+      return LLVMBuildStore(builder, rhs, lhs);
+    case OP_And:
+    case OP_Or:
     case OP_ArrIdx:
-      return LLVMBuildInBoundsGEP2(
-        cx.gen.builder, LLVMTypeOf(lhs), lhs, &rhs, 1, "arr_idx"
-      );
+      print_cdgn_err(node->kind);
   }
   print_cdgn_err(node->kind);
 }
 
-static LLVMValueRef codegen_value(CContext cx, Node* node) {
-  if (is_integer(node->value.type) == true) {
+static bool step_oper(CContext cx, CodegenFrame* frame, LLVMValueRef* value) {
+  Node* node = ast_get(cx.ast, frame->id);
+  if (node->operation.kind == OP_And || node->operation.kind == OP_Or) {
+    return step_logic(cx, frame, value);
+  } else if (node->operation.kind == OP_ArrIdx) {
+    return step_index(cx, frame, value);
+  }
+  // The place assigned to is built as it is, operands are read
+  if (frame->stage == 0) {
+    ValueUse use = node->operation.kind == OP_Asg ? VU_Place : VU_RValue;
+    push_expr(cx, node->operation.lhs, use);
+    return false;
+  } else if (frame->stage == 1) {
+    push_expr(cx, node->operation.rhs, VU_RValue);
+    return false;
+  }
+  LLVMValueRef rhs = pop_value(cx);
+  LLVMValueRef lhs = pop_value(cx);
+  *value = build_binary(cx, node, lhs, rhs);
+  return true;
+}
+
+// Builds the arguments of a call one at a time, the call is built with the
+// values they leave on the value stack
+static bool step_call(CContext cx, CodegenFrame* frame, LLVMValueRef* value) {
+  Node* node = ast_get(cx.ast, frame->id);
+  NodeList arg_nodes = node->call_node.args;
+  if (frame->stage < arg_nodes.count) {
+    push_expr(cx, ast_list(cx.ast, arg_nodes)[frame->stage], VU_RValue);
+    return false;
+  }
+  DeclFn* decl_fn = get_decl_fn(*cx.funcs, node->call_node.name);
+  if (decl_fn == nullptr) {
+    eputs("ND_Call function not found");
+    exit(1);
+  }
+  LLVMValueRef* args = (*cx.values)->buffer + frame->values;
+  usize count = (*cx.values)->length - frame->values;
+  *value = LLVMBuildCall2(
+    cx.gen.builder, decl_fn->type, decl_fn->value, args, count,
+    symbol_str(decl_fn->name)
+  );
+  (*cx.values)->length = frame->values;
+  return true;
+}
+
+// Advances the frame, its operands left their values on the value stack.
+// Returns false after pushing another operand, true once the frame is done
+// with the value of its expression.
+static bool codegen_step(
+  CContext cx, CodegenFrame* frame, LLVMValueRef* value
+) {
+  Node* node = ast_get(cx.ast, frame->id);
+  switch (node->kind) {
+    case ND_Operation:
+      return step_oper(cx, frame, value);
+
+    case ND_Negation:
+    case ND_Addr:
+    case ND_Deref:
+      // The operand of an address is the place it takes
+      if (frame->stage == 0) {
+        ValueUse use = node->kind == ND_Addr ? VU_Place : VU_RValue;
+        push_expr(cx, node->unary, use);
+        return false;
+      }
+      *value = pop_value(cx);
+      if (node->kind == ND_Negation) {
+        *value = LLVMBuildNeg(cx.gen.builder, *value, "neg");
+      }
+      return true;
+
+    case ND_Value:
+      *value = codegen_value(cx, frame->id);
+      return true;
+
+    case ND_Variable: {
+      Node* decl = ast_get(cx.ast, node->unary);
+      DeclVar* decl_var = get_decl_var(*cx.vars, decl->declaration.name);
+      if (decl_var == nullptr) {
+        eputs("ND_Variable not found");
+        exit(1);
+      }
+      *value = decl_var->variable;
+      return true;
+    }
+
+    case ND_Call:
+      return step_call(cx, frame, value);
+
+    default:
+      *value = codegen_parse(cx, frame->id);
+      return true;
+  }
+}
+
+// Builds the expression at id and its operands without recursing into them
+static LLVMValueRef codegen_expr(CContext cx, NodeId id, ValueUse use) {
+  usize base = (*cx.frames)->length;
+  push_expr(cx, id, use);
+  while ((*cx.frames)->length > base) {
+    usize top = (*cx.frames)->length - 1;
+    // The frame is copied out, pushing an operand may move the stack
+    CodegenFrame frame = (*cx.frames)->buffer[top];
+    LLVMValueRef value = nullptr;
+    bool done = codegen_step(cx, &frame, &value);
+    frame.stage += 1;
+    (*cx.frames)->buffer[top] = frame;
+    if (done == true) {
+      (*cx.frames)->length = top;
+      value = codegen_use(cx, frame.id, frame.use, value);
+      LLVMValueRef_vector_push(cx.values, value);
+    }
+  }
+  return pop_value(cx);
+}
+
+static LLVMValueRef codegen_value(CContext cx, NodeId id) {
+  Node* node = ast_get(cx.ast, id);
+  Node* value_type = ast_get(cx.ast, node->value.type);
+  if (is_integer(value_type) == true) {
     LLVMTypeRef type = codegen_type(cx, node->value.type);
-    return LLVMConstInt(type, atoi(node->value.basic->array), true);
+    const u32* words = node->value.number.words;
+    const u64 number[] = {
+      (u64)words[1] << 32 | words[0],
+      (u64)words[3] << 32 | words[2],
+    };
+    return LLVMConstIntOfArbitraryPrecision(type, 2, number);
+
+  } else if (value_type->type.kind == TP_Flt) {
+    LLVMTypeRef type = codegen_type(cx, node->value.type);
+    return LLVMConstReal(type, number_flt(node->value.number));
 
-  } else if (node->value.type->type.kind == TP_Str) {
+  } else if (value_type->type.kind == TP_Str) {
+    StrView string = ast_string(cx.ast, node->value.string);
     LLVMTypeRef type = LLVMArrayType(
-      LLVMInt8TypeInContext(cx.gen.context), node->value.basic->capacity + 1
+      LLVMInt8TypeInContext(cx.gen.context), string.length + 1
     );
     LLVMValueRef str_val = LLVMConstStringInContext(
-      cx.gen.context, node->value.basic->array, node->value.basic->capacity,
-      false
+      cx.gen.context, string.pointer, string.length, false
     );
     LLVMValueRef global_str = LLVMAddGlobal(cx.gen.module, type, ".str");
     LLVMSetInitializer(global_str, str_val);
@@ -493,48 +814,17 @@ static LLVMValueRef codegen_value(CContext cx, Node* node) {
     LLVMSetUnnamedAddr(global_str, LLVMGlobalUnnamedAddr);
     LLVMSetAlignment(global_str, 1);
     LLVMSetGlobalConstant(global_str, true);
-    return global_str;
+    return LLVMConstBitCast(global_str, codegen_type(cx, node->value.type));
 
-  } else if (node->value.type->type.kind == TP_Arr) {
+  } else if (value_type->type.kind == TP_Arr) {
     // TODO: Implement array value
   }
   print_cdgn_err(node->kind);
 }
 
-static LLVMValueRef codegen_call(CContext cx, Node* node) {
-  DeclFn* decl_fn = get_decl_fn(cx.funcs, node->call_node.name);
-  if (decl_fn == nullptr) {
-    eputs("ND_Call function not found");
-    exit(1);
-  }
-  LLVMValueRefVector* call_args = LLVMValueRef_vector_make(2);
-  for (Node* arg = node->call_node.args; arg != nullptr; arg = arg->next) {
-    LLVMValueRef value = codegen_parse(cx, arg);
-    if (arg->kind == ND_Variable || arg->kind == ND_Deref ||
-        (arg->kind == ND_Operation && arg->operation.kind == OP_ArrIdx)) {
-      value = LLVMBuildLoad2(cx.gen.builder, LLVMTypeOf(value), value, "");
-    }
-    LLVMValueRef_vector_push(&call_args, value);
-  }
-  LLVMValueRef result = LLVMBuildCall2(
-    cx.gen.builder, decl_fn->type, decl_fn->value, call_args->buffer,
-    call_args->length, decl_fn->name
-  );
-  free(call_args);
-  return result;
-}
-
-static LLVMTypeRef codegen_type(CContext cx, Node* node) {
-  if (node->kind == ND_Variable) {
-    return codegen_type(cx, node->unary);
-
-  } else if (node->kind == ND_Decl || node->kind == ND_ArgVar) {
-    return codegen_type(cx, node->declaration.type);
-
-  } else if (node->kind == ND_Value) {
-    return codegen_type(cx, node->value.type);
-
-  } else if (node->kind == ND_Type) {
+static LLVMTypeRef codegen_type(CContext cx, NodeId id) {
+  Node* node = ast_get(cx.ast, id);
+  if (node->kind == ND_Type) {
     if (is_integer(node)) {
       return LLVMIntTypeInContext(cx.gen.context, node->type.bit_width);
 
@@ -554,6 +844,9 @@ static LLVMTypeRef codegen_type(CContext cx, Node* node) {
     } else if (node->type.kind == TP_Ptr) {
       return LLVMPointerType(codegen_type(cx, node->type.base), 0);
 
+    } else if (node->type.kind == TP_Str) {
+      return LLVMPointerType(LLVMInt8TypeInContext(cx.gen.context), 0);
+
     } else if (node->type.kind == TP_Arr) {
       return LLVMArrayType2(
         codegen_type(cx, node->type.array.base), node->type.array.size
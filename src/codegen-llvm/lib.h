@@ -6,7 +6,12 @@ struct CompileOptions {
   StrView input_string;
   StrView input_filename;
   StrView output_filename;
+  StrView cache_dir;
   u32 verbosity_level;
+  u32 threads;
+  u32 error_limit;
+  bool eager;
+  bool no_emit;
 };
 
 extern void compile_string(CompileOptions opts);
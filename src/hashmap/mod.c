@@ -38,9 +38,11 @@ void hashmap_free(HashMap* map) {
 }
 
 void** hashmap_get(HashMap** map_adrs, StrView key) {
-  HashMap* map = *map_adrs;
-  usize hash = get_hash(key);
+  return hashmap_get_key(map_adrs, get_hash(key));
+}
 
+void** hashmap_get_key(HashMap** map_adrs, usize hash) {
+  HashMap* map = *map_adrs;
   HashNode* entry = get_entry(map, hash);
   if (entry != nullptr) {
     return &entry->value;
@@ -50,8 +52,11 @@ void** hashmap_get(HashMap** map_adrs, StrView key) {
 }
 
 void** hashmap_find(HashMap** map_adrs, StrView key) {
+  return hashmap_find_key(map_adrs, get_hash(key));
+}
+
+void** hashmap_find_key(HashMap** map_adrs, usize hash) {
   HashMap* map = *map_adrs;
-  usize hash = get_hash(key);
   HashNode* entry = get_entry(map, hash);
   if (entry != nullptr) {
     return &entry->value;
@@ -107,12 +112,17 @@ void hashmap_free(HashMap* map_adrs) {
 }
 
 void** hashmap_get(HashMap** map_adrs, StrView key) {
+  return hashmap_get_key(map_adrs, get_hash(key));
+}
+
+// Keys are used as their own hash, so they must be well spread in the low
+// bits and never 0, which marks an empty slot
+void** hashmap_get_key(HashMap** map_adrs, usize hash) {
   HashMap* map = *map_adrs;
   if (map->capacity >= MAP_MAX_LOAD(map->length)) {
     *map_adrs = resize(map);
     map = *map_adrs;
   }
-  usize hash = get_hash(key);
   HashNode* entry = get_entry(map, hash);
   if (entry->key != 0) {
     return &entry->value;
@@ -123,7 +133,10 @@ void** hashmap_get(HashMap** map_adrs, StrView key) {
 }
 
 void** hashmap_find(HashMap** map_adrs, StrView key) {
-  usize hash = get_hash(key);
+  return hashmap_find_key(map_adrs, get_hash(key));
+}
+
+void** hashmap_find_key(HashMap** map_adrs, usize hash) {
   HashNode* entry = get_entry(*map_adrs, hash);
   if (entry->key != 0) {
     return &entry->value;
@@ -217,3 +230,7 @@ static inline usize get_hash(StrView key) {
   }
   return hash;
 }
+
+usize hashmap_hash(StrView key) {
+  return get_hash(key);
+}
@@ -48,3 +48,6 @@ extern HashMap* hashmap_make(usize size);
 extern void hashmap_free(HashMap* map);
 extern void** hashmap_get(HashMap** map_adrs, StrView key);
 extern void** hashmap_find(HashMap** map_adrs, StrView key);
+extern void** hashmap_get_key(HashMap** map_adrs, usize key);
+extern void** hashmap_find_key(HashMap** map_adrs, usize key);
+extern usize hashmap_hash(StrView key);
@@ -0,0 +1,303 @@
+#include <fcntl.h>
+#include <hashmap/mod.h>
+#include <parser/cache.h>
+#include <parser/intern.h>
+#include <parser/mod.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+#include <utility/mod.h>
+
+static const char cache_magic[8] = "BAHRAST";
+
+// The header is followed by the node words, the list buffer, the string
+// buffer, the types table, the symbol spellings and the input, each starting
+// on an 8 byte boundary.
+// Spellings are stored null terminated in symbol order.
+typedef struct CacheHeader CacheHeader;
+struct CacheHeader {
+  char magic[8];
+  u64 hash;
+  u64 build;
+  u64 input_length;
+  NodeList tree;
+  u32 length;
+  u32 lists_length;
+  u32 strings_length;
+  u32 types_length;
+  u32 types_capacity;
+  u32 symbols;
+  u32 symbols_size;
+};
+
+typedef struct CacheLayout CacheLayout;
+struct CacheLayout {
+  usize words;
+  usize lists;
+  usize strings;
+  usize types;
+  usize symbols;
+  usize input;
+  usize size;
+};
+
+static CacheStats stats;
+static u64 build_identity;
+static once_flag build_once = ONCE_FLAG_INIT;
+
+static inline usize align8(usize size) {
+  return (size + 7) & ~(usize)7;
+}
+
+static CacheLayout cache_layout(const CacheHeader* header) {
+  CacheLayout layout = {};
+  layout.words = align8(sizeof(CacheHeader));
+  layout.lists = layout.words + align8(sizeof(u32) * (usize)header->length);
+  layout.strings =
+    layout.lists + align8(sizeof(NodeId) * (usize)header->lists_length);
+  layout.types = layout.strings + align8(header->strings_length);
+  layout.symbols =
+    layout.types + align8(sizeof(NodeId) * (usize)header->types_capacity);
+  layout.input = layout.symbols + align8(header->symbols_size);
+  layout.size = layout.input + header->input_length;
+  return layout;
+}
+
+// The build is told apart by a hash of the compiler binary itself, any change
+// to the parser or to the layout of the tree changes it. It stays 0 when the
+// binary cannot be read, which leaves the cache unused.
+static void build_hash() {
+  i32 fd = open("/proc/self/exe", O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return;
+  }
+  usize size = (usize)info.st_size;
+  void* binary = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (binary == MAP_FAILED) {
+    return;
+  }
+  StrView view = {
+    .pointer = binary,
+    .length = size,
+  };
+  build_identity = (hashmap_hash(view) ^ size) | 1;
+  munmap(binary, size);
+}
+
+CacheKey cache_key(StrView input, bool eager) {
+  call_once(&build_once, build_hash);
+  u64 variant = build_identity ^ (eager == true);
+  u64 hash = hashmap_hash(input) ^ variant * 0x9e3779b97f4a7c15ULL;
+  return (CacheKey){
+    .hash = hash,
+    .build = build_identity,
+    .input = input,
+  };
+}
+
+static char* cache_path(StrView dir, CacheKey key, rcstr suffix) {
+  usize size = dir.length + 64;
+  char* path = malloc(size);
+  if (path == nullptr) {
+    perror("malloc");
+    exit(1);
+  }
+  snprintf(
+    path, size, "%.*s/%016llx%s", (i32)dir.length, dir.pointer,
+    (unsigned long long)key.hash, suffix
+  );
+  return path;
+}
+
+// The hash only names the file, a tree is taken for the input it was parsed
+// from by comparing the copy of the input it was stored with
+static bool cache_valid(const CacheHeader* header, CacheKey key, usize size) {
+  return size >= sizeof(CacheHeader) &&
+         memcmp(header->magic, cache_magic, sizeof(cache_magic)) == 0 &&
+         header->build == key.build && header->hash == key.hash &&
+         header->input_length == key.input.length &&
+         (usize)header->tree.offset + header->tree.count <=
+           header->lists_length &&
+         header->types_length <= header->types_capacity &&
+         cache_layout(header).size == size &&
+         memcmp(
+           (const u8*)header + cache_layout(header).input, key.input.pointer,
+           key.input.length
+         ) == 0;
+}
+
+// Symbol ids in the tree are only right when the interner hands out the
+// same ids again, which holds when nothing else was interned before
+static bool cache_intern(const CacheHeader* header, rcstr spellings) {
+  rcstr iter = spellings;
+  rcstr end = spellings + header->symbols_size;
+  for (Symbol symbol = 1; symbol <= header->symbols; ++symbol) {
+    usize length = strnlen(iter, (usize)(end - iter));
+    if (iter + length == end) {
+      return false;
+    }
+    StrView view = {
+      .pointer = iter,
+      .length = length,
+    };
+    if (intern(view) != symbol) {
+      return false;
+    }
+    iter += length + 1;
+  }
+  return true;
+}
+
+static bool cache_map(StrView dir, CacheKey key, ParserOutput* output) {
+  if (key.build == 0) {
+    return false;
+  }
+  char* path = cache_path(dir, key, ".ast");
+  i32 fd = open(path, O_RDONLY);
+  free(path);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (usize)info.st_size < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+  usize size = (usize)info.st_size;
+  u8* mapping =
+    mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  const CacheHeader* header = (const CacheHeader*)mapping;
+  if (cache_valid(header, key, size) != true ||
+      cache_intern(header, (rcstr)mapping + cache_layout(header).symbols) !=
+        true) {
+    munmap(mapping, size);
+    return false;
+  }
+  CacheLayout layout = cache_layout(header);
+  *output = (ParserOutput){
+    .tree = header->tree,
+    .ast = {
+      .length = header->length,
+      .capacity = header->length,
+      .lists_length = header->lists_length,
+      .lists_capacity = header->lists_length,
+      .strings_length = header->strings_length,
+      .strings_capacity = header->strings_length,
+      .types_length = header->types_length,
+      .types_capacity = header->types_capacity,
+      .words = (u32*)(mapping + layout.words),
+      .lists = (NodeId*)(mapping + layout.lists),
+      .strings = mapping + layout.strings,
+      .types = (NodeId*)(mapping + layout.types),
+      .mapping = mapping,
+      .mapping_size = size,
+    },
+  };
+  return true;
+}
+
+bool cache_load(StrView dir, CacheKey key, ParserOutput* output) {
+  bool found = cache_map(dir, key, output);
+  if (found == true) {
+    stats.hits += 1;
+  } else {
+    stats.misses += 1;
+  }
+  return found;
+}
+
+static bool cache_write(FILE* file, const void* data, usize size) {
+  static const u8 padding[8] = {};
+  return fwrite(data, 1, size, file) == size &&
+         fwrite(padding, 1, align8(size) - size, file) == align8(size) - size;
+}
+
+// Written to a file of its own first and renamed into place, a compile
+// running at the same time never maps a partly written tree. Failing to
+// write the cache is not an error, the next compile parses again.
+void cache_store(StrView dir, CacheKey key, const ParserOutput* output) {
+  if (key.build == 0) {
+    return;
+  }
+  const Ast* ast = &output->ast;
+  CacheHeader header = {
+    .hash = key.hash,
+    .build = key.build,
+    .input_length = key.input.length,
+    .tree = output->tree,
+    .length = ast->length,
+    .lists_length = ast->lists_length,
+    .strings_length = ast->strings_length,
+    .types_length = ast->types_length,
+    .types_capacity = ast->types_capacity,
+    .symbols = (u32)symbol_count(),
+  };
+  memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  for (Symbol symbol = 1; symbol <= header.symbols; ++symbol) {
+    header.symbols_size += (u32)symbol_view(symbol).length + 1;
+  }
+
+  char* directory = strndup(dir.pointer, dir.length);
+  if (directory == nullptr) {
+    perror("strndup");
+    exit(1);
+  }
+  unused i32 made = mkdir(directory, 0777);
+  free(directory);
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".ast.%ld", (long)getpid());
+  char* temporary = cache_path(dir, key, suffix);
+  FILE* file = fopen(temporary, "wb");
+  if (file == nullptr) {
+    free(temporary);
+    return;
+  }
+  bool written =
+    cache_write(file, &header, sizeof(header)) &&
+    cache_write(file, ast->words, sizeof(u32) * (usize)ast->length) &&
+    cache_write(
+      file, ast->lists, sizeof(NodeId) * (usize)ast->lists_length
+    ) &&
+    cache_write(file, ast->strings, ast->strings_length) &&
+    cache_write(
+      file, ast->types, sizeof(NodeId) * (usize)ast->types_capacity
+    );
+  for (Symbol symbol = 1; symbol <= header.symbols && written; ++symbol) {
+    StrView view = symbol_view(symbol);
+    usize size = view.length + 1;
+    written = fwrite(view.pointer, 1, size, file) == size;
+  }
+  static const u8 padding[8] = {};
+  usize pad = align8(header.symbols_size) - header.symbols_size;
+  written = written && fwrite(padding, 1, pad, file) == pad &&
+            fwrite(key.input.pointer, 1, key.input.length, file) ==
+              key.input.length;
+  if (fclose(file) != 0) {
+    written = false;
+  }
+  char* path = cache_path(dir, key, ".ast");
+  if (written != true || rename(temporary, path) != 0) {
+    remove(temporary);
+  }
+  free(temporary);
+  free(path);
+}
+
+CacheStats cache_stats() {
+  return stats;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <parser/mod.h>
+#include <utility/mod.h>
+
+// Parsed trees are cached on disk under a hash of the input bytes and of the
+// compiler binary. The tree holds no pointers, a cached one is mapped back as
+// it was written and only the symbols it names are interned again, in their
+// original order. The file keeps a copy of the input it was parsed from and
+// is only loaded when the copy matches the input byte for byte, so string
+// literals keep pointing into an unchanged input. A file written by another
+// build of the compiler is never loaded, whatever it changed in the layout.
+typedef struct CacheKey CacheKey;
+struct CacheKey {
+  u64 hash;
+  u64 build;
+  StrView input;
+};
+
+typedef struct CacheStats CacheStats;
+struct CacheStats {
+  usize hits;
+  usize misses;
+};
+
+extern CacheKey cache_key(StrView input, bool eager);
+extern bool cache_load(StrView dir, CacheKey key, ParserOutput* output);
+extern void cache_store(StrView dir, CacheKey key, const ParserOutput* output);
+extern CacheStats cache_stats();
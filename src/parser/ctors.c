@@ -1,9 +1,12 @@
-#include <arena/mod.h>
-#include <hashmap/mod.h>
+#include <assert.h>
 #include <parser/ctors.h>
 #include <parser/lexer.h>
 #include <parser/mod.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <utility/mod.h>
 
 // static bool is_integer(Node* node) {
@@ -43,247 +46,756 @@
 //   return make_oper(OP_PtrSub, lhs, rhs);
 // }
 
-Node* make_oper(Arena* arena, OperKind oper, Node* lhs, Node* rhs) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Operation,
-    .operation =
-      (OperNode){
-        .kind = oper,
-        .lhs = lhs,
-        .rhs = rhs,
-      },
+// Every kind with the union member it uses and the resulting node size in
+// bytes. The sizes are checked below, so a growing payload shows up here.
+#define NODE_LAYOUT(X)            \
+  X(ND_None, kind, 4)             \
+  X(ND_Operation, operation, 24)  \
+  X(ND_Negation, unary_type, 16)  \
+  X(ND_Return, location, 12)      \
+  X(ND_Block, block, 12)          \
+  X(ND_Addr, unary_type, 16)      \
+  X(ND_Deref, unary_type, 16)     \
+  X(ND_Type, type, 20)            \
+  X(ND_Decl, declaration, 20)     \
+  X(ND_Value, value, 24)          \
+  X(ND_Variable, unary, 8)        \
+  X(ND_ArgVar, declaration, 20)   \
+  X(ND_Function, function, 32)    \
+  X(ND_If, if_node, 20)           \
+  X(ND_While, while_node, 16)     \
+  X(ND_Call, call_node, 24)
+
+#define NODE_HEADER_SIZE offsetof(Node, unary)
+#define NODE_SIZE(member)                                     \
+  max(                                                        \
+    NODE_HEADER_SIZE,                                         \
+    offsetof(Node, member) + sizeof(((Node*)nullptr)->member) \
+  )
+
+#define X(kind, member, bytes) \
+  static_assert(NODE_SIZE(member) == (bytes), #kind " changed size");
+NODE_LAYOUT(X)
+#undef X
+
+static const u8 node_words[] = {
+#define X(kind, member, bytes) \
+  [kind] = (NODE_SIZE(member) + sizeof(u32) - 1) / sizeof(u32),
+  NODE_LAYOUT(X)
+#undef X
+};
+
+Ast ast_make(rcstr source, usize capacity) {
+  Ast ast = {
+    .source = source,
   };
-  return node;
+  ast_reserve(&ast, max(capacity, (usize)16));
+  ast.length = 1;
+  return ast;
+}
+
+static void* copy_out(Arena* arena, const void* buffer, usize size) {
+  void* copy = arena_alloc(arena, size);
+  memcpy(copy, buffer, size);
+  return copy;
+}
+
+// A tree loaded from the cache is copied out of the mapped file before it
+// first grows, passes after parsing may still add nodes to it
+static void ast_detach(Ast* ast) {
+  if (ast->mapping == nullptr) {
+    return;
+  }
+  Arena* arena = &ast->arena;
+  ast->words = copy_out(arena, ast->words, sizeof(u32) * ast->capacity);
+  ast->lists =
+    copy_out(arena, ast->lists, sizeof(NodeId) * ast->lists_capacity);
+  ast->strings = copy_out(arena, ast->strings, ast->strings_capacity);
+  ast->types =
+    copy_out(arena, ast->types, sizeof(NodeId) * ast->types_capacity);
+  munmap(ast->mapping, ast->mapping_size);
+  ast->mapping = nullptr;
+  ast->mapping_size = 0;
+}
+
+void ast_reserve(Ast* ast, usize capacity) {
+  if (capacity > UINT32_MAX) {
+    error("Syntax tree of %zu words exceeds the 32-bit node limit", capacity);
+  }
+  ast_detach(ast);
+  ast->words = arena_realloc(
+    &ast->arena, ast->words, sizeof(u32) * ast->capacity,
+    sizeof(u32) * capacity
+  );
+  ast->capacity = (u32)capacity;
+}
+
+NodeId ast_alloc(Ast* ast, NodeKind kind) {
+  usize size = node_words[kind];
+  if (ast->length + size > ast->capacity) {
+    ast_reserve(ast, max((usize)ast->capacity * 2, ast->length + size));
+  }
+  NodeId id = ast->length;
+  ast->length += size;
+  Node* node = ast_get(ast, id);
+  node->kind = kind;
+  node->category = VC_RValue;
+  return id;
+}
+
+// Room for count more ids at the end of the list buffer
+static void ast_reserve_lists(Ast* ast, usize count) {
+  if (ast->lists_length + count > UINT32_MAX) {
+    error("Node lists exceed the 32-bit list limit");
+  }
+  if (ast->lists_length + count > ast->lists_capacity) {
+    ast_detach(ast);
+    usize capacity = max(ast->lists_capacity * 2, (usize)256);
+    capacity = max(capacity, ast->lists_length + count);
+    ast->lists = arena_realloc(
+      &ast->arena, ast->lists, sizeof(NodeId) * ast->lists_capacity,
+      sizeof(NodeId) * capacity
+    );
+    ast->lists_capacity = (u32)capacity;
+  }
 }
 
-Node* make_unary(Arena* arena, NodeKind kind, Node* value) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = kind,
-    .unary = value,
+NodeList make_list(Ast* ast, const NodeId* items, usize count) {
+  if (count == 0) {
+    return (NodeList){};
+  }
+  ast_reserve_lists(ast, count);
+  NodeList list = {
+    .offset = ast->lists_length,
+    .count = (u32)count,
   };
-  return node;
+  memcpy(ast->lists + list.offset, items, sizeof(NodeId) * count);
+  ast->lists_length += (u32)count;
+  return list;
 }
 
-static StrNode* alloc_string(Arena* arena, StrView view) {
-  usize size = sizeof(usize) + sizeof(char) * (view.length + 1);
-  StrNode* string = arena_alloc(arena, size);
-  memcpy(string->array, view.pointer, view.length);
-  string->array[view.length] = 0;
-  string->capacity = view.length;
-  return string;
-}
-
-Node* make_basic_value(Arena* arena, Node* type, StrView view) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Value,
-    .value =
-      (ValueNode){
-        .type = type,
-        .basic = alloc_string(arena, view),
-      },
+void ast_free(Ast* ast) {
+  if (ast->mapping != nullptr) {
+    munmap(ast->mapping, ast->mapping_size);
+  }
+  arena_free(&ast->arena);
+  *ast = (Ast){};
+}
+
+SymbolTable symbol_table_make(Arena* arena, usize capacity) {
+  NodeId* bindings = arena_alloc(arena, sizeof(NodeId) * capacity);
+  memset(bindings, 0, sizeof(NodeId) * capacity);
+  return (SymbolTable){
+    .arena = arena,
+    .capacity = capacity,
+    .bindings = bindings,
+    .log_capacity = 64,
+    .log = arena_alloc(arena, sizeof(Binding) * 64),
+  };
+}
+
+usize scope_enter(const SymbolTable* table) {
+  return table->log_length;
+}
+
+void scope_leave(SymbolTable* table, usize mark) {
+  while (table->log_length > mark) {
+    table->log_length -= 1;
+    Binding undo = table->log[table->log_length];
+    table->bindings[undo.symbol] = undo.shadowed;
+  }
+}
+
+// Symbols interned after the table was made are past its end
+static void symbol_table_grow(SymbolTable* table, Symbol symbol) {
+  usize capacity = max(max(table->capacity * 2, (usize)symbol + 1), (usize)256);
+  NodeId* bindings = arena_realloc(
+    table->arena, table->bindings, sizeof(NodeId) * table->capacity,
+    sizeof(NodeId) * capacity
+  );
+  memset(
+    bindings + table->capacity, 0,
+    sizeof(NodeId) * (capacity - table->capacity)
+  );
+  table->capacity = capacity;
+  table->bindings = bindings;
+}
+
+ListStack list_stack_make(Arena* arena) {
+  return (ListStack){
+    .arena = arena,
+    .capacity = 64,
+    .items = arena_alloc(arena, sizeof(NodeId) * 64),
+  };
+}
+
+void list_push(ListStack* stack, NodeId node) {
+  if (stack->length == stack->capacity) {
+    stack->items = arena_realloc(
+      stack->arena, stack->items, sizeof(NodeId) * stack->capacity,
+      sizeof(NodeId) * stack->capacity * 2
+    );
+    stack->capacity *= 2;
+  }
+  stack->items[stack->length] = node;
+  stack->length += 1;
+}
+
+NodeList list_close(ListStack* stack, Ast* ast, usize mark) {
+  NodeList list = make_list(ast, stack->items + mark, stack->length - mark);
+  stack->length = mark;
+  return list;
+}
+
+void scope_bind(SymbolTable* table, Symbol symbol, NodeId node) {
+  if (symbol >= table->capacity) {
+    symbol_table_grow(table, symbol);
+  }
+  if (table->log_length == table->log_capacity) {
+    table->log = arena_realloc(
+      table->arena, table->log, sizeof(Binding) * table->log_capacity,
+      sizeof(Binding) * table->log_capacity * 2
+    );
+    table->log_capacity *= 2;
+  }
+  table->log[table->log_length] = (Binding){
+    .symbol = symbol,
+    .shadowed = table->bindings[symbol],
+  };
+  table->log_length += 1;
+  table->bindings[symbol] = node;
+}
+
+// Locations are kept the way literals are, as offsets into the source
+static u32 source_offset(const Ast* ast, rcstr location) {
+  return (u32)(location - ast->source);
+}
+
+NodeId make_oper(
+  Ast* ast, OperKind oper, NodeId lhs, NodeId rhs, rcstr location
+) {
+  NodeId node = ast_alloc(ast, ND_Operation);
+  ast_get(ast, node)->operation = (OperNode){
+    .kind = oper,
+    .lhs = lhs,
+    .rhs = rhs,
+    .location = source_offset(ast, location),
   };
   return node;
 }
 
-static StrNode* alloc_str_lit(Arena* arena, StrView view) {
-  usize size = sizeof(usize) + sizeof(char) * (view.length + 1);
-  StrNode* string = arena_alloc(arena, size);
+// Variables have no room for a location, theirs is left out
+NodeId make_unary(Ast* ast, NodeKind kind, NodeId value, rcstr location) {
+  NodeId node = ast_alloc(ast, kind);
+  ast_get(ast, node)->unary = value;
+  if (kind != ND_Variable) {
+    ast_get(ast, node)->location = source_offset(ast, location);
+  }
+  if (kind == ND_Negation || kind == ND_Addr || kind == ND_Deref) {
+    ast_get(ast, node)->unary_type = 0;
+  }
+  return node;
+}
+
+static StrId ast_alloc_bytes(Ast* ast, usize size) {
+  if (ast->strings_length + size > UINT32_MAX) {
+    error("String literals exceed the 4 GiB AST limit");
+  }
+  if (ast->strings_length + size > ast->strings_capacity) {
+    ast_detach(ast);
+    usize capacity = max(ast->strings_capacity * 2, (usize)256);
+    capacity = max(capacity, ast->strings_length + size);
+    ast->strings = arena_realloc(
+      &ast->arena, ast->strings, ast->strings_capacity, capacity
+    );
+    ast->strings_capacity = (u32)min(capacity, (usize)UINT32_MAX);
+  }
+  StrId id = ast->strings_length;
+  ast->strings_length += (u32)size;
+  return id;
+}
+
+static inline bool is_octal(char ref) {
+  return ref >= '0' && ref <= '7';
+}
+
+static inline i32 hex_digit(char ref) {
+  if (ref >= '0' && ref <= '9') {
+    return ref - '0';
+  }
+  ref |= 0x20;
+  return ref >= 'a' && ref <= 'f' ? ref - 'a' + 10 : -1;
+}
+
+// Code points of \u and \U escapes are written as UTF-8
+static char* put_utf8(char* out, u32 point) {
+  if (point < 0x80) {
+    *out++ = (char)point;
+  } else if (point < 0x800) {
+    *out++ = (char)(0xc0 | point >> 6);
+    *out++ = (char)(0x80 | (point & 0x3f));
+  } else if (point < 0x10000) {
+    *out++ = (char)(0xe0 | point >> 12);
+    *out++ = (char)(0x80 | (point >> 6 & 0x3f));
+    *out++ = (char)(0x80 | (point & 0x3f));
+  } else {
+    *out++ = (char)(0xf0 | (point >> 18 & 0x07));
+    *out++ = (char)(0x80 | (point >> 12 & 0x3f));
+    *out++ = (char)(0x80 | (point >> 6 & 0x3f));
+    *out++ = (char)(0x80 | (point & 0x3f));
+  }
+  return out;
+}
+
+// Decodes the C escapes of a literal into out, which holds at least as many
+// bytes as the literal since no escape decodes to more bytes than it spells.
+// Octal escapes take up to three digits and hex escapes every digit, both
+// keep the low byte of their value. An unknown escape stands for the
+// character after the backslash. Returns the decoded length.
+static usize decode_escapes(char* out, StrView view) {
+  const char* begin = out;
   rcstr src = view.pointer;
-  rstr itr = string->array;
-  size = view.length;
-
-  for (; src != view.pointer + view.length; ++itr, ++src) {
-    if (*src == '\\' && src[1] == 'n') {
-      *itr = '\n';
-      src += 1;
-      size -= 1;
-    } else {
-      *itr = *src;
+  rcstr end = view.pointer + view.length;
+  while (src != end) {
+    rcstr escape = scanner_get()->find_backslash(src, end);
+    memcpy(out, src, (usize)(escape - src));
+    out += escape - src;
+    if (escape == end || escape + 1 == end) {
+      src = escape;
+      break;
+    }
+    src = escape + 2;
+    switch (escape[1]) {  // clang-format off
+      case 'a': *out++ = '\a'; break;
+      case 'b': *out++ = '\b'; break;
+      case 'f': *out++ = '\f'; break;
+      case 'n': *out++ = '\n'; break;
+      case 'r': *out++ = '\r'; break;
+      case 't': *out++ = '\t'; break;
+      case 'v': *out++ = '\v'; break;
+      // clang-format on
+      case 'x': {
+        u32 value = 0;
+        for (; src != end && hex_digit(*src) >= 0; ++src) {
+          value = value << 4 | (u32)hex_digit(*src);
+        }
+        *out++ = (char)value;
+        break;
+      }
+      case 'u':
+      case 'U': {
+        usize digits = escape[1] == 'u' ? 4 : 8;
+        u32 point = 0;
+        usize count = 0;
+        for (; count < digits && src != end && hex_digit(*src) >= 0; ++count) {
+          point = point << 4 | (u32)hex_digit(*src);
+          src += 1;
+        }
+        out = put_utf8(out, min(point, (u32)0x10ffff));
+        break;
+      }
+      default:
+        if (is_octal(escape[1]) == true) {
+          u32 value = (u32)(escape[1] - '0');
+          for (usize count = 1; count < 3 && src != end && is_octal(*src);
+               ++count) {
+            value = value << 3 | (u32)(*src - '0');
+            src += 1;
+          }
+          *out++ = (char)value;
+        } else {
+          *out++ = escape[1];
+        }
+        break;
     }
   }
-  *itr = 0;
-  string->capacity = size;
-  return string;
-}
-
-Node* make_str_value(Arena* arena, StrView view) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Value,
-    .value =
-      (ValueNode){
-        .type = make_basic_type(arena, TP_Str),
-        .basic = alloc_str_lit(arena, view),
-      },
-  };
-  return node;
+  memcpy(out, src, (usize)(end - src));
+  out += end - src;
+  return (usize)(out - begin);
 }
 
-Node* make_numeric_value(Arena* arena, Node* type, usize number) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Value,
-    .value =
-      (ValueNode){
-        .type = type,
-        .number = number,
-      },
+// Literals without a backslash stay in the source, only the others are
+// decoded into the string buffer
+static StrSpan alloc_str_lit(Ast* ast, StrView view) {
+  rcstr end = view.pointer + view.length;
+  if (scanner_get()->find_backslash(view.pointer, end) == end) {
+    return (StrSpan){
+      .offset = (u32)(view.pointer - ast->source),
+      .length = (u32)view.length,
+    };
+  }
+  StrId id = ast_alloc_bytes(ast, view.length);
+  usize length = decode_escapes((char*)ast->strings + id, view);
+  ast->strings_length = id + (u32)length;
+  return (StrSpan){
+    .offset = id,
+    .length = (u32)length,
+    .decoded = true,
   };
-  return node;
 }
 
-Node* make_pointer_value(Arena* arena, Node* type, Node* value) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Value,
-    .value =
-      (ValueNode){
-        .type = type,
-        .base = value,
-      },
+NodeId make_str_value(Ast* ast, StrView view) {
+  NodeId type = make_basic_type(ast, TP_Str);
+  StrSpan string = alloc_str_lit(ast, view);
+  NodeId node = ast_alloc(ast, ND_Value);
+  ast_get(ast, node)->value = (ValueNode){
+    .type = type,
+    .string = string,
   };
   return node;
 }
 
-Node* make_basic_type(Arena* arena, TypeKind kind) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Type,
-    .type =
-      (TypeNode){
-        .kind = kind,
-      },
+NodeId make_numeric_value(Ast* ast, NodeId type, Number number) {
+  NodeId node = ast_alloc(ast, ND_Value);
+  ast_get(ast, node)->value = (ValueNode){
+    .type = type,
+    .number = number,
   };
   return node;
 }
 
-Node* make_numeric_type(Arena* arena, TypeKind kind, usize width) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Type,
-    .type =
-      (TypeNode){
-        .kind = kind,
-        .bit_width = width,
-      },
+NodeId make_pointer_value(Ast* ast, NodeId type, NodeList elements) {
+  NodeId node = ast_alloc(ast, ND_Value);
+  ast_get(ast, node)->value = (ValueNode){
+    .type = type,
+    .elements = elements,
   };
   return node;
 }
 
-Node* make_pointer_type(Arena* arena, Node* type) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Type,
-    .type =
-      (TypeNode){
-        .kind = TP_Ptr,
-        .base = type,
-      },
-  };
+// Every type is keyed by its kind and the two words after it, the union
+// members not used by a kind are left zero
+static inline usize type_hash(const TypeNode* type) {
+  u64 hash = ((u64)type->kind << 32 | type->array.base) * 0x9e3779b97f4a7c15ULL;
+  return (usize)((hash ^ type->array.size) * 0x9e3779b97f4a7c15ULL >> 32);
+}
+
+static inline bool type_equals(const TypeNode* lhs, const TypeNode* rhs) {
+  return lhs->kind == rhs->kind && lhs->array.base == rhs->array.base &&
+         lhs->array.size == rhs->array.size;
+}
+
+static void ast_grow_types(Ast* ast) {
+  ast_detach(ast);
+  usize capacity = ast->types_capacity != 0 ? ast->types_capacity * 2 : 64;
+  NodeId* types = arena_alloc(&ast->arena, sizeof(NodeId) * capacity);
+  memset(types, 0, sizeof(NodeId) * capacity);
+  for (usize i = 0; i < ast->types_capacity; ++i) {
+    NodeId node = ast->types[i];
+    if (node == 0) {
+      continue;
+    }
+    usize index = type_hash(&ast_get(ast, node)->type) & (capacity - 1);
+    while (types[index] != 0) {
+      index = (index + 1) & (capacity - 1);
+    }
+    types[index] = node;
+  }
+  ast->types = types;
+  ast->types_capacity = (u32)capacity;
+}
+
+// Slot of the type in the table, either holding its node or empty
+static usize type_slot(const Ast* ast, const TypeNode* type) {
+  usize mask = ast->types_capacity - 1;
+  usize index = type_hash(type) & mask;
+  for (; ast->types[index] != 0; index = (index + 1) & mask) {
+    if (type_equals(&ast_get(ast, ast->types[index])->type, type) == true) {
+      break;
+    }
+  }
+  return index;
+}
+
+static NodeId make_type(Ast* ast, TypeNode type) {
+  if (ast->types_length * 2 >= ast->types_capacity) {
+    ast_grow_types(ast);
+  }
+  usize index = type_slot(ast, &type);
+  if (ast->types[index] != 0) {
+    return ast->types[index];
+  }
+  NodeId node = ast_alloc(ast, ND_Type);
+  ast_get(ast, node)->type = type;
+  ast->types[index] = node;
+  ast->types_length += 1;
   return node;
 }
 
-Node* make_array_type(Arena* arena, Node* type, usize size) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Type,
-    .type =
-      (TypeNode){
-        .kind = TP_Arr,
-        .array.base = type,
-        .array.size = size,
-      },
+NodeId make_basic_type(Ast* ast, TypeKind kind) {
+  return make_type(
+    ast,
+    (TypeNode){
+      .kind = kind,
+    }
+  );
+}
+
+NodeId make_numeric_type(Ast* ast, TypeKind kind, u32 width) {
+  return make_type(
+    ast,
+    (TypeNode){
+      .kind = kind,
+      .bit_width = width,
+    }
+  );
+}
+
+NodeId make_pointer_type(Ast* ast, NodeId type) {
+  return make_type(
+    ast,
+    (TypeNode){
+      .kind = TP_Ptr,
+      .base = type,
+    }
+  );
+}
+
+NodeId make_array_type(Ast* ast, NodeId type, u32 size) {
+  return make_type(
+    ast,
+    (TypeNode){
+      .kind = TP_Arr,
+      .array.base = type,
+      .array.size = size,
+    }
+  );
+}
+
+// Copies of types the tree already had resolve to the node it has
+static inline NodeId resolve_type(const Ast* ast, NodeId type) {
+  NodeId canonical = ast_get(ast, type)->type.canonical;
+  return canonical != 0 ? canonical : type;
+}
+
+#define MOVE(id) ((id) != 0 ? (id) + delta : 0)
+#define MOVE_TYPE(id) ((id) != 0 ? resolve_type(ast, (id) + delta) : 0)
+#define MOVE_LIST(list)                                      \
+  (NodeList) {                                               \
+    .offset = (list).count != 0 ? (list).offset + lists : 0, \
+    .count = (list).count,                                   \
+  }
+
+// Spans into a source other than the tree's own are copied into its string
+// buffer, they would not outlive the appended tree otherwise
+static StrSpan move_string(
+  Ast* ast, const Ast* other, StrSpan span, u32 strings
+) {
+  if (span.decoded == true) {
+    span.offset += strings;
+  } else if (other->source != ast->source) {
+    StrId id = ast_alloc_bytes(ast, span.length);
+    memcpy(ast->strings + id, other->source + span.offset, span.length);
+    span = (StrSpan){
+      .offset = id,
+      .length = span.length,
+      .decoded = true,
+    };
+  }
+  return span;
+}
+
+static void relocate_node(
+  Ast* ast, const Ast* other, Node* node, u32 delta, u32 lists, u32 strings
+) {
+  switch (node->kind) {
+    case ND_Operation:
+      node->operation.lhs = MOVE(node->operation.lhs);
+      node->operation.rhs = MOVE(node->operation.rhs);
+      node->operation.type = MOVE_TYPE(node->operation.type);
+      break;
+    case ND_Negation:
+    case ND_Addr:
+    case ND_Deref:
+      node->unary = MOVE(node->unary);
+      node->unary_type = MOVE_TYPE(node->unary_type);
+      break;
+    case ND_Return:
+    case ND_Variable:
+      node->unary = MOVE(node->unary);
+      break;
+    case ND_Block:
+      node->block = MOVE_LIST(node->block);
+      break;
+    case ND_Decl:
+    case ND_ArgVar:
+      node->declaration.type =
+        resolve_type(ast, node->declaration.type + delta);
+      node->declaration.value = MOVE(node->declaration.value);
+      break;
+    case ND_Value: {
+      node->value.type = resolve_type(ast, node->value.type + delta);
+      TypeKind kind = ast_get(ast, node->value.type)->type.kind;
+      if (kind == TP_Ptr || kind == TP_Arr) {
+        node->value.elements = MOVE_LIST(node->value.elements);
+      } else if (kind == TP_Str) {
+        node->value.string =
+          move_string(ast, other, node->value.string, strings);
+      }
+      break;
+    }
+    case ND_Function:
+      node->function.ret_type =
+        resolve_type(ast, node->function.ret_type + delta);
+      node->function.args = MOVE_LIST(node->function.args);
+      node->function.body = MOVE(node->function.body);
+      break;
+    case ND_If:
+      node->if_node.cond = MOVE(node->if_node.cond);
+      node->if_node.then = MOVE(node->if_node.then);
+      node->if_node.elseb = MOVE(node->if_node.elseb);
+      break;
+    case ND_While:
+      node->while_node.cond = MOVE(node->while_node.cond);
+      node->while_node.then = MOVE(node->while_node.then);
+      break;
+    case ND_Call:
+      node->call_node.args = MOVE_LIST(node->call_node.args);
+      node->call_node.type = MOVE_TYPE(node->call_node.type);
+      break;
+    case ND_None:
+    case ND_Type:
+      break;
+  }
+}
+
+u32 ast_append(Ast* ast, const Ast* other) {
+  ast_detach(ast);
+  u32 delta = ast->length - 1;
+  u32 strings = ast->strings_length;
+  ast_reserve_lists(ast, other->lists_length);
+  u32 lists = ast->lists_length;
+  for (u32 i = 0; i < other->lists_length; ++i) {
+    ast->lists[lists + i] = other->lists[i] + delta;
+  }
+  ast->lists_length += other->lists_length;
+  usize words = other->length - 1;
+  if (ast->length + words > ast->capacity) {
+    ast_reserve(ast, max((usize)ast->capacity * 2, ast->length + words));
+  }
+  NodeId begin = ast->length;
+  NodeId end = begin + (u32)words;
+  memcpy(ast->words + begin, other->words + 1, sizeof(u32) * words);
+  ast->length = end;
+  if (other->strings_length != 0) {
+    StrId id = ast_alloc_bytes(ast, other->strings_length);
+    memcpy(ast->strings + id, other->strings, other->strings_length);
+  }
+
+  // Types only refer to types made before them, walking in order leaves the
+  // base of every type canonical before the type itself is looked up
+  for (NodeId id = begin; id < end; id += node_words[ast_get(ast, id)->kind]) {
+    Node* node = ast_get(ast, id);
+    if (node->kind != ND_Type) {
+      continue;
+    }
+    if (node->type.kind == TP_Ptr || node->type.kind == TP_Arr) {
+      node->type.array.base = resolve_type(ast, node->type.array.base + delta);
+    }
+    if (ast->types_length * 2 >= ast->types_capacity) {
+      ast_grow_types(ast);
+    }
+    usize index = type_slot(ast, &node->type);
+    if (ast->types[index] != 0) {
+      node->type.canonical = ast->types[index];
+    } else {
+      node->type.canonical = 0;
+      ast->types[index] = id;
+      ast->types_length += 1;
+    }
+  }
+  for (NodeId id = begin; id < end; id += node_words[ast_get(ast, id)->kind]) {
+    Node* node = ast_get(ast, id);
+    if (node->kind != ND_Type) {
+      relocate_node(ast, other, node, delta, lists, strings);
+    }
+  }
+  return delta;
+}
+
+#undef MOVE
+#undef MOVE_TYPE
+#undef MOVE_LIST
+
+NodeId make_declaration(
+  Context cx, NodeId type, Symbol name, NodeId value, rcstr location
+) {
+  NodeId node = ast_alloc(cx.ast, ND_Decl);
+  ast_get(cx.ast, node)->declaration = (DeclNode){
+    .type = type,
+    .value = value,
+    .name = name,
+    .location = source_offset(cx.ast, location),
   };
+  NodeId var = make_unary(cx.ast, ND_Variable, node, nullptr);
+  scope_bind(cx.symbols, name, var);
   return node;
 }
 
-Node* make_declaration(Context cx, Node* type, StrView view, Node* value) {
-  Node* node = arena_alloc(cx.arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Decl,
-    .declaration =
-      (DeclNode){
-        .type = type,
-        .value = value,
-        .name = alloc_string(cx.arena, view),
-      },
+NodeId make_arg_var(Context cx, NodeId type, Symbol name, rcstr location) {
+  NodeId node = ast_alloc(cx.ast, ND_ArgVar);
+  ast_get(cx.ast, node)->declaration = (DeclNode){
+    .type = type,
+    .name = name,
+    .location = source_offset(cx.ast, location),
   };
-  *hashmap_get(cx.scopes->buffer + cx.scopes->length - 1, view) = node;
+  NodeId var = make_unary(cx.ast, ND_Variable, node, nullptr);
+  scope_bind(cx.symbols, name, var);
   return node;
 }
 
-Node* make_arg_var(Context cx, Node* type, StrView view) {
-  Node* node = arena_alloc(cx.arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_ArgVar,
-    .declaration =
-      (DeclNode){
-        .type = type,
-        .name = alloc_string(cx.arena, view),
-      },
-  };
-  *hashmap_get(cx.scopes->buffer + cx.scopes->length - 1, view) = node;
+NodeId make_block(Ast* ast, NodeList stmts) {
+  NodeId node = ast_alloc(ast, ND_Block);
+  ast_get(ast, node)->block = stmts;
   return node;
 }
 
-Node* make_function(
-  Arena* arena, Node* type, StrView view, Node* body, Node* args,
+NodeId make_function(
+  Ast* ast, NodeId type, Symbol name, NodeId body, NodeList args,
   Linkage linkage
 ) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Function,
-    .function =
-      (FnNode){
-        .linkage = linkage,
-        .body = body,
-        .args = args,
-        .ret_type = type,
-        .name = alloc_string(arena, view),
-      },
+  NodeId node = ast_alloc(ast, ND_Function);
+  ast_get(ast, node)->function = (FnNode){
+    .linkage = linkage,
+    .body = body,
+    .args = args,
+    .ret_type = type,
+    .name = name,
   };
   return node;
 }
 
-Node* make_if_node(Arena* arena, Node* cond, Node* then, Node* elseb) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_If,
-    .if_node =
-      (IfNode){
-        .cond = cond,
-        .then = then,
-        .elseb = elseb,
-      },
+NodeId make_if_node(
+  Ast* ast, NodeId cond, NodeId then, NodeId elseb, rcstr location
+) {
+  NodeId node = ast_alloc(ast, ND_If);
+  ast_get(ast, node)->if_node = (IfNode){
+    .cond = cond,
+    .then = then,
+    .elseb = elseb,
+    .location = source_offset(ast, location),
   };
   return node;
 }
 
-Node* make_while_node(Arena* arena, Node* cond, Node* then) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_While,
-    .while_node =
-      (WhileNode){
-        .cond = cond,
-        .then = then,
-      },
+NodeId make_while_node(Ast* ast, NodeId cond, NodeId then, rcstr location) {
+  NodeId node = ast_alloc(ast, ND_While);
+  ast_get(ast, node)->while_node = (WhileNode){
+    .cond = cond,
+    .then = then,
+    .location = source_offset(ast, location),
   };
   return node;
 }
 
-Node* make_call_node(Arena* arena, StrView view, Node* args) {
-  Node* node = arena_alloc(arena, sizeof(Node));
-  *node = (Node){
-    .kind = ND_Call,
-    .call_node =
-      (CallNode){
-        .args = args,
-        .name = alloc_string(arena, view),
-      },
+NodeId make_call_node(
+  Ast* ast, Symbol name, NodeList args, rcstr location
+) {
+  NodeId node = ast_alloc(ast, ND_Call);
+  ast_get(ast, node)->call_node = (CallNode){
+    .args = args,
+    .name = name,
+    .location = source_offset(ast, location),
   };
   return node;
 }
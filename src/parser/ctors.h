@@ -1,29 +1,52 @@
 #pragma once
-#include <arena/mod.h>
 #include <parser/mod.h>
 #include <utility/vec.h>
 
+// Sources average about half a word of nodes per byte and dense expressions
+// under one and a half, only the untouched tail of the reservation is wasted
+#define AST_CAPACITY(bytes) ((bytes) + 16)
+
+// String literals of the tree are read from source, which has to outlive it
+extern Ast ast_make(rcstr source, usize capacity);
+extern void ast_reserve(Ast* ast, usize capacity);
+extern NodeId ast_alloc(Ast* ast, NodeKind kind);
+extern u32 ast_append(Ast* ast, const Ast* other);
+
+extern SymbolTable symbol_table_make(Arena* arena, usize capacity);
+extern usize scope_enter(const SymbolTable* table);
+extern void scope_leave(SymbolTable* table, usize mark);
+extern void scope_bind(SymbolTable* table, Symbol symbol, NodeId node);
+
+extern ListStack list_stack_make(Arena* arena);
+extern void list_push(ListStack* stack, NodeId node);
+// Moves the children above mark into a list of the tree
+extern NodeList list_close(ListStack* stack, Ast* ast, usize mark);
+
 // clang-format off
-extern Node* make_add(Arena* arena, Node* lhs, Node* rhs, Token* token);
-extern Node* make_sub(Arena* arena, Node* lhs, Node* rhs, Token* token);
-extern Node* make_oper(Arena* arena, OperKind oper, Node* lhs, Node* rhs);
-extern Node* make_unary(Arena* arena, NodeKind kind, Node* value);
-extern Node* make_basic_value(Arena* arena, Node* type, StrView view);
-extern Node* make_str_value(Arena* arena, StrView view);
-extern Node* make_numeric_value(Arena* arena, Node* type, usize num);
-extern Node* make_pointer_value(Arena* arena, Node* type, Node* value);
-extern Node* make_basic_type(Arena* arena, TypeKind kind);
-extern Node* make_numeric_type(Arena* arena, TypeKind kind, usize width);
-extern Node* make_pointer_type(Arena* arena, Node* value);
-extern Node* make_array_type(Arena* arena, Node* type, usize size);
-extern Node* make_declaration(Context cx, Node* type, StrView view, Node* value);
-extern Node* make_arg_var(Context cx, Node* type, StrView value);
-extern Node* make_if_node(Arena* arena, Node* cond, Node* then, Node* elseb);
-extern Node* make_while_node(Arena* arena, Node* cond, Node* then);
-extern Node* make_call_node(Arena* arena, StrView view, Node* args);
-extern Node* make_function(
-  Arena* arena, Node* type, StrView view, Node* body, Node* args, Linkage linkage
+extern NodeId make_add(Ast* ast, NodeId lhs, NodeId rhs, Token* token);
+extern NodeId make_sub(Ast* ast, NodeId lhs, NodeId rhs, Token* token);
+extern NodeId make_oper(Ast* ast, OperKind oper, NodeId lhs, NodeId rhs, rcstr location);
+extern NodeId make_unary(Ast* ast, NodeKind kind, NodeId value, rcstr location);
+extern NodeList make_list(Ast* ast, const NodeId* items, usize count);
+extern NodeId make_block(Ast* ast, NodeList stmts);
+extern NodeId make_str_value(Ast* ast, StrView view);
+extern NodeId make_numeric_value(Ast* ast, NodeId type, Number number);
+extern NodeId make_pointer_value(Ast* ast, NodeId type, NodeList elements);
+extern NodeId make_basic_type(Ast* ast, TypeKind kind);
+extern NodeId make_numeric_type(Ast* ast, TypeKind kind, u32 width);
+extern NodeId make_pointer_type(Ast* ast, NodeId value);
+extern NodeId make_array_type(Ast* ast, NodeId type, u32 size);
+extern NodeId make_declaration(Context cx, NodeId type, Symbol name, NodeId value, rcstr location);
+extern NodeId make_arg_var(Context cx, NodeId type, Symbol name, rcstr location);
+extern NodeId make_if_node(Ast* ast, NodeId cond, NodeId then, NodeId elseb, rcstr location);
+extern NodeId make_while_node(Ast* ast, NodeId cond, NodeId then, rcstr location);
+extern NodeId make_call_node(Ast* ast, Symbol name, NodeList args, rcstr location);
+extern NodeId make_function(
+  Ast* ast, NodeId type, Symbol name, NodeId body, NodeList args,
+  Linkage linkage
 );
 // clang-format on
 
-extern void print_ast(Node* prog);
+// Nodes keeping a location are printed with its line and column in source,
+// the input the tree was parsed from, when it is given
+extern void print_ast(const Ast* ast, NodeList prog, StrView source);
@@ -0,0 +1,262 @@
+#include <parser/diag.h>
+#include <parser/lexer.h>
+#include <parser/scan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <utility/mod.h>
+#include <utility/vec.h>
+
+typedef struct Diagnostic Diagnostic;
+struct Diagnostic {
+  rcstr source;
+  usize source_length;
+  rcstr location;
+  usize order;
+  usize message;
+};
+
+DEFINE_VECTOR(Diagnostic)
+DEFINE_VEC_FNS(Diagnostic, malloc, free)
+
+// Messages are formatted when reported, so the arguments do not need to
+// outlive the call, and kept as offsets into one growing text buffer. Parser
+// threads report into the same list under the lock, every thread unwinds to
+// recovery points of its own. While the limit is deferred every error is
+// kept, it is checked once threads are done.
+typedef struct Diagnostics Diagnostics;
+struct Diagnostics {
+  DiagnosticVector* list;
+  char* text;
+  usize text_length;
+  usize text_capacity;
+  usize limit;
+  bool deferred;
+};
+
+static Diagnostics diagnostics = {
+  .limit = DIAG_ERROR_LIMIT,
+};
+static thread_local jmp_buf* recover = nullptr;
+static once_flag lock_once = ONCE_FLAG_INIT;
+static mtx_t lock;
+
+static void lock_init() {
+  if (mtx_init(&lock, mtx_plain) != thrd_success) {
+    eputs("Failed to create the diagnostics lock");
+    exit(1);
+  }
+}
+
+static void diag_lock() {
+  call_once(&lock_once, lock_init);
+  mtx_lock(&lock);
+}
+
+static usize diag_print_all(Diagnostics* diag);
+unreturning static void diag_stop(Diagnostics* diag);
+
+void diag_set_limit(usize limit) {
+  diagnostics.limit = limit != 0 ? limit : DIAG_ERROR_LIMIT;
+}
+
+static usize diag_format(Diagnostics* diag, rcstr fmt, va_list ap) {
+  va_list copy;
+  va_copy(copy, ap);
+  i32 written = vsnprintf(nullptr, 0, fmt, copy);
+  va_end(copy);
+  usize length = (usize)max(written, 0);
+
+  usize needed = diag->text_length + length + 1;
+  if (needed > diag->text_capacity) {
+    usize capacity = max(max(diag->text_capacity * 2, needed), (usize)256);
+    char* text = realloc(diag->text, capacity);
+    if (text == nullptr) {
+      perror("realloc");
+      exit(1);
+    }
+    diag->text = text;
+    diag->text_capacity = capacity;
+  }
+  usize offset = diag->text_length;
+  vsnprintf(diag->text + offset, length + 1, fmt, ap);
+  diag->text_length = needed;
+  return offset;
+}
+
+void diag_report(StrView source, rcstr location, rcstr fmt, va_list ap) {
+  Diagnostics* diag = &diagnostics;
+  diag_lock();
+  if (diag->list == nullptr) {
+    diag->list = Diagnostic_vector_make(16);
+  }
+  Diagnostic_vector_push(
+    &diag->list,
+    (Diagnostic){
+      .source = source.pointer,
+      .source_length = source.length,
+      .location = location,
+      .order = diag->list->length,
+      .message = diag_format(diag, fmt, ap),
+    }
+  );
+  if (diag->deferred == true || diag->list->length < diag->limit) {
+    mtx_unlock(&lock);
+    return;
+  }
+  Diagnostics full = *diag;
+  *diag = (Diagnostics){
+    .limit = diag->limit,
+  };
+  mtx_unlock(&lock);
+  diag_stop(&full);
+}
+
+void diag_defer_limit(bool defer) {
+  Diagnostics* diag = &diagnostics;
+  diag_lock();
+  diag->deferred = defer;
+  usize count = diag->list != nullptr ? diag->list->length : 0;
+  if (defer == true || count < diag->limit) {
+    mtx_unlock(&lock);
+    return;
+  }
+  Diagnostics full = *diag;
+  *diag = (Diagnostics){
+    .limit = diag->limit,
+  };
+  mtx_unlock(&lock);
+  diag_stop(&full);
+}
+
+void diag_raise() {
+  if (recover != nullptr) {
+    longjmp(*recover, 1);
+  }
+  diag_flush();
+  exit(1);
+}
+
+jmp_buf* diag_recover(jmp_buf* point) {
+  jmp_buf* previous = recover;
+  recover = point;
+  return previous;
+}
+
+usize diag_count() {
+  diag_lock();
+  usize count = diagnostics.list != nullptr ? diagnostics.list->length : 0;
+  mtx_unlock(&lock);
+  return count;
+}
+
+static i32 diag_compare(const void* lhs_ptr, const void* rhs_ptr) {
+  const Diagnostic* lhs = lhs_ptr;
+  const Diagnostic* rhs = rhs_ptr;
+  if ((lhs->location == nullptr) != (rhs->location == nullptr)) {
+    return lhs->location == nullptr ? 1 : -1;
+  }
+  if (lhs->location != rhs->location) {
+    return lhs->location < rhs->location ? -1 : 1;
+  }
+  return lhs->order < rhs->order ? -1 : lhs->order > rhs->order;
+}
+
+static void diag_print(
+  const Diagnostics* diag, const Diagnostic* entry, const LineIndex* index
+) {
+  rcstr message = diag->text + entry->message;
+  if (entry->location == nullptr) {
+    eprintln("%s", message);
+    return;
+  }
+  StrView view = {
+    .pointer = entry->source,
+    .length = entry->source_length,
+  };
+  rcstr location = entry->location;
+  SourceLoc loc = line_index_find(index, (u32)(location - view.pointer));
+  rcstr line = location - (loc.column - 1);
+  rcstr end = scanner_get()->find_newline(location, view.pointer + view.length);
+  i32 chars_written = eprintf("%u: ", loc.line);
+  eprintf("%.*s\n", (i32)(end - line), line);
+  i32 position = (i32)(location - line) + chars_written;
+
+  eprintf("%*s", position, "");
+  eprintln("^ %s", message);
+}
+
+// Line indexes are built by the printing call for the inputs its errors point
+// into and freed with it. Errors are sorted by location, those of one input
+// follow each other and share one index.
+static usize diag_print_all(Diagnostics* diag) {
+  usize count = diag->list != nullptr ? diag->list->length : 0;
+  if (count == 0) {
+    return 0;
+  }
+  qsort(diag->list->buffer, count, sizeof(Diagnostic), diag_compare);
+  LineIndex index = {};
+  rcstr indexed = nullptr;
+  usize indexed_length = 0;
+  for (usize i = 0; i < count; ++i) {
+    const Diagnostic* entry = &diag->list->buffer[i];
+    bool other = entry->source != indexed ||
+                 entry->source_length != indexed_length;
+    if (entry->location != nullptr && other == true) {
+      line_index_free(&index);
+      StrView view = {
+        .pointer = entry->source,
+        .length = entry->source_length,
+      };
+      index = line_index_make(view);
+      indexed = entry->source;
+      indexed_length = entry->source_length;
+    }
+    diag_print(diag, entry, &index);
+  }
+  line_index_free(&index);
+  free(diag->list);
+  free(diag->text);
+  *diag = (Diagnostics){
+    .limit = diag->limit,
+  };
+  return count;
+}
+
+// Prints the first errors up to the limit, the ones a serial run reports
+// before stopping, and ends the process. The errors were taken out of the
+// shared list, no lock is held while printing.
+static void diag_stop(Diagnostics* diag) {
+  usize count = min(diag->list->length, diag->limit);
+  qsort(
+    diag->list->buffer, diag->list->length, sizeof(Diagnostic), diag_compare
+  );
+  diag->list->length = count;
+  diag_print_all(diag);
+  eprintln("Stopping after %zu errors", count);
+  exit(1);
+}
+
+void diag_drain(fn(void(void*, rcstr, rcstr)) sink, void* data) {
+  Diagnostics* diag = &diagnostics;
+  diag_lock();
+  if (diag->list != nullptr) {
+    usize count = diag->list->length;
+    qsort(diag->list->buffer, count, sizeof(Diagnostic), diag_compare);
+    for (usize i = 0; i < count; ++i) {
+      const Diagnostic* entry = &diag->list->buffer[i];
+      sink(data, entry->location, diag->text + entry->message);
+    }
+    diag->list->length = 0;
+    diag->text_length = 0;
+  }
+  mtx_unlock(&lock);
+}
+
+usize diag_flush() {
+  diag_lock();
+  usize count = diag_print_all(&diagnostics);
+  mtx_unlock(&lock);
+  return count;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <setjmp.h>
+#include <stdarg.h>
+#include <utility/mod.h>
+
+#ifndef DIAG_ERROR_LIMIT
+#define DIAG_ERROR_LIMIT 20
+#endif
+
+// Errors are collected instead of ending the process. A reported error
+// unwinds to the innermost recovery point installed with diag_recover, and
+// ends the process when there is none. Collected errors are printed ordered
+// by their position in the source once flushed, errors without a location
+// follow in the order they were reported.
+extern void diag_set_limit(usize limit);
+// While deferred, reaching the error limit does not end the process. Threads
+// report in any order, the limit is checked when undeferred and stops on the
+// errors a serial run would have stopped on.
+extern void diag_defer_limit(bool defer);
+extern void diag_report(StrView source, rcstr location, rcstr fmt, va_list ap);
+unreturning extern void diag_raise();
+extern jmp_buf* diag_recover(jmp_buf* point);
+extern usize diag_count();
+extern usize diag_flush();
+// Hands the collected errors to sink in the order diag_flush prints them and
+// forgets them, for callers that keep errors of their own
+extern void diag_drain(fn(void(void*, rcstr, rcstr)) sink, void* data);
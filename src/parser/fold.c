@@ -0,0 +1,560 @@
+#include <parser/ctors.h>
+#include <parser/fold.h>
+#include <parser/number.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility/mod.h>
+#include <utility/vec.h>
+
+DEFINE_VECTOR(NodeId)
+DEFINE_VEC_FNS(NodeId, malloc, free)
+
+// A node waiting for its operands to be folded. stage counts the operands
+// pushed so far, operand is the node the left one was folded into. The
+// elements of a list are folded one at a time, count of them were pushed so
+// far and each is replaced in the list once it is folded.
+typedef struct FoldFrame FoldFrame;
+struct FoldFrame {
+  NodeId id;
+  NodeId operand;
+  u32 count;
+  u8 stage;
+};
+
+DEFINE_VECTOR(FoldFrame)
+DEFINE_VEC_FNS(FoldFrame, malloc, free)
+
+// Expressions are walked with explicit stacks kept from one walk to the
+// next, however deep an expression is none of the walks recurse into it.
+// The statements taking the place of those of a list being folded are
+// collected in items, above the length it had when the list started.
+typedef struct Folder Folder;
+struct Folder {
+  Ast* ast;
+  usize eliminated;
+  NodeIdVector* nodes;
+  NodeIdVector* items;
+  FoldFrameVector* frames;
+};
+
+static NodeId fold_node(Folder* folder, NodeId id);
+
+static void push_node(Folder* folder, NodeId id) {
+  if (id != 0) {
+    NodeId_vector_push(&folder->nodes, id);
+  }
+}
+
+static void push_list(Folder* folder, NodeList list) {
+  NodeId_vector_push_many(
+    &folder->nodes, ast_list(folder->ast, list), list.count
+  );
+}
+
+static NodeId pop_node(Folder* folder) {
+  folder->nodes->length -= 1;
+  return folder->nodes->buffer[folder->nodes->length];
+}
+
+// Nodes on the stack above base and under them, a variable counts as one
+static usize count_pushed(Folder* folder, usize base) {
+  const Ast* ast = folder->ast;
+  usize count = 0;
+  while (folder->nodes->length > base) {
+    const Node* node = ast_get(ast, pop_node(folder));
+    count += 1;
+    switch (node->kind) {
+      case ND_Operation:
+        push_node(folder, node->operation.lhs);
+        push_node(folder, node->operation.rhs);
+        break;
+      case ND_Negation:
+      case ND_Return:
+        push_node(folder, node->unary);
+        break;
+      case ND_Block:
+        push_list(folder, node->block);
+        break;
+      case ND_Decl:
+        push_node(folder, node->declaration.value);
+        break;
+      case ND_Value: {
+        TypeKind kind = ast_get(ast, node->value.type)->type.kind;
+        if (kind == TP_Ptr || kind == TP_Arr) {
+          push_list(folder, node->value.elements);
+        }
+        break;
+      }
+      case ND_If:
+        push_node(folder, node->if_node.cond);
+        push_node(folder, node->if_node.then);
+        push_node(folder, node->if_node.elseb);
+        break;
+      case ND_While:
+        push_node(folder, node->while_node.cond);
+        push_node(folder, node->while_node.then);
+        break;
+      case ND_Call:
+        push_list(folder, node->call_node.args);
+        break;
+      case ND_None:
+      case ND_Addr:
+      case ND_Deref:
+      case ND_Type:
+      case ND_Variable:
+      case ND_ArgVar:
+      case ND_Function:
+        break;
+    }
+  }
+  return count;
+}
+
+// Nodes in the subtree at id
+static usize count_nodes(Folder* folder, NodeId id) {
+  usize base = folder->nodes->length;
+  push_node(folder, id);
+  return count_pushed(folder, base);
+}
+
+static usize count_list(Folder* folder, NodeList list) {
+  usize base = folder->nodes->length;
+  push_list(folder, list);
+  return count_pushed(folder, base);
+}
+
+// Whether evaluating the subtree has no effect besides its value
+static bool is_pure(Folder* folder, NodeId id) {
+  const Ast* ast = folder->ast;
+  usize base = folder->nodes->length;
+  push_node(folder, id);
+  while (folder->nodes->length > base) {
+    const Node* node = ast_get(ast, pop_node(folder));
+    switch (node->kind) {
+      case ND_Operation:
+        if (node->operation.kind == OP_Asg) {
+          folder->nodes->length = base;
+          return false;
+        }
+        push_node(folder, node->operation.lhs);
+        push_node(folder, node->operation.rhs);
+        break;
+      case ND_Negation:
+        push_node(folder, node->unary);
+        break;
+      case ND_Value:
+      case ND_Variable:
+      case ND_Addr:
+      case ND_Deref:
+        break;
+      default:
+        folder->nodes->length = base;
+        return false;
+    }
+  }
+  return true;
+}
+
+// The integer value node at id, nullptr for anything else
+static const ValueNode* int_constant(const Ast* ast, NodeId id) {
+  const Node* node = ast_get(ast, id);
+  if (node->kind != ND_Value) {
+    return nullptr;
+  }
+  TypeKind kind = ast_get(ast, node->value.type)->type.kind;
+  return kind == TP_SInt || kind == TP_UInt ? &node->value : nullptr;
+}
+
+static bool is_predicate(OperKind oper) {
+  switch (oper) {
+    case OP_And:
+    case OP_Or:
+    case OP_Eq:
+    case OP_NEq:
+    case OP_Lt:
+    case OP_Lte:
+    case OP_Gte:
+    case OP_Gt:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Operations with a constant on one side that leave the other side as it
+// is: x + 0, x * 1 and the like. right tells which side the constant is on.
+static bool is_identity(OperKind oper, Number constant, bool right) {
+  switch (oper) {
+    case OP_Add:
+    case OP_BitOr:
+    case OP_BitXor:
+      return number_is(constant, 0);
+    case OP_Sub:
+    case OP_Shl:
+    case OP_Shr:
+      return right == true && number_is(constant, 0);
+    case OP_Mul:
+      return number_is(constant, 1);
+    case OP_Div:
+      return right == true && number_is(constant, 1);
+    default:
+      return false;
+  }
+}
+
+// Operations with a constant on one side that give the constant whatever
+// the other side is: x * 0 and x & 0
+static bool is_absorbing(OperKind oper, Number constant) {
+  return (oper == OP_Mul || oper == OP_BitAnd) && number_is(constant, 0);
+}
+
+// Takes the nodes the operands were folded into
+static NodeId fold_operation(
+  Folder* folder, NodeId id, NodeId lhs, NodeId rhs
+) {
+  Ast* ast = folder->ast;
+  Node* node = ast_get(ast, id);
+  node->operation.lhs = lhs;
+  node->operation.rhs = rhs;
+  OperKind oper = node->operation.kind;
+  if (oper == OP_Asg || oper == OP_ArrIdx) {
+    return id;
+  }
+
+  const ValueNode* left = int_constant(ast, lhs);
+  const ValueNode* right = int_constant(ast, rhs);
+  if (left != nullptr && right != nullptr && left->type == right->type) {
+    const TypeNode* type = &ast_get(ast, left->type)->type;
+    Number result;
+    if (number_binary(
+          oper, type->kind, type->bit_width, left->number, right->number,
+          &result
+        ) != true) {
+      return id;
+    }
+    // The left value is reused for the result, the operation and the right
+    // value drop out of the tree
+    NodeId result_type = is_predicate(oper) == true
+                           ? make_numeric_type(ast, TP_UInt, 1)
+                           : ast_get(ast, lhs)->value.type;
+    ValueNode* value = &ast_get(ast, lhs)->value;
+    value->type = result_type;
+    value->number = result;
+    folder->eliminated += 2;
+    return lhs;
+  }
+
+  if (right != nullptr && is_identity(oper, right->number, true) == true) {
+    folder->eliminated += 2;
+    return lhs;
+  } else if (left != nullptr && is_identity(oper, left->number, false)) {
+    folder->eliminated += 2;
+    return rhs;
+  } else if (right != nullptr && is_absorbing(oper, right->number) == true &&
+             is_pure(folder, lhs) == true) {
+    folder->eliminated += 1 + count_nodes(folder, lhs);
+    return rhs;
+  } else if (left != nullptr && is_absorbing(oper, left->number) == true &&
+             is_pure(folder, rhs) == true) {
+    folder->eliminated += 1 + count_nodes(folder, rhs);
+    return lhs;
+  }
+  return id;
+}
+
+static NodeId fold_negation(Folder* folder, NodeId id, NodeId operand) {
+  Ast* ast = folder->ast;
+  ast_get(ast, id)->unary = operand;
+  const ValueNode* constant = int_constant(ast, operand);
+  if (constant == nullptr) {
+    return id;
+  }
+  const TypeNode* type = &ast_get(ast, constant->type)->type;
+  ValueNode* value = &ast_get(ast, operand)->value;
+  value->number = number_negative(value->number, type->kind, type->bit_width);
+  folder->eliminated += 1;
+  return operand;
+}
+
+static NodeList fold_list(Folder* folder, NodeList list);
+static void fold_into(Folder* folder, NodeId id);
+
+static void push_item(Folder* folder, NodeId id) {
+  NodeId_vector_push(&folder->items, id);
+}
+
+// Pushes the statements an "if" or "while" with a constant condition is left
+// as, statements of a block taken in its place are spliced into the
+// enclosing list. Blocks declaring names keep their own scope and are not
+// spliced.
+static void fold_branch(Folder* folder, NodeId id, NodeId taken) {
+  Ast* ast = folder->ast;
+  if (taken == 0) {
+    folder->eliminated += count_nodes(folder, id);
+    return;
+  }
+  Node* branch = ast_get(ast, taken);
+  if (branch->kind == ND_Decl) {
+    push_item(folder, id);
+    return;
+  }
+  if (branch->kind == ND_Block) {
+    for (u32 i = 0; i < branch->block.count; ++i) {
+      if (ast_get(ast, ast_list(ast, branch->block)[i])->kind == ND_Decl) {
+        push_item(folder, id);
+        return;
+      }
+    }
+  }
+  usize kept = branch->kind == ND_Block ? count_list(folder, branch->block)
+                                        : count_nodes(folder, taken);
+  folder->eliminated += count_nodes(folder, id) - kept;
+  if (branch->kind != ND_Block) {
+    push_item(folder, taken);
+    return;
+  }
+  for (u32 i = 0; i < branch->block.count; ++i) {
+    push_item(folder, ast_list(ast, branch->block)[i]);
+  }
+}
+
+// Branches hold a single statement, one folded into none or into several
+// statements is held by a block in its place
+static NodeId fold_body(Folder* folder, NodeId id) {
+  Ast* ast = folder->ast;
+  usize base = folder->items->length;
+  fold_into(folder, id);
+  usize count = folder->items->length - base;
+  const NodeId* items = folder->items->buffer + base;
+  folder->items->length = base;
+  if (count == 1) {
+    return items[0];
+  }
+  folder->eliminated -= 1;
+  return make_block(ast, make_list(ast, items, count));
+}
+
+static void fold_if(Folder* folder, NodeId id) {
+  Ast* ast = folder->ast;
+  NodeId cond = fold_node(folder, ast_get(ast, id)->if_node.cond);
+  ast_get(ast, id)->if_node.cond = cond;
+  NodeId then = fold_body(folder, ast_get(ast, id)->if_node.then);
+  ast_get(ast, id)->if_node.then = then;
+  NodeId elseb = ast_get(ast, id)->if_node.elseb;
+  if (elseb != 0) {
+    elseb = fold_body(folder, elseb);
+    ast_get(ast, id)->if_node.elseb = elseb;
+  }
+  const ValueNode* constant = int_constant(ast, cond);
+  if (constant == nullptr) {
+    push_item(folder, id);
+    return;
+  }
+  const IfNode* node = &ast_get(ast, id)->if_node;
+  fold_branch(
+    folder, id, number_is(constant->number, 0) ? node->elseb : node->then
+  );
+}
+
+static void fold_while(Folder* folder, NodeId id) {
+  Ast* ast = folder->ast;
+  NodeId cond = fold_node(folder, ast_get(ast, id)->while_node.cond);
+  ast_get(ast, id)->while_node.cond = cond;
+  NodeId then = fold_body(folder, ast_get(ast, id)->while_node.then);
+  ast_get(ast, id)->while_node.then = then;
+  const ValueNode* constant = int_constant(ast, cond);
+  if (constant != nullptr && number_is(constant->number, 0) == true) {
+    fold_branch(folder, id, 0);
+  } else {
+    push_item(folder, id);
+  }
+}
+
+// Statements and leaves, statements fold the expressions they hold with
+// fold_node of their own. A branch in place of a single node is left as one
+// node, see fold_body.
+static NodeId fold_stmt(Folder* folder, NodeId id) {
+  Ast* ast = folder->ast;
+  switch (ast_get(ast, id)->kind) {
+    case ND_Return: {
+      NodeId value = fold_node(folder, ast_get(ast, id)->unary);
+      ast_get(ast, id)->unary = value;
+      return id;
+    }
+    case ND_Block: {
+      NodeList body = fold_list(folder, ast_get(ast, id)->block);
+      ast_get(ast, id)->block = body;
+      return id;
+    }
+    case ND_Decl: {
+      NodeId value = fold_node(folder, ast_get(ast, id)->declaration.value);
+      ast_get(ast, id)->declaration.value = value;
+      return id;
+    }
+    case ND_If:
+    case ND_While:
+      return fold_body(folder, id);
+    case ND_Operation:
+    case ND_Negation:
+    case ND_Value:
+    case ND_Call:
+    case ND_None:
+    case ND_Addr:
+    case ND_Deref:
+    case ND_Type:
+    case ND_Variable:
+    case ND_ArgVar:
+    case ND_Function:
+      return id;
+  }
+  return id;
+}
+
+// Pushes the node at id to be folded. Only operations, negations, calls and
+// array values have operands to come back to, anything else is folded on
+// the spot and left in folded for the frame below.
+static void push_fold(Folder* folder, NodeId id, NodeId* folded) {
+  if (id == 0) {
+    *folded = 0;
+    return;
+  }
+  Node* node = ast_get(folder->ast, id);
+  if (node->kind == ND_Value) {
+    TypeKind kind = ast_get(folder->ast, node->value.type)->type.kind;
+    if (kind != TP_Ptr && kind != TP_Arr) {
+      *folded = id;
+      return;
+    }
+  } else if (node->kind != ND_Operation && node->kind != ND_Negation &&
+             node->kind != ND_Call) {
+    *folded = fold_stmt(folder, id);
+    return;
+  }
+  FoldFrame_vector_push(&folder->frames, (FoldFrame){ .id = id });
+}
+
+// The elements of an array value or the arguments of a call
+static NodeList operand_list(const Ast* ast, NodeId id) {
+  const Node* node = ast_get(ast, id);
+  return node->kind == ND_Call ? node->call_node.args : node->value.elements;
+}
+
+// Advances the frame on top of the stack, folded is the node the operand it
+// pushed last was folded into. Returns false after pushing another operand,
+// true once the frame is done with the node taking its place in folded.
+static bool fold_step(Folder* folder, NodeId* folded) {
+  Ast* ast = folder->ast;
+  FoldFrame* top = &folder->frames->buffer[folder->frames->length - 1];
+  FoldFrame frame = *top;
+  Node* node = ast_get(ast, frame.id);
+  top->stage += 1;
+  switch (node->kind) {
+    case ND_Operation:
+      if (frame.stage == 0) {
+        push_fold(folder, node->operation.lhs, folded);
+        return false;
+      } else if (frame.stage == 1) {
+        top->operand = *folded;
+        push_fold(folder, node->operation.rhs, folded);
+        return false;
+      }
+      *folded = fold_operation(folder, frame.id, frame.operand, *folded);
+      return true;
+
+    case ND_Negation:
+      if (frame.stage == 0) {
+        push_fold(folder, node->unary, folded);
+        return false;
+      }
+      *folded = fold_negation(folder, frame.id, *folded);
+      return true;
+
+    case ND_Value:
+    case ND_Call: {
+      NodeList list = operand_list(ast, frame.id);
+      if (frame.count != 0) {
+        ast_list(ast, list)[frame.count - 1] = *folded;
+      }
+      if (frame.count < list.count) {
+        top->count = frame.count + 1;
+        push_fold(folder, ast_list(ast, list)[frame.count], folded);
+        return false;
+      }
+      *folded = frame.id;
+      return true;
+    }
+
+    default:  // Never pushed, see push_fold
+      *folded = frame.id;
+      return true;
+  }
+}
+
+// Returns the node taking the place of id, statements folded into none or
+// several of them go through fold_into instead
+static NodeId fold_node(Folder* folder, NodeId id) {
+  usize base = folder->frames->length;
+  NodeId folded = 0;
+  push_fold(folder, id, &folded);
+  while (folder->frames->length > base) {
+    if (fold_step(folder, &folded) == true) {
+      folder->frames->length -= 1;
+    }
+  }
+  return folded;
+}
+
+// Pushes the statements taking the place of the one at id, none when it
+// drops out
+static void fold_into(Folder* folder, NodeId id) {
+  NodeKind kind = ast_get(folder->ast, id)->kind;
+  if (kind == ND_If) {
+    fold_if(folder, id);
+  } else if (kind == ND_While) {
+    fold_while(folder, id);
+  } else {
+    push_item(folder, fold_node(folder, id));
+  }
+}
+
+// Folds every statement of the list, the statements taking their place are
+// written over it or into a new list when there are more of them
+static NodeList fold_list(Folder* folder, NodeList list) {
+  Ast* ast = folder->ast;
+  usize base = folder->items->length;
+  for (u32 i = 0; i < list.count; ++i) {
+    fold_into(folder, ast_list(ast, list)[i]);
+  }
+  usize count = folder->items->length - base;
+  const NodeId* items = folder->items->buffer + base;
+  folder->items->length = base;
+  if (count > list.count) {
+    return make_list(ast, items, count);
+  }
+  if (count != 0) {
+    memcpy(ast_list(ast, list), items, sizeof(NodeId) * count);
+  }
+  list.count = (u32)count;
+  return list;
+}
+
+usize fold_tree(Ast* ast, NodeList tree) {
+  Folder folder = {
+    .ast = ast,
+    .nodes = NodeId_vector_make(64),
+    .items = NodeId_vector_make(64),
+    .frames = FoldFrame_vector_make(64),
+  };
+  for (u32 i = 0; i < tree.count; ++i) {
+    NodeId function = ast_list(ast, tree)[i];
+    NodeId body = ast_get(ast, function)->function.body;
+    if (body != 0) {
+      fold_node(&folder, body);
+    }
+  }
+  free(folder.nodes);
+  free(folder.items);
+  free(folder.frames);
+  return folder.eliminated;
+}
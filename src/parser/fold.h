@@ -0,0 +1,9 @@
+#pragma once
+#include <parser/mod.h>
+#include <utility/mod.h>
+
+// Folds constant integer arithmetic and comparisons, simplifies operations
+// with an identity or absorbing constant and drops branches of "if" and
+// "while" whose condition is constant. The tree is rewritten in place,
+// returns the number of nodes no longer reachable from it.
+extern usize fold_tree(Ast* ast, NodeList tree);
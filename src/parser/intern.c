@@ -0,0 +1,127 @@
+#include <arena/mod.h>
+#include <hashmap/mod.h>
+#include <parser/intern.h>
+#include <parser/mod.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility/mod.h>
+
+typedef struct SymbolEntry SymbolEntry;
+struct SymbolEntry {
+  usize hash;
+  StrNode* string;
+};
+
+// Open addressing over symbol ids. Every slot keeps the low half of the hash
+// and the spelling next to the id, so a lookup reads one slot and one
+// spelling and never the entry table. Spellings are copied into an arena so
+// they stay put while the tables grow.
+typedef struct SymbolSlot SymbolSlot;
+struct SymbolSlot {
+  Symbol symbol;
+  u32 tag;
+  StrNode* string;
+};
+
+typedef struct Interner Interner;
+struct Interner {
+  usize capacity;
+  usize length;
+  SymbolSlot* slots;
+  SymbolEntry* entries;
+  Arena strings;
+};
+
+static Interner interner;
+
+// Short spellings leave the string hash close to their raw bytes, mixing it
+// again spreads names like "x1", "x2" over the whole table
+static inline usize slot_of(usize hash, usize capacity) {
+  return (usize)(((u64)hash * 0x9e3779b97f4a7c15ULL) >> 32) & (capacity - 1);
+}
+
+static void interner_grow(Interner* table) {
+  usize capacity = table->capacity != 0 ? table->capacity * 2 : 1024;
+  SymbolSlot* slots = calloc(capacity, sizeof(SymbolSlot));
+  SymbolEntry* entries =
+    realloc(table->entries, sizeof(SymbolEntry) * (capacity / 2 + 1));
+  if (slots == nullptr || entries == nullptr) {
+    perror("alloc");
+    exit(1);
+  }
+  for (Symbol symbol = 1; symbol < table->length; ++symbol) {
+    usize index = slot_of(entries[symbol].hash, capacity);
+    while (slots[index].symbol != 0) {
+      index = (index + 1) & (capacity - 1);
+    }
+    slots[index] = (SymbolSlot){
+      .symbol = symbol,
+      .tag = (u32)entries[symbol].hash,
+      .string = entries[symbol].string,
+    };
+  }
+  free(table->slots);
+  table->capacity = capacity;
+  table->slots = slots;
+  table->entries = entries;
+  table->length = max(table->length, (usize)1);
+}
+
+Symbol intern(StrView view) {
+  Interner* table = &interner;
+  if (table->length * 2 >= table->capacity) {
+    interner_grow(table);
+  }
+  usize hash = hashmap_hash(view);
+  usize mask = table->capacity - 1;
+  usize index = slot_of(hash, table->capacity);
+  for (; table->slots[index].symbol != 0; index = (index + 1) & mask) {
+    SymbolSlot* slot = &table->slots[index];
+    if (slot->tag == (u32)hash && slot->string->capacity == view.length &&
+        memcmp(slot->string->array, view.pointer, view.length) == 0) {
+      return slot->symbol;
+    }
+  }
+  usize size = sizeof(StrNode) + sizeof(char) * (view.length + 1);
+  StrNode* string = arena_alloc(&table->strings, size);
+  memcpy(string->array, view.pointer, view.length);
+  string->array[view.length] = 0;
+  string->capacity = view.length;
+
+  Symbol symbol = (Symbol)table->length;
+  table->entries[symbol] = (SymbolEntry){
+    .hash = hash,
+    .string = string,
+  };
+  table->slots[index] = (SymbolSlot){
+    .symbol = symbol,
+    .tag = (u32)hash,
+    .string = string,
+  };
+  table->length += 1;
+  return symbol;
+}
+
+StrView symbol_view(Symbol symbol) {
+  return strview_from_strnode(interner.entries[symbol].string);
+}
+
+const char* symbol_str(Symbol symbol) {
+  return interner.entries[symbol].string->array;
+}
+
+usize symbol_hash(Symbol symbol) {
+  return interner.entries[symbol].hash;
+}
+
+usize symbol_count() {
+  return interner.length != 0 ? interner.length - 1 : 0;
+}
+
+void interner_free() {
+  free(interner.slots);
+  free(interner.entries);
+  arena_free(&interner.strings);
+  interner = (Interner){};
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <utility/mod.h>
+#include <utility/vec.h>
+
+// Identifiers are interned once by the lexer, everything after it names
+// them by symbol. Symbols compare equal exactly when their spellings do, 0 is
+// never handed out. The interner is process wide and not thread safe, only
+// the thread driving the lexer may add to it.
+typedef u32 Symbol;
+DEFINE_VECTOR(Symbol)
+
+extern Symbol intern(StrView view);
+extern StrView symbol_view(Symbol symbol);
+extern const char* symbol_str(Symbol symbol);
+extern usize symbol_hash(Symbol symbol);
+extern usize symbol_count();
+extern void interner_free();
@@ -1,14 +1,19 @@
 #include <parser/ctors.h>
+#include <parser/diag.h>
 #include <parser/lexer.h>
+#include <parser/scan.h>
+#include <parser/words.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <unistd.h>
 #include <utility/mod.h>
 
-DEFINE_VEC_FNS(Token, malloc, free)
-
 unreturning void error(rcstr fmt, ...) {
+  diag_flush();
   va_list ap;
   va_start(ap, fmt);
   evprintf(fmt, ap);
@@ -16,55 +21,78 @@ unreturning void error(rcstr fmt, ...) {
   exit(1);
 }
 
-unreturning static void verror_at(
-  StrView view, rcstr location, rcstr fmt, va_list ap
-) {
-  rcstr input = view.pointer;
-  u32 line_num = 1;
-  for (rcstr cursor = input; cursor < location; ++cursor) {
-    if (*cursor == '\n') {
-      line_num += 1;
-    }
+LineIndex line_index_make(StrView input) {
+  const Scanner* scan = scanner_get();
+  rcstr iter = input.pointer;
+  rcstr end = input.pointer + input.length;
+  usize count = scan->count_newlines(iter, end) + 1;
+  u32* starts = malloc(sizeof(u32) * count);
+  if (starts == nullptr) {
+    perror("malloc");
+    exit(1);
   }
-  rcstr line = location;
-  while (input < line && line[-1] != '\n') {
-    line--;
+  starts[0] = 0;
+  for (usize line = 1; line < count; ++line) {
+    iter = scan->find_newline(iter, end) + 1;
+    starts[line] = (u32)(iter - input.pointer);
   }
-  rcstr end = location;
-  while (*end && *end != '\n') {
-    end++;
+  return (LineIndex){
+    .count = count,
+    .starts = starts,
+  };
+}
+
+SourceLoc line_index_find(const LineIndex* index, u32 offset) {
+  usize low = 0;
+  usize high = index->count;
+  while (high - low > 1) {
+    usize mid = low + (high - low) / 2;
+    if (index->starts[mid] <= offset) {
+      low = mid;
+    } else {
+      high = mid;
+    }
   }
-  i32 chars_written = eprintf("%u: ", line_num);
-  eprintf("%.*s\n", (i32)(end - line), line);
-  i32 position = (i32)(location - line) + chars_written;
+  return (SourceLoc){
+    .line = (u32)low + 1,
+    .column = offset - index->starts[low] + 1,
+  };
+}
 
-  eprintf("%*s", position, "");
-  eprintf("%s", "^ ");
-  evprintf(fmt, ap);
-  eputs();
-  exit(1);
+void line_index_free(LineIndex* index) {
+  free(index->starts);
+  *index = (LineIndex){};
+}
+
+static void report_at(StrView view, rcstr location, rcstr fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  diag_report(view, location, fmt, ap);
+  va_end(ap);
 }
 
 unreturning void error_at(StrView view, rcstr location, rcstr fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
-  verror_at(view, location, fmt, ap);
+  diag_report(view, location, fmt, ap);
+  va_end(ap);
+  diag_raise();
 }
 
-unreturning void error_tok(StrView view, Token* token, rcstr fmt, ...) {
+unreturning void error_tok(
+  const TokenStream* stream, TokenId id, rcstr fmt, ...
+) {
   va_list ap;
   va_start(ap, fmt);
-  verror_at(view, token->pos, fmt, ap);
+  diag_report(token_stream_input(stream), token_pos(stream, id), fmt, ap);
+  va_end(ap);
+  diag_raise();
 }
 
 static inline bool is_skippable(char ref) {
   return ref == ' ' || ref == '\t' || ref == '\r' || ref == '\f';
 }
 
-static inline bool is_num_literal(char ref) {
-  return (ref >= '0' && ref <= '9') || ref == '.' || ref == '_';
-}
-
 static inline bool is_number(char ref) {
   return ref >= '0' && ref <= '9';
 }
@@ -73,10 +101,6 @@ static inline bool is_char_literal(char ref) {
   return (ref >= 'a' && ref <= 'z') || (ref >= 'A' && ref <= 'Z') || ref == '_';
 }
 
-static inline bool is_char_number(char ref) {
-  return is_char_literal(ref) || is_number(ref);
-}
-
 #define MAKE_NAME_TABLE(NAME, SIZE) \
   static const char NAME##_table[][SIZE] = { ENTRIES };
 #define MAKE_TABLE(TYPE, NAME, NAME2)                                    \
@@ -152,18 +176,7 @@ MAKE_TABLE(AddInfo, punct, info)
 
 #undef ENTRIES
 
-#define ENTRIES        \
-  X(KW_Ext, "ext")     \
-  X(KW_Pub, "pub")     \
-  X(KW_Let, "let")     \
-  X(KW_Fn, "fn")       \
-  X(KW_Use, "use")     \
-  X(KW_If, "if")       \
-  X(KW_Else, "else")   \
-  X(KW_For, "for")     \
-  X(KW_While, "while") \
-  X(KW_Match, "match") \
-  X(KW_Return, "ret")
+#define ENTRIES KWRD_ENTRIES
 
 #define X(info, str) str,
 MAKE_NAME_TABLE(kwrd, 8)
@@ -179,12 +192,7 @@ MAKE_TABLE(AddInfo, kwrd, info)
 
 #undef ENTRIES
 
-#define ENTRIES          \
-  X(AD_F16Type, "f16")   \
-  X(AD_BF16Type, "bf16") \
-  X(AD_F32Type, "f32")   \
-  X(AD_F64Type, "f64")   \
-  X(AD_F128Type, "f128")
+#define ENTRIES FLT_ENTRIES
 
 #define X(info, str) str,
 MAKE_NAME_TABLE(flt, 4)
@@ -203,25 +211,42 @@ MAKE_TABLE(AddInfo, flt, info)
 typedef struct OptNumIdx OptNumIdx;
 struct OptNumIdx {
   usize size;
+  rcstr extra_dot;
   bool flt;
   bool some;
 };
 
-static OptNumIdx try_get_num_lit(StrView view, rcstr iter) {
+static OptNumIdx try_get_num_lit(
+  StrView view, rcstr iter, const Scanner* scan
+) {
   if (is_number(*iter) == false) {
     return (OptNumIdx){};
   }
-  usize size = 0;
+  rcstr end = view.pointer + view.length;
+  // Prefixed literals run over every identifier character, the parser
+  // checks their digits against the base
+  if (iter[0] == '0' && iter + 1 != end &&
+      ((iter[1] | 0x20) == 'x' || (iter[1] | 0x20) == 'o' ||
+       (iter[1] | 0x20) == 'b')) {
+    return (OptNumIdx){
+      .size = scan->skip_ident(iter + 2, end) - iter,
+      .some = true,
+    };
+  }
+  rcstr cursor = scan->skip_digits(iter, end);
   bool flt_found = false;
-  for (; is_num_literal(iter[size]) == true; ++size) {
-    if (iter[size] == '.' && flt_found == true) {
-      error_at(view, &iter[size], "More than one '.' found");
-    } else if (iter[size] == '.' && flt_found == false) {
-      flt_found = true;
+  while (cursor != end && *cursor == '.') {
+    if (flt_found == true) {
+      return (OptNumIdx){
+        .extra_dot = cursor,
+        .some = true,
+      };
     }
+    flt_found = true;
+    cursor = scan->skip_digits(cursor + 1, end);
   }
   return (OptNumIdx){
-    .size = size,
+    .size = cursor - iter,
     .flt = flt_found,
     .some = true,
   };
@@ -233,17 +258,17 @@ struct OptIdx {
   bool some;
 };
 
-static inline bool not_quote_punct(char ref, char prev) {
-  return ref != '\"' || (ref != '\"' && prev != '\\');
-}
-
-static OptIdx try_get_str_lit(rcstr iter) {
-  if (*iter != '\"') {
+// A backslash always takes the character after it, so an escaped quote does
+// not end the literal and an escaped backslash does not hide the quote after
+// it. Returns the size up to the closing quote, or up to end without one.
+static OptIdx try_get_quoted(StrView view, rcstr iter, char quote) {
+  if (*iter != quote) {
     return (OptIdx){};
   }
+  rcstr end = view.pointer + view.length;
   usize size = 1;
-  while (not_quote_punct(iter[size], iter[size - 1]) == true) {
-    size += 1;
+  while (iter + size != end && iter[size] != quote) {
+    size += iter[size] == '\\' && iter + size + 1 != end ? 2 : 1;
   }
   return (OptIdx){
     .size = size,
@@ -251,256 +276,723 @@ static OptIdx try_get_str_lit(rcstr iter) {
   };
 }
 
-static OptIdx try_get_char_lit(rcstr iter) {
-  if (*iter != '\'') {
+static OptIdx try_get_str_lit(StrView view, rcstr iter) {
+  return try_get_quoted(view, iter, '\"');
+}
+
+static OptIdx try_get_char_lit(StrView view, rcstr iter) {
+  return try_get_quoted(view, iter, '\'');
+}
+
+typedef struct WordHash WordHash;
+struct WordHash {
+  u32 seed;
+  u8 slots[1 << WORD_HASH_BITS];
+};
+
+// The word-seeds test keeps the seeds perfect for the ENTRIES lists, a build
+// that skipped it still stops here instead of missing a word
+static void word_hash_build(
+  WordHash* hash, u32 seed, rcstr names, usize stride, const usize* sizes,
+  usize count
+) {
+  hash->seed = seed;
+  for (usize i = 0; i < count; ++i) {
+    u32 slot = word_slot(seed, word_key(names + i * stride, sizes[i]));
+    if (hash->slots[slot] != 0) {
+      error("Reserved word hash seed 0x%08x has collisions", seed);
+    }
+    hash->slots[slot] = (u8)(i + 1);
+  }
+}
+
+static OptIdx word_hash_find(
+  const WordHash* hash, rcstr names, usize stride, const usize* sizes,
+  rcstr iter, usize size
+) {
+  if (size > stride) {
     return (OptIdx){};
   }
-  usize size = 1;
-  while (iter[size] != '\'') {
-    size += 1;
+  u8 slot = hash->slots[word_slot(hash->seed, word_key(iter, size))];
+  if (slot == 0) {
+    return (OptIdx){};
+  }
+  usize index = slot - 1;
+  if (sizes[index] != size ||
+      memcmp(iter, names + index * stride, size) != 0) {
+    return (OptIdx){};
   }
   return (OptIdx){
-    .size = size,
+    .size = index,
     .some = true,
   };
 }
 
-static OptIdx try_get_kwrd(rcstr iter) {
-  if (is_char_literal(*iter) == false) {
-    return (OptIdx){};
-  }
-  for (usize i = 0; i < sizeof_arr(kwrd_table); ++i) {
-    if (memcmp(iter, kwrd_table[i], kwrd_size_table[i]) == 0 &&
-        is_char_number(iter[kwrd_size_table[i]]) == false) {
-      return (OptIdx){
-        .size = i,
-        .some = true,
-      };
+// Every token kind is decided by the class of its first byte, so the lexer
+// looks at that byte once instead of asking each recognizer in turn.
+typedef enum CharClass : u8 {
+  CC_Invalid,
+  CC_Space,
+  CC_Newline,
+  CC_Digit,
+  CC_Word,
+  CC_Quote,
+  CC_Apos,
+  CC_Punct,
+} CharClass;
+
+// Punctuators are matched by a DFA built from the punct ENTRIES list: a trie
+// over the bytes that occur in punctuators, where every state remembers the
+// entry it accepts. Walking it reads each byte once and the last accepting
+// state is the maximal munch.
+#define PUNCT_STATES (sizeof_arr(punct_table) * 3 + 1)
+#define PUNCT_COLUMNS 32
+
+typedef struct PunctDfa PunctDfa;
+struct PunctDfa {
+  u8 column[256];
+  u8 next[PUNCT_STATES][PUNCT_COLUMNS];
+  u8 accept[PUNCT_STATES];
+};
+
+static WordHash kwrd_hash;
+static WordHash flt_hash;
+static u8 char_class[256];
+static PunctDfa punct_dfa;
+
+static void punct_dfa_build(PunctDfa* dfa) {
+  usize columns = 1;
+  usize states = 1;
+  for (usize i = 0; i < sizeof_arr(punct_table); ++i) {
+    usize state = 0;
+    for (usize j = 0; j < punct_size_table[i]; ++j) {
+      u8 byte = (u8)punct_table[i][j];
+      if (dfa->column[byte] == 0) {
+        if (columns == PUNCT_COLUMNS) {
+          error("Punctuator table uses more than %d bytes", PUNCT_COLUMNS);
+        }
+        dfa->column[byte] = (u8)columns;
+        columns += 1;
+      }
+      u8* next = &dfa->next[state][dfa->column[byte]];
+      if (*next == 0) {
+        *next = (u8)states;
+        states += 1;
+      }
+      state = *next;
+    }
+    // Entries are 1-based so 0 can mean no match, earlier entries win
+    if (dfa->accept[state] == 0) {
+      dfa->accept[state] = (u8)(i + 1);
     }
   }
-  return (OptIdx){};
 }
 
-static OptIdx try_get_fltt(rcstr iter) {
-  if (*iter != 'f' && *iter != 'b') {
-    return (OptIdx){};
-  }
-  for (usize i = 0; i < sizeof_arr(flt_table); ++i) {
-    if (memcmp(iter, flt_table[i], flt_size_table[i]) == 0 &&
-        is_char_number(iter[flt_size_table[i]]) == false) {
-      return (OptIdx){
-        .size = i,
-        .some = true,
-      };
+static once_flag tables_once = ONCE_FLAG_INIT;
+
+static void lexer_tables_build() {
+  word_hash_build(
+    &kwrd_hash, KWRD_HASH_SEED, kwrd_table[0], sizeof(kwrd_table[0]),
+    kwrd_size_table, sizeof_arr(kwrd_table)
+  );
+  word_hash_build(
+    &flt_hash, FLT_HASH_SEED, flt_table[0], sizeof(flt_table[0]),
+    flt_size_table, sizeof_arr(flt_table)
+  );
+  for (usize byte = 0; byte < 256; ++byte) {
+    if (is_skippable((char)byte) == true) {
+      char_class[byte] = CC_Space;
+    } else if (is_number((char)byte) == true) {
+      char_class[byte] = CC_Digit;
+    } else if (is_char_literal((char)byte) == true) {
+      char_class[byte] = CC_Word;
     }
   }
-  return (OptIdx){};
+  char_class['\n'] = CC_Newline;
+  char_class['\"'] = CC_Quote;
+  char_class['\''] = CC_Apos;
+  for (usize i = 0; i < sizeof_arr(punct_table); ++i) {
+    char_class[(u8)punct_table[i][0]] = CC_Punct;
+  }
+  punct_dfa_build(&punct_dfa);
+}
+
+// Lexers on several threads may be made at the same time, the tables are
+// built once before any of them reads them
+static void lexer_tables_init() {
+  call_once(&tables_once, lexer_tables_build);
+}
+
+static OptIdx try_get_kwrd(rcstr iter, usize size) {
+  return word_hash_find(
+    &kwrd_hash, kwrd_table[0], sizeof(kwrd_table[0]), kwrd_size_table, iter,
+    size
+  );
 }
 
-static OptIdx try_get_intt(rcstr iter, char comp) {
+static OptIdx try_get_fltt(rcstr iter, usize size) {
+  return word_hash_find(
+    &flt_hash, flt_table[0], sizeof(flt_table[0]), flt_size_table, iter, size
+  );
+}
+
+static bool is_intt(rcstr iter, usize size, char comp) {
   if (*iter != comp) {
-    return (OptIdx){};
-  }
-  usize size = 1;
-  while (is_number(iter[size]) == true) {
-    size += 1;
+    return false;
   }
-  if (is_char_literal(iter[size]) == true) {
-    return (OptIdx){};
+  for (usize i = 1; i < size; ++i) {
+    if (is_number(iter[i]) == false) {
+      return false;
+    }
   }
-  return (OptIdx){
-    .size = size,
-    .some = true,
-  };
+  return true;
 }
 
-static OptIdx try_get_ident(rcstr iter) {
-  usize size = 0;
-  while (is_char_number(iter[size]) == true) {
-    size += 1;
+static OptIdx try_get_punct(rcstr iter, rcstr end) {
+  const PunctDfa* dfa = &punct_dfa;
+  usize state = 0;
+  usize accept = 0;
+  for (; iter != end; ++iter) {
+    state = dfa->next[state][dfa->column[(u8)*iter]];
+    if (state == 0) {
+      break;
+    }
+    accept = dfa->accept[state] != 0 ? dfa->accept[state] : accept;
   }
-  if (size == 0) {
+  if (accept == 0) {
     return (OptIdx){};
   }
   return (OptIdx){
-    .size = size,
+    .size = accept - 1,
     .some = true,
   };
 }
 
-static OptIdx try_get_punct(rcstr iter) {
-  for (usize i = 0; i < sizeof_arr(punct_table); ++i) {
-    if (memcmp(iter, punct_table[i], punct_size_table[i]) == 0) {
-      return (OptIdx){
-        .size = i,
-        .some = true,
-      };
-    }
-  }
-  return (OptIdx){};
-}
-
-TokenVector* lex_string(StrView view) {
-  TokenVector* tokens = Token_vector_make(64);
+// Skips whitespace, newlines and comments and reports whether a newline was
+// crossed, which marks the token before the skipped run as end of line
+static bool skip_trivia(Lexer* lexer) {
+  const Scanner* scan = lexer->scan;
+  rcstr iter = lexer->iter;
+  rcstr end = lexer->input.pointer + lexer->input.length;
+  bool is_eol = false;
 
-#define tokens_push(...) Token_vector_push(&tokens, ((Token)__VA_ARGS__))
+  while (iter != end) {
+    CharClass class = char_class[(u8)*iter];
 
-  rcstr iter = view.pointer;
-  while (iter != view.pointer + view.length) {
     /// Skippable
-    if (is_skippable(*iter) == true) {
+    if (class == CC_Space) {
       iter += 1;
+      if (iter != end && char_class[(u8)*iter] == CC_Space) {
+        iter = scan->skip_space(iter, end);
+      }
       continue;
     }
 
     /// End of line
-    if (*iter == '\n') {
-      if (tokens->length != 0) {
-        tokens->buffer[tokens->length - 1].is_eol = true;
-      }
+    if (class == CC_Newline) {
+      is_eol = true;
       iter += 1;
       continue;
     }
 
     /// Comment
-    if (*iter == '/' && iter[1] == '/') {
-      while (*iter != '\n') {
-        iter += 1;
-      }
+    if (*iter == '/' && iter + 1 != end && iter[1] == '/') {
+      iter = scan->find_newline(iter + 2, end);
       continue;
     }
+    break;
+  }
+  lexer->iter = iter;
+  return is_eol;
+}
+
+// Speculative lexers record the first error instead of reporting it, the
+// stitching step decides whether the error is real. The lexer cannot step
+// over a bad character, so its errors end the run instead of unwinding.
+static Token lex_failure(Lexer* lexer, rcstr location, rcstr message) {
+  if (lexer->tolerant == true) {
+    report_at(lexer->input, location, "%s", message);
+  } else if (lexer->speculative == false) {
+    diag_recover(nullptr);
+    error_at(lexer->input, location, "%s", message);
+  }
+  lexer->failure = lexer->iter;
+  return (Token){
+    .kind = TK_Eof,
+    .pos = location,
+  };
+}
+
+static Token lex_token(Lexer* lexer) {
+  StrView view = lexer->input;
+  const Scanner* scan = lexer->scan;
+  rcstr iter = lexer->iter;
+  rcstr end = view.pointer + view.length;
+
+  if (iter == end) {
+    return (Token){
+      .kind = TK_Eof,
+      .pos = end,
+    };
+  }
+
+#define token_return(NEXT, ...)        \
+  do {                                 \
+    Token token = (Token)__VA_ARGS__;  \
+    lexer->iter = (NEXT);              \
+    token.is_eol = skip_trivia(lexer); \
+    return token;                      \
+  } while (false)
 
+  switch (char_class[(u8)*iter]) {
     /// Number
-    OptNumIdx opt_num = try_get_num_lit(view, iter);
-    if (opt_num.some == true) {
-      if (opt_num.flt == true) {
-        tokens_push({
-          .kind = TK_FltLiteral,
-          .pos = iter,
-          .len = opt_num.size,
-        });
-      } else {
-        tokens_push({
-          .kind = TK_IntLiteral,
-          .pos = iter,
-          .len = opt_num.size,
-        });
+    case CC_Digit: {
+      OptNumIdx opt = try_get_num_lit(view, iter, scan);
+      if (opt.extra_dot != nullptr) {
+        return lex_failure(lexer, opt.extra_dot, "More than one '.' found");
       }
-      iter += opt_num.size;
-      continue;
+      token_return(iter + opt.size, {
+        .kind = opt.flt == true ? TK_FltLiteral : TK_IntLiteral,
+        .pos = iter,
+      });
     }
 
     /// String
-    OptIdx opt = try_get_str_lit(iter);
-    if (opt.some == true) {
-      tokens_push({
+    case CC_Quote: {
+      OptIdx opt = try_get_str_lit(view, iter);
+      if (iter + opt.size == end) {
+        return lex_failure(lexer, iter, "Unterminated string literal");
+      }
+      token_return(iter + opt.size + 1, {
         .kind = TK_StrLiteral,
         .pos = iter + 1,
-        .len = opt.size - 1,
       });
-      iter += opt.size + 1;
-      continue;
     }
 
     /// Char
-    opt = try_get_char_lit(iter);
-    if (opt.some == true) {
-      tokens_push({
+    case CC_Apos: {
+      OptIdx opt = try_get_char_lit(view, iter);
+      if (iter + opt.size == end) {
+        return lex_failure(lexer, iter, "Unterminated character literal");
+      }
+      token_return(iter + opt.size + 1, {
         .kind = TK_CharLiteral,
         .pos = iter + 1,
-        .len = opt.size - 1,
       });
-      iter += opt.size + 1;
-      continue;
     }
 
-    /// Keyword
-    opt = try_get_kwrd(iter);
-    if (opt.some == true) {
-      tokens_push({
-        .kind = TK_Keyword,
-        .info = kwrd_info_table[opt.size],
-        .pos = iter,
-        .len = kwrd_size_table[opt.size],
-      });
-      iter += kwrd_size_table[opt.size];
-      continue;
-    }
+    /// Word
+    case CC_Word: {
+      usize size = scan->skip_ident(iter, end) - iter;
 
-    /// Floating point
-    opt = try_get_fltt(iter);
-    if (opt.some == true) {
-      tokens_push({
-        .kind = TK_Ident,
-        .info = flt_info_table[opt.size],
-        .pos = iter,
-        .len = flt_size_table[opt.size],
-      });
-      iter += flt_size_table[opt.size];
-      continue;
-    }
+      /// Keyword
+      OptIdx opt = try_get_kwrd(iter, size);
+      if (opt.some == true) {
+        token_return(iter + size, {
+          .kind = TK_Keyword,
+          .info = kwrd_info_table[opt.size],
+          .pos = iter,
+        });
+      }
 
-    /// Signed integer
-    opt = try_get_intt(iter, 'i');
-    if (opt.some == true) {
-      tokens_push({
-        .kind = TK_Ident,
-        .info = AD_SIntType,
-        .pos = iter,
-        .len = opt.size,
-      });
-      iter += opt.size;
-      continue;
-    }
+      // Speculative chunk lexers run on worker threads, their identifiers
+      // are interned when the chunks are stitched together
+      Symbol symbol = 0;
+      if (lexer->speculative == false) {
+        symbol = intern((StrView){ .pointer = iter, .length = size });
+      }
 
-    /// Unsigned integer
-    opt = try_get_intt(iter, 'u');
-    if (opt.some == true) {
-      tokens_push({
-        .kind = TK_Ident,
-        .info = AD_UIntType,
-        .pos = iter,
-        .len = opt.size,
-      });
-      iter += opt.size;
-      continue;
-    }
+      /// Floating point
+      opt = try_get_fltt(iter, size);
+      if (opt.some == true) {
+        token_return(iter + size, {
+          .kind = TK_Ident,
+          .info = flt_info_table[opt.size],
+          .symbol = symbol,
+          .pos = iter,
+        });
+      }
+
+      /// Signed and unsigned integer
+      if (is_intt(iter, size, 'i') == true) {
+        token_return(iter + size, {
+          .kind = TK_Ident,
+          .info = AD_SIntType,
+          .symbol = symbol,
+          .pos = iter,
+        });
+      }
+      if (is_intt(iter, size, 'u') == true) {
+        token_return(iter + size, {
+          .kind = TK_Ident,
+          .info = AD_UIntType,
+          .symbol = symbol,
+          .pos = iter,
+        });
+      }
 
-    /// Ident
-    opt = try_get_ident(iter);
-    if (opt.some == true) {
-      tokens_push({
+      /// Ident
+      token_return(iter + size, {
         .kind = TK_Ident,
+        .symbol = symbol,
         .pos = iter,
-        .len = opt.size,
       });
-      iter += opt.size;
-      continue;
     }
 
     /// Punct
-    opt = try_get_punct(iter);
-    if (opt.some == true) {
-      tokens_push({
+    case CC_Punct: {
+      OptIdx opt = try_get_punct(iter, end);
+      if (opt.some == false) {
+        break;
+      }
+      token_return(iter + punct_size_table[opt.size], {
         .kind = TK_Punct,
         .info = punct_info_table[opt.size],
         .pos = iter,
-        .len = punct_size_table[opt.size],
       });
-      iter += punct_size_table[opt.size];
+    }
+
+    default:
+      break;
+  }
+
+#undef token_return
+
+  return lex_failure(lexer, iter, "Invalid token");
+}
+
+static Lexer lexer_make_at(StrView input, rcstr begin, bool speculative) {
+  Lexer lexer = {
+    .input = input,
+    .iter = begin,
+    .scan = scanner_get(),
+    .speculative = speculative,
+  };
+  unused bool is_eol = skip_trivia(&lexer);
+  return lexer;
+}
+
+Lexer lexer_make(StrView input) {
+  lexer_tables_init();
+  return lexer_make_at(input, input.pointer, false);
+}
+
+Lexer lexer_make_from(StrView input, usize offset) {
+  lexer_tables_init();
+  return lexer_make_at(input, input.pointer + offset, false);
+}
+
+Token* lexer_peek(Lexer* lexer, usize offset) {
+  if (offset >= LEXER_LOOKAHEAD) {
+    error("Lexer lookahead of %zu exceeds the ring buffer", offset);
+  }
+  while (lexer->count <= offset) {
+    usize slot = (lexer->head + lexer->count) % LEXER_LOOKAHEAD;
+    lexer->ring[slot] = lex_token(lexer);
+    lexer->count += 1;
+  }
+  return &lexer->ring[(lexer->head + offset) % LEXER_LOOKAHEAD];
+}
+
+Token lexer_next(Lexer* lexer) {
+  Token token = *lexer_peek(lexer, 0);
+  lexer->head = (lexer->head + 1) % LEXER_LOOKAHEAD;
+  lexer->count -= 1;
+  return token;
+}
+
+// Typical sources average well over 4 bytes per token, sizing the stream
+// from the input keeps lexing free of reallocations
+#define TOKEN_STREAM_CAPACITY(bytes) ((bytes) / 4 + 16)
+
+static void token_stream_reserve(TokenStream* stream, usize capacity) {
+  u8* block =
+    arena_alloc(stream->arena, capacity * (sizeof(u32) + sizeof(Symbol) + 2));
+  u32* offset = (u32*)block;
+  Symbol* symbol = (Symbol*)(offset + capacity);
+  u8* kind = (u8*)(symbol + capacity);
+  u8* info = kind + capacity;
+  if (stream->offset != nullptr) {
+    memcpy(offset, stream->offset, sizeof(u32) * stream->length);
+    memcpy(symbol, stream->symbol, sizeof(Symbol) * stream->length);
+    memcpy(kind, stream->kind, stream->length);
+    memcpy(info, stream->info, stream->length);
+  }
+  stream->capacity = capacity;
+  stream->offset = offset;
+  stream->symbol = symbol;
+  stream->kind = kind;
+  stream->info = info;
+}
+
+TokenStream token_stream_make(Arena* arena, StrView input, usize capacity) {
+  if (input.length > UINT32_MAX) {
+    error("Input of %zu bytes exceeds the 4 GiB source limit", input.length);
+  }
+  TokenStream stream = {
+    .arena = arena,
+    .source = input.pointer,
+    .source_length = input.length,
+  };
+  token_stream_reserve(&stream, max(capacity, (usize)16));
+  return stream;
+}
+
+void token_stream_push(TokenStream* stream, Token token) {
+  if (stream->length == stream->capacity) {
+    token_stream_reserve(stream, stream->capacity * 2);
+  }
+  usize index = stream->length;
+  stream->offset[index] = (u32)(token.pos - stream->source);
+  stream->symbol[index] = token.symbol;
+  stream->kind[index] = (u8)(token.kind | (token.is_eol ? TOKEN_EOL : 0));
+  stream->info[index] = (u8)token.info;
+  stream->length += 1;
+}
+
+static void token_stream_append(
+  TokenStream* stream, const TokenStream* src, usize from
+) {
+  usize count = src->length - from;
+  if (stream->length + count > stream->capacity) {
+    usize capacity = max(stream->capacity * 2, stream->length + count);
+    token_stream_reserve(stream, capacity);
+  }
+  memcpy(
+    stream->offset + stream->length, src->offset + from, sizeof(u32) * count
+  );
+  memcpy(
+    stream->symbol + stream->length, src->symbol + from,
+    sizeof(Symbol) * count
+  );
+  memcpy(stream->kind + stream->length, src->kind + from, count);
+  memcpy(stream->info + stream->length, src->info + from, count);
+  stream->length += count;
+}
+
+// Lengths are not stored, the token is measured again from its start
+StrView token_view(const TokenStream* stream, TokenId id) {
+  StrView input = token_stream_input(stream);
+  rcstr pos = token_pos(stream, id);
+  rcstr end = input.pointer + input.length;
+  usize length = 0;
+  switch (token_kind(stream, id)) {
+    case TK_Ident:
+    case TK_BasicType:
+    case TK_Keyword:
+      length = scanner_get()->skip_ident(pos, end) - pos;
+      break;
+    case TK_IntLiteral:
+    case TK_FltLiteral:
+      length = try_get_num_lit(input, pos, scanner_get()).size;
+      break;
+    case TK_StrLiteral:
+      length = try_get_str_lit(input, pos - 1).size - 1;
+      break;
+    case TK_CharLiteral:
+      length = try_get_char_lit(input, pos - 1).size - 1;
+      break;
+    case TK_Punct:
+      length = punct_size_table[try_get_punct(pos, end).size];
+      break;
+    case TK_Eof:
+      break;
+  }
+  return (StrView){
+    .pointer = pos,
+    .length = length,
+  };
+}
+
+static TokenStream lex_string_serial(Arena* arena, StrView view) {
+  TokenStream tokens =
+    token_stream_make(arena, view, TOKEN_STREAM_CAPACITY(view.length));
+  Lexer lexer = lexer_make(view);
+  Token token = lexer_next(&lexer);
+  for (; token.kind != TK_Eof; token = lexer_next(&lexer)) {
+    token_stream_push(&tokens, token);
+  }
+  token_stream_push(&tokens, token);
+  return tokens;
+}
+
+usize hardware_threads() {
+#ifdef __linux__
+  isize count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (usize)count : 1;
+#else
+  return 1;
+#endif
+}
+
+TokenStream lex_string(Arena* arena, StrView view) {
+  return lex_string_parallel(arena, view, hardware_threads());
+}
+
+// Parallel lexing splits the input at line starts. Every chunk is lexed
+// speculatively, as if no token crossed into it, and stops at the first
+// token starting past its end. Stitching then only has to check that the
+// previous chunk stopped exactly on one of the chunk's token starts, and
+// re-lexes serially until it does when a literal spanned the boundary.
+// Chunks are lexed into arenas of their own, which join the caller's arena
+// once stitched.
+typedef struct LexChunk LexChunk;
+struct LexChunk {
+  rcstr begin;
+  rcstr end;
+  rcstr resume;
+  rcstr failure;
+  TokenStream tokens;
+  Arena arena;
+};
+
+typedef struct LexPool LexPool;
+struct LexPool {
+  StrView input;
+  LexChunk* chunks;
+  usize count;
+  atomic_size_t next;
+};
+
+static inline u32 token_start(const TokenStream* stream, usize index) {
+  TokenKind kind = token_kind(stream, index);
+  if (kind == TK_StrLiteral || kind == TK_CharLiteral) {
+    return stream->offset[index] - 1;
+  }
+  return stream->offset[index];
+}
+
+static void lex_chunk(StrView input, LexChunk* chunk) {
+  Lexer lexer = lexer_make_at(input, chunk->begin, true);
+  chunk->tokens = token_stream_make(
+    &chunk->arena, input, TOKEN_STREAM_CAPACITY(chunk->end - chunk->begin)
+  );
+  while (lexer.iter < chunk->end) {
+    Token token = lex_token(&lexer);
+    if (lexer.failure != nullptr) {
+      break;
+    }
+    token_stream_push(&chunk->tokens, token);
+  }
+  chunk->resume = lexer.iter;
+  chunk->failure = lexer.failure;
+}
+
+static i32 lex_worker(void* data) {
+  LexPool* pool = data;
+  while (true) {
+    usize index = atomic_fetch_add(&pool->next, 1);
+    if (index >= pool->count) {
+      return 0;
+    }
+    lex_chunk(pool->input, &pool->chunks[index]);
+  }
+}
+
+static usize find_token_start(const TokenStream* tokens, u32 position) {
+  usize low = 0;
+  usize high = tokens->length;
+  while (low < high) {
+    usize mid = low + (high - low) / 2;
+    if (token_start(tokens, mid) < position) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low != tokens->length && token_start(tokens, low) != position) {
+    return tokens->length;
+  }
+  return low;
+}
+
+TokenStream lex_string_parallel(Arena* arena, StrView view, usize threads) {
+  if (threads <= 1 || view.length < LEX_PARALLEL_MIN) {
+    return lex_string_serial(arena, view);
+  }
+  lexer_tables_init();
+  rcstr end = view.pointer + view.length;
+
+  usize count = min(threads * 4, view.length / LEX_CHUNK_MIN);
+  LexChunk* chunks = arena_alloc(arena, sizeof(LexChunk) * count);
+  rcstr begin = view.pointer;
+  usize used = 0;
+  for (usize i = 1; i <= count && begin != end; ++i) {
+    rcstr split = end;
+    if (i != count) {
+      split = memchr(
+        view.pointer + view.length / count * i, '\n',
+        end - (view.pointer + view.length / count * i)
+      );
+      split = split == nullptr ? end : split + 1;
+    }
+    if (split <= begin) {
       continue;
     }
+    chunks[used] = (LexChunk){ .begin = begin, .end = split };
+    used += 1;
+    begin = split;
+  }
 
-    error_at(view, iter, "Invalid token");
+  LexPool pool = {
+    .input = view,
+    .chunks = chunks,
+    .count = used,
+  };
+  usize workers = min(threads, used);
+  thrd_t* handles = arena_alloc(arena, sizeof(thrd_t) * workers);
+  for (usize i = 1; i < workers; ++i) {
+    if (thrd_create(&handles[i], lex_worker, &pool) != thrd_success) {
+      error("Failed to start a lexer thread");
+    }
+  }
+  unused i32 result = lex_worker(&pool);
+  for (usize i = 1; i < workers; ++i) {
+    thrd_join(handles[i], nullptr);
+  }
+
+  usize total = 1;
+  for (usize i = 0; i < used; ++i) {
+    total += chunks[i].tokens.length;
+  }
+  TokenStream tokens = token_stream_make(arena, view, total);
+  Lexer lexer = lexer_make_at(view, view.pointer, false);
+  rcstr iter = lexer.iter;
+
+  for (usize i = 0; i < used; ++i) {
+    LexChunk* chunk = &chunks[i];
+    u32 position = (u32)(iter - view.pointer);
+    usize index = find_token_start(&chunk->tokens, position);
+    while (index == chunk->tokens.length && iter < chunk->end) {
+      lexer.iter = iter;
+      token_stream_push(&tokens, lex_token(&lexer));
+      iter = lexer.iter;
+      position = (u32)(iter - view.pointer);
+      index = find_token_start(&chunk->tokens, position);
+    }
+    if (iter < chunk->end) {
+      usize first = tokens.length;
+      token_stream_append(&tokens, &chunk->tokens, index);
+      for (TokenId id = first; id < tokens.length; ++id) {
+        if (token_kind(&tokens, id) == TK_Ident) {
+          tokens.symbol[id] = intern(token_view(&tokens, id));
+        }
+      }
+      iter = chunk->resume;
+      if (chunk->failure != nullptr) {
+        lexer.iter = chunk->failure;
+        unused Token token = lex_token(&lexer);
+      }
+    }
+    arena_adopt(arena, &chunk->arena);
   }
+  token_stream_push(&tokens, (Token){ .kind = TK_Eof, .pos = end });
   return tokens;
 }
 
-void lexer_print(TokenVector* tokens) {
-  Token* iter = tokens->buffer;
-  Token* sen = tokens->buffer + tokens->length;
-  for (; iter != sen; ++iter) {
-    switch (iter->kind) {  // clang-format off
+void lexer_print(const TokenStream* stream) {
+  for (TokenId id = 0; id < stream->length; ++id) {
+    switch (token_kind(stream, id)) {  // clang-format off
       case TK_Ident:        eprintf("Ident:%*s", 8, "");       break;
       case TK_BasicType:    eprintf("BasicType:%*s", 4, "");   break;
       case TK_IntLiteral:   eprintf("IntLiteral:%*s", 3, "");  break;
@@ -509,8 +1001,8 @@ void lexer_print(TokenVector* tokens) {
       case TK_CharLiteral:  eprintf("CharLiteral:%*s", 2, ""); break;
       case TK_Keyword:      eprintf("Keyword:%*s", 6, "");     break;
       case TK_Punct:        eprintf("Punct:%*s", 8, "");       break;
+      case TK_Eof:          return;
     }  // clang-format on
-    StrView str = { .pointer = iter->pos, .length = iter->len };
-    eputw(str);
+    eputw(token_view(stream, id));
   }
 }
@@ -1,4 +1,7 @@
 #pragma once
+#include <arena/mod.h>
+#include <parser/intern.h>
+#include <parser/scan.h>
 #include <utility/mod.h>
 #include <utility/vec.h>
 
@@ -11,6 +14,7 @@ typedef enum TokenKind : u16 {
   TK_CharLiteral,
   TK_Keyword,
   TK_Punct,
+  TK_Eof,
 } TokenKind;
 
 typedef enum AddInfo : u16 {
@@ -99,19 +103,134 @@ struct Token {
   TokenKind kind : 15;
   bool is_eol : 1;
   AddInfo info;
-  u32 len;
+  Symbol symbol;
   rcstr pos;
 };
-DEFINE_VECTOR(Token)
 
-#define strview_from_token(token)                    \
-  (StrView) {                                        \
-    .pointer = (token)->pos, .length = (token)->len, \
-  }
+// Tokens are stored as separate arrays of 32-bit source offsets and symbols
+// and kind and info bytes. The parser only ever inspects the kind and info in
+// its hot loops, positions and lengths are recovered from the source.
+// Identifiers carry their interned symbol, every other token has symbol 0.
+// The arrays live in the arena the stream was made in and are released with
+// it, a stream is never freed on its own.
+typedef u32 TokenId;
+typedef struct TokenStream TokenStream;
+struct TokenStream {
+  Arena* arena;
+  rcstr source;
+  usize source_length;
+  usize capacity;
+  usize length;
+  u32* offset;
+  Symbol* symbol;
+  u8* kind;
+  u8* info;
+};
+
+// The end of line flag lives in the top bit of the kind byte
+#define TOKEN_EOL 0x80
+
+#ifndef LEXER_LOOKAHEAD
+#define LEXER_LOOKAHEAD 4
+#endif
+
+// Inputs from LEX_PARALLEL_MIN bytes up are lexed and parsed on threads when
+// more than one is asked for. That keeps the whole token stream and the
+// scratch of every parse chunk at once, the lex arena peaks at about five
+// times the input size. A serial parse pulls the tokens of one item at a
+// time through a window and stays at a few megabytes.
+#ifndef LEX_PARALLEL_MIN
+#define LEX_PARALLEL_MIN (usize)(4 * 1024 * 1024)
+#endif
+#ifndef LEX_CHUNK_MIN
+#define LEX_CHUNK_MIN (usize)(256 * 1024)
+#endif
+
+// Pull-based lexer, tokens are produced on demand into a small ring buffer.
+// A failure ends the process unless the lexer is speculative, which stops
+// silently, or tolerant, which reports it and stops. Both leave the position
+// of the failure behind for their user to pick lexing up again.
+typedef struct Lexer Lexer;
+struct Lexer {
+  StrView input;
+  rcstr iter;
+  rcstr failure;
+  const Scanner* scan;
+  usize head;
+  usize count;
+  bool speculative;
+  bool tolerant;
+  Token ring[LEXER_LOOKAHEAD];
+};
+
+static inline TokenKind token_kind(const TokenStream* stream, TokenId id) {
+  return stream->kind[id] & ~TOKEN_EOL;
+}
+
+static inline AddInfo token_info(const TokenStream* stream, TokenId id) {
+  return stream->info[id];
+}
+
+static inline bool token_is_eol(const TokenStream* stream, TokenId id) {
+  return (stream->kind[id] & TOKEN_EOL) != 0;
+}
+
+static inline Symbol token_symbol(const TokenStream* stream, TokenId id) {
+  return stream->symbol[id];
+}
+
+static inline const char* token_pos(const TokenStream* stream, TokenId id) {
+  return stream->source + stream->offset[id];
+}
+
+static inline StrView token_stream_input(const TokenStream* stream) {
+  return (StrView){
+    .pointer = stream->source,
+    .length = stream->source_length,
+  };
+}
+
+extern TokenStream token_stream_make(
+  Arena* arena, StrView input, usize capacity
+);
+extern void token_stream_push(TokenStream* stream, Token token);
+extern StrView token_view(const TokenStream* stream, TokenId id);
+
+// Line and column of a source position, both counted from 1
+typedef struct SourceLoc SourceLoc;
+struct SourceLoc {
+  u32 line;
+  u32 column;
+};
+
+// The offsets the lines of one input start at. It belongs to whoever built
+// it, a caller looking up many positions of an input builds it once and
+// looks them up by binary search.
+typedef struct LineIndex LineIndex;
+struct LineIndex {
+  usize count;
+  u32* starts;
+};
+
+extern LineIndex line_index_make(StrView input);
+extern SourceLoc line_index_find(const LineIndex* index, u32 offset);
+extern void line_index_free(LineIndex* index);
 
-extern TokenVector* lex_string(StrView view);
-extern void lexer_print(TokenVector* lexer);
+extern Lexer lexer_make(StrView input);
+// Starts lexing at a byte offset into the input, positions stay relative to
+// the whole input
+extern Lexer lexer_make_from(StrView input, usize offset);
+extern Token lexer_next(Lexer* lexer);
+extern Token* lexer_peek(Lexer* lexer, usize offset);
+extern TokenStream lex_string(Arena* arena, StrView view);
+extern TokenStream lex_string_parallel(
+  Arena* arena, StrView view, usize threads
+);
+extern usize hardware_threads();
+extern void lexer_print(const TokenStream* stream);
 
 unreturning extern void error(rcstr fmt, ...);
 unreturning extern void error_at(StrView view, rcstr loc, rcstr fmt, ...);
-unreturning extern void error_tok(StrView view, Token* tok, rcstr fmt, ...);
+unreturning extern void error_tok(
+  const TokenStream* stream, TokenId id, rcstr fmt, ...
+);
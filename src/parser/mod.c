@@ -1,56 +1,98 @@
-#include <arena/mod.h>
-#include <hashmap/mod.h>
+#include <parser/cache.h>
 #include <parser/ctors.h>
+#include <parser/diag.h>
 #include <parser/lexer.h>
 #include <parser/mod.h>
+#include <parser/number.h>
+#include <setjmp.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <utility/mod.h>
 #include <utility/vec.h>
 
-static Node* parse_lexer(StrView input, TokenVector* tokens, Arena* arena);
+static NodeList parse_program(
+  Arena* arena, Lexer* lexer, Ast* ast, bool lazy
+);
+static NodeList parse_program_parallel(
+  Arena* arena, const TokenStream* tokens, Ast* ast, usize threads, bool lazy
+);
+static NodeList parse_reachable(
+  Arena* arena, Ast* ast, NodeList tree, StrView input
+);
 
 ParserOutput parse_string(ParserOptions opts) {
+  diag_set_limit(opts.error_limit);
+  bool cached = opts.cache_dir.length != 0;
+  CacheKey key =
+    cached == true ? cache_key(opts.input, opts.eager) : (CacheKey){};
+  if (cached == true) {
+    ParserOutput output = {};
+    if (cache_load(opts.cache_dir, key, &output) == true) {
+      output.ast.source = opts.input.pointer;
+      if (opts.verbose) {
+        print_ast(&output.ast, output.tree, opts.input);
+        eputs("\n-----------------------------------------------");
+      }
+      return output;
+    }
+  }
   if (opts.verbose) {
     eputw(opts.input);
     eputs("\n-----------------------------------------------");
-  }
-  TokenVector* tokens = lex_string(opts.input);
-  if (opts.verbose) {
-    lexer_print(tokens);
+    Arena arena = {};
+    TokenStream tokens = lex_string(&arena, opts.input);
+    lexer_print(&tokens);
     eputs("\n-----------------------------------------------");
+    arena_free(&arena);
   }
+  // Large inputs are lexed and parsed on all threads, everything else is
+  // streamed into the parser one function at a time. Unless asked to parse
+  // eagerly, bodies of private functions are skipped and only parsed once
+  // they are found to be reachable. Tokens, symbol tables and the rest of
+  // the scratch of parsing share one lex arena, released once the tree is
+  // complete.
+  usize threads = opts.threads != 0 ? opts.threads : hardware_threads();
+  bool lazy = opts.eager != true;
   Arena arena = {};
-  Node* tree = parse_lexer(opts.input, tokens, &arena);
+  Ast ast = ast_make(opts.input.pointer, AST_CAPACITY(opts.input.length));
+  NodeList tree = {};
+  if (threads > 1 && opts.input.length >= LEX_PARALLEL_MIN) {
+    TokenStream tokens = lex_string_parallel(&arena, opts.input, threads);
+    tree = parse_program_parallel(&arena, &tokens, &ast, threads, lazy);
+  } else {
+    Lexer lexer = lexer_make(opts.input);
+    tree = parse_program(&arena, &lexer, &ast, lazy);
+  }
+  if (lazy == true) {
+    tree = parse_reachable(&arena, &ast, tree, opts.input);
+  }
+  usize lex_peak = arena.peak;
+  arena_free(&arena);
   if (opts.verbose) {
-    print_ast(tree);
+    print_ast(&ast, tree, opts.input);
     eputs("\n-----------------------------------------------");
   }
-  free(tokens);
-  return (ParserOutput){
-    .arena = arena,
+  ParserOutput output = {
+    .ast = ast,
     .tree = tree,
+    .lex_peak = lex_peak,
   };
+  // Only trees without errors are cached, a hit is never missing one
+  if (cached == true && diag_count() == 0) {
+    cache_store(opts.cache_dir, key, &output);
+  }
+  return output;
 }
 
-DEFINE_VEC_FNS(Scope, malloc, free)
-
-static Node* find_variable(Token* token, Context cx) {
-  Scope* rev_itr = cx.scopes->buffer + cx.scopes->length - 1;
-  Scope* rev_sen = cx.scopes->buffer - 1;
-
-  for (; rev_itr != rev_sen; --rev_itr) {
-    Node* var = *hashmap_find(rev_itr, strview_from_token(token));
-    if (var != nullptr) {
-      return make_unary(cx.arena, ND_Variable, var);
-    }
-  }
-  return nullptr;
+static NodeId find_variable(TokenId token, Context cx) {
+  return scope_find(cx.symbols, token_symbol(cx.tokens, token));
 }
 
-static bool consume(Token** rest, Token* token, AddInfo info) {
-  if (token->info != info) {
+static bool consume(TokenId* rest, TokenId token, Context cx, AddInfo info) {
+  if (token_info(cx.tokens, token) != info) {
     *rest = token;
     return false;
   }
@@ -58,224 +100,690 @@ static bool consume(Token** rest, Token* token, AddInfo info) {
   return true;
 }
 
-static Token* expect_info(StrView input, Token* token, AddInfo info) {
-  if (token->info != info) {
-    error_tok(input, token, "Invalid expression");
+static TokenId expect_info(Context cx, TokenId token, AddInfo info) {
+  if (token_info(cx.tokens, token) != info) {
+    error_tok(cx.tokens, token, "Invalid expression");
   }
   return token + 1;
 }
 
-static Token* expect_eol(StrView input, Token* token) {
-  if (token->is_eol != true) {
-    error_tok(input, token + 1, "Expected end of the line");
+static TokenId expect_eol(Context cx, TokenId token) {
+  if (token_is_eol(cx.tokens, token) != true) {
+    error_tok(cx.tokens, token + 1, "Expected end of the line");
   }
   return token + 1;
 }
 
-static Token* expect_ident(StrView input, Token* token) {
-  if (token->kind != TK_Ident) {
-    error_tok(input, token, "Expected an identifier");
+static TokenId expect_ident(Context cx, TokenId token) {
+  if (token_kind(cx.tokens, token) != TK_Ident) {
+    error_tok(cx.tokens, token, "Expected an identifier");
   }
   return token + 1;
 }
 
-static Node* parse_list(
-  Token** rest, Token* token, Context cx, AddInfo breaker,
-  fn(Node*(Token**, Token*, Context)) callable
+static NodeList parse_list(
+  TokenId* rest, TokenId token, Context cx, AddInfo breaker,
+  fn(NodeId(TokenId*, TokenId, Context)) callable
 ) {
-  Node handle = {};
-  Node* cursor = &handle;
-  while (token->info != breaker) {
-    if (cursor != &handle) {
-      token = expect_info(cx.input, token, PK_Comma);
+  usize mark = cx.lists->length;
+  while (token_info(cx.tokens, token) != breaker) {
+    if (cx.lists->length != mark) {
+      token = expect_info(cx, token, PK_Comma);
     }
-    if (token->info == breaker) {
+    if (token_info(cx.tokens, token) == breaker) {
       break;
     }
-    cursor->next = callable(&token, token, cx);
-    cursor = cursor->next;
+    NodeId node = callable(&token, token, cx);
+    list_push(cx.lists, node);
   };
   *rest = token;
-  return handle.next;
-}
-
-static Node* parse_type(Token** rest, Token* token, Context cx);
-static Node* public_function(Token** rest, Token* token, Context cx);
-static Node* extern_function(Token** rest, Token* token, Context cx);
-static Node* function(Token** rest, Token* token, Context cx);
-static Node* argument(Token** rest, Token* token, Context cx);
-static Node* declaration(Token** rest, Token* token, Context cx);
-static Node* stmt(Token** rest, Token* token, Context cx);
-static Node* compound_stmt(Token** rest, Token* token, Context cx);
-static Node* assign(Token** rest, Token* token, Context cx);
-static Node* expr(Token** rest, Token* token, Context cx);
-static Node* equality(Token** rest, Token* token, Context cx);
-static Node* relational(Token** rest, Token* token, Context cx);
-static Node* add(Token** rest, Token* token, Context cx);
-static Node* mul(Token** rest, Token* token, Context cx);
-static Node* unary(Token** rest, Token* token, Context cx);
-static Node* primary(Token** rest, Token* token, Context cx);
-
-// program = functions*
-static Node* parse_lexer(StrView input, TokenVector* tokens, Arena* arena) {
-  Token* token = tokens->buffer;
-  Token* sentinel = tokens->buffer + tokens->length;
+  return list_close(cx.lists, cx.ast, mark);
+}
+
+static NodeId parse_type(TokenId* rest, TokenId token, Context cx);
+static NodeId public_function(TokenId* rest, TokenId token, Context cx);
+static NodeId extern_function(TokenId* rest, TokenId token, Context cx);
+static NodeId function(TokenId* rest, TokenId token, Context cx);
+static NodeId argument(TokenId* rest, TokenId token, Context cx);
+static NodeId declaration(TokenId* rest, TokenId token, Context cx);
+static NodeId stmt(TokenId* rest, TokenId token, Context cx);
+static NodeId compound_stmt(TokenId* rest, TokenId token, Context cx);
+static NodeId expr(TokenId* rest, TokenId token, Context cx);
+static NodeId primary(TokenId* rest, TokenId token, Context cx);
+
+// Pulls the tokens of the next top-level item into the window. An item ends
+// where a new "pub", "ext" or "fn" starts outside of braces or at the start
+// of a line, so the window only ever holds one function and is terminated by
+// an end of file token.
+static void fill_item(Lexer* lexer, TokenStream* window) {
+  window->length = 0;
+  Token prev = lexer_next(lexer);
+  usize depth = 0;
+  while (true) {
+    token_stream_push(window, prev);
+    if (prev.info == PK_LeftBrace) {
+      depth += 1;
+    } else if (prev.info == PK_RightBrace && depth != 0) {
+      depth -= 1;
+    }
+    Token* next = lexer_peek(lexer, 0);
+    if (next->kind == TK_Eof ||
+        splits_item(next->info, prev.info, prev.is_eol, depth) == true) {
+      break;
+    }
+    prev = lexer_next(lexer);
+  }
+  Token eof = { .kind = TK_Eof, .pos = lexer_peek(lexer, 0)->pos };
+  token_stream_push(window, eof);
+}
+
+// Whether an item starting a line ends the one being parsed at token, see
+// splits_item
+static bool resyncs(Context cx, TokenId token) {
+  return token != 0 && token_is_eol(cx.tokens, token - 1) == true &&
+         starts_item(
+           token_info(cx.tokens, token), token_info(cx.tokens, token - 1)
+         ) == true;
+}
+
+// Skips the tokens of an item that failed to parse, up to the next "pub",
+// "ext" or "fn". Braces are not counted, the failed item may not close them.
+static TokenId skip_item(Context cx, TokenId token) {
+  AddInfo prev = token_info(cx.tokens, token);
+  for (token += 1; token_kind(cx.tokens, token) != TK_Eof; ++token) {
+    AddInfo info = token_info(cx.tokens, token);
+    if (starts_item(info, prev) == true) {
+      break;
+    }
+    prev = info;
+  }
+  return token;
+}
+
+// item = ("pub" | "ext")? "fn" function
+static NodeId item(TokenId* rest, TokenId token, Context cx) {
+  if (consume(&token, token, cx, KW_Pub)) {
+    TokenId expected = expect_info(cx, token, KW_Fn);
+    return public_function(rest, expected, cx);
+
+  } else if (consume(&token, token, cx, KW_Ext)) {
+    TokenId expected = expect_info(cx, token, KW_Fn);
+    return extern_function(rest, expected, cx);
+  }
+  TokenId expected = expect_info(cx, token, KW_Fn);
+  return function(rest, expected, cx);
+}
+
+// Parses one item, an error inside it is collected and the item is left out
+// along with the names it bound and the lists it left open
+static NodeId recover_item(TokenId* rest, TokenId token, Context cx) {
+  usize mark = scope_enter(cx.symbols);
+  usize items = cx.lists->length;
+  jmp_buf point;
+  jmp_buf* outer = diag_recover(&point);
+  if (setjmp(point) != 0) {
+    diag_recover(outer);
+    scope_leave(cx.symbols, mark);
+    cx.lists->length = items;
+    *rest = skip_item(cx, token);
+    return 0;
+  }
+  NodeId node = item(rest, token, cx);
+  diag_recover(outer);
+  return node;
+}
+
+// items = item*
+// Parses the items starting in [token, end), end is at most the end of file.
+// The items are pushed to the list stack, below the lists of their bodies.
+static void parse_items(Context cx, TokenId token, TokenId end) {
+  while (token < end) {
+    NodeId node = recover_item(&token, token, cx);
+    if (node != 0) {
+      list_push(cx.lists, node);
+    }
+  }
+}
+
+// program = items
+// Pulls one item at a time from the lexer into a reused window
+static NodeList parse_program(
+  Arena* arena, Lexer* lexer, Ast* ast, bool lazy
+) {
+  SymbolTable symbols = symbol_table_make(arena, symbol_count() + 1);
+  TokenStream window = token_stream_make(arena, lexer->input, 256);
+  ListStack lists = list_stack_make(arena);
   Context cx = {
-    .scopes = Scope_vector_make(8),
-    .arena = arena,
-    .input = input,
+    .symbols = &symbols,
+    .lists = &lists,
+    .ast = ast,
+    .tokens = &window,
+    .lazy = lazy,
   };
-  Scope_vector_push(&cx.scopes, hashmap_make(32));
 
-  Node handle = {};
-  Node* cursor = &handle;
-  while (token != sentinel) {
-    if (consume(&token, token, KW_Pub)) {
-      Token* expected = expect_info(cx.input, token, KW_Fn);
-      cursor->next = public_function(&token, expected, cx);
-      cursor = cursor->next;
+  while (lexer_peek(lexer, 0)->kind != TK_Eof) {
+    fill_item(lexer, &window);
+    parse_items(cx, 0, window.length - 1);
+  }
+  return list_close(&lists, ast, 0);
+}
 
-    } else if (consume(&token, token, KW_Ext)) {
-      Token* expected = expect_info(cx.input, token, KW_Fn);
-      cursor->next = extern_function(&token, expected, cx);
-      cursor = cursor->next;
+NodeList parse_tokens(
+  Arena* arena, SymbolTable* symbols, const TokenStream* tokens,
+  TokenId begin, TokenId end, Ast* ast
+) {
+  usize mark = scope_enter(symbols);
+  ListStack lists = list_stack_make(arena);
+  Context cx = {
+    .symbols = symbols,
+    .lists = &lists,
+    .ast = ast,
+    .tokens = tokens,
+  };
+  parse_items(cx, begin, end);
+  scope_leave(symbols, mark);
+  return list_close(&lists, ast, 0);
+}
 
-    } else {
-      Token* expected = expect_info(cx.input, token, KW_Fn);
-      cursor->next = function(&token, expected, cx);
-      cursor = cursor->next;
+// Parallel parsing splits the token stream between top-level items, found
+// the same way fill_item finds them. Every chunk is parsed into a tree of its
+// own with its own symbol table, the trees are then appended to the first
+// one in source order. Every chunk keeps its scratch in an arena of its own,
+// which joins the lex arena once the workers are done. The functions of a
+// chunk are left on its list stack, the list of the whole tree is made from
+// them once the trees are joined.
+typedef struct ParseChunk ParseChunk;
+struct ParseChunk {
+  TokenId begin;
+  TokenId end;
+  ListStack lists;
+  Ast ast;
+  Arena arena;
+};
+
+typedef struct ParsePool ParsePool;
+struct ParsePool {
+  const TokenStream* tokens;
+  ParseChunk* chunks;
+  usize count;
+  atomic_size_t next;
+  bool lazy;
+};
+
+static void parse_chunk(const ParsePool* pool, ParseChunk* chunk) {
+  const TokenStream* tokens = pool->tokens;
+  if (chunk->ast.words == nullptr) {
+    usize bytes =
+      token_pos(tokens, chunk->end) - token_pos(tokens, chunk->begin);
+    chunk->ast = ast_make(tokens->source, AST_CAPACITY(bytes));
+  }
+  SymbolTable symbols =
+    symbol_table_make(&chunk->arena, symbol_count() + 1);
+  chunk->lists = list_stack_make(&chunk->arena);
+  Context cx = {
+    .symbols = &symbols,
+    .lists = &chunk->lists,
+    .ast = &chunk->ast,
+    .tokens = tokens,
+    .lazy = pool->lazy,
+  };
+  parse_items(cx, chunk->begin, chunk->end);
+}
+
+static i32 parse_worker(void* data) {
+  ParsePool* pool = data;
+  while (true) {
+    usize index = atomic_fetch_add(&pool->next, 1);
+    if (index >= pool->count) {
+      return 0;
+    }
+    parse_chunk(pool, &pool->chunks[index]);
+  }
+}
+
+static usize split_items(
+  const TokenStream* tokens, ParseChunk* chunks, usize count
+) {
+  TokenId eof = (TokenId)tokens->length - 1;
+  TokenId begin = 0;
+  usize used = 0;
+  usize depth = 0;
+  for (TokenId token = 1; token < eof && used + 1 < count; ++token) {
+    AddInfo prev = token_info(tokens, token - 1);
+    if (prev == PK_LeftBrace) {
+      depth += 1;
+    } else if (prev == PK_RightBrace && depth != 0) {
+      depth -= 1;
+    }
+    bool line = token_is_eol(tokens, token - 1);
+    if (splits_item(token_info(tokens, token), prev, line, depth) != true) {
+      continue;
+    }
+    depth = 0;
+    if (token >= eof / count * (used + 1)) {
+      chunks[used] = (ParseChunk){ .begin = begin, .end = token };
+      used += 1;
+      begin = token;
+    }
+  }
+  chunks[used] = (ParseChunk){ .begin = begin, .end = eof };
+  return used + 1;
+}
+
+static NodeList parse_program_parallel(
+  Arena* arena, const TokenStream* tokens, Ast* ast, usize threads, bool lazy
+) {
+  usize count = threads * 4;
+  ParseChunk* chunks = arena_alloc(arena, sizeof(ParseChunk) * count);
+  usize used = split_items(tokens, chunks, count);
+  chunks[0].ast = *ast;
+
+  ParsePool pool = {
+    .tokens = tokens,
+    .chunks = chunks,
+    .count = used,
+    .lazy = lazy,
+  };
+  usize workers = min(threads, used);
+  thrd_t* handles = arena_alloc(arena, sizeof(thrd_t) * workers);
+  diag_defer_limit(true);
+  for (usize i = 1; i < workers; ++i) {
+    if (thrd_create(&handles[i], parse_worker, &pool) != thrd_success) {
+      error("Failed to start a parser thread");
+    }
+  }
+  unused i32 result = parse_worker(&pool);
+  for (usize i = 1; i < workers; ++i) {
+    thrd_join(handles[i], nullptr);
+  }
+  diag_defer_limit(false);
+  for (usize i = 0; i < used; ++i) {
+    arena_adopt(arena, &chunks[i].arena);
+  }
+
+  *ast = chunks[0].ast;
+  ListStack functions = list_stack_make(arena);
+  for (usize i = 0; i < used; ++i) {
+    ParseChunk* chunk = &chunks[i];
+    u32 delta = 0;
+    if (i != 0 && chunk->lists.length != 0) {
+      delta = ast_append(ast, &chunk->ast);
+    }
+    for (usize j = 0; j < chunk->lists.length; ++j) {
+      list_push(&functions, chunk->lists.items[j] + delta);
+    }
+    if (i != 0) {
+      ast_free(&chunk->ast);
+    }
+  }
+  return list_close(&functions, ast, 0);
+}
+
+// Bodies skipped by a lazy parse are lexed again from their opening brace.
+// The arguments parsed with the signature are put back in scope, an error
+// in the body leaves the function without one. Every body is parsed in the
+// same window, symbol table and list stack, left as they were found.
+static NodeId recover_body(Context cx) {
+  usize items = cx.lists->length;
+  jmp_buf point;
+  jmp_buf* outer = diag_recover(&point);
+  if (setjmp(point) != 0) {
+    diag_recover(outer);
+    cx.lists->length = items;
+    return 0;
+  }
+  TokenId rest = 0;
+  NodeId body = compound_stmt(&rest, 1, cx);
+  diag_recover(outer);
+  return body;
+}
+
+static void parse_body(
+  Ast* ast, NodeId func, StrView input, SymbolTable* symbols,
+  ListStack* lists, TokenStream* window
+) {
+  Lexer lexer = lexer_make_from(input, ast_get(ast, func)->function.pending);
+  fill_item(&lexer, window);
+  usize mark = scope_enter(symbols);
+  Context cx = {
+    .symbols = symbols,
+    .lists = lists,
+    .ast = ast,
+    .tokens = window,
+  };
+  NodeList args = ast_get(ast, func)->function.args;
+  for (u32 i = 0; i < args.count; ++i) {
+    NodeId arg = ast_list(ast, args)[i];
+    Symbol name = ast_get(ast, arg)->declaration.name;
+    scope_bind(symbols, name, make_unary(ast, ND_Variable, arg, nullptr));
+  }
+  NodeId body = recover_body(cx);
+  ast_get(ast, func)->function.body = body;
+  ast_get(ast, func)->function.pending = 0;
+  scope_leave(symbols, mark);
+}
+
+// Functions found by name, the ones reached so far and the reached ones whose
+// bodies are still to be searched for calls. Bodies are searched with an
+// explicit stack of the nodes still to be visited, deep expressions do not
+// recurse.
+typedef struct Reach Reach;
+struct Reach {
+  Arena* arena;
+  NodeId* functions;
+  bool* reached;
+  NodeId* queue;
+  usize queued;
+  NodeId* stack;
+  usize depth;
+  usize capacity;
+};
+
+static void reach_function(Reach* reach, Symbol name) {
+  if (reach->functions[name] != 0 && reach->reached[name] != true) {
+    reach->reached[name] = true;
+    reach->queue[reach->queued] = reach->functions[name];
+    reach->queued += 1;
+  }
+}
+
+static void reach_reserve(Reach* reach, usize count) {
+  if (reach->depth + count > reach->capacity) {
+    usize capacity = max(reach->capacity * 2, reach->depth + count);
+    reach->stack = arena_realloc(
+      reach->arena, reach->stack, sizeof(NodeId) * reach->capacity,
+      sizeof(NodeId) * capacity
+    );
+    reach->capacity = capacity;
+  }
+}
+
+static void push_call_search(Reach* reach, NodeId id) {
+  if (id != 0) {
+    reach_reserve(reach, 1);
+    reach->stack[reach->depth] = id;
+    reach->depth += 1;
+  }
+}
+
+// The nodes of a list go on the stack last first, they are visited in order
+static void push_call_list(const Ast* ast, Reach* reach, NodeList list) {
+  reach_reserve(reach, list.count);
+  const NodeId* items = ast_list(ast, list);
+  for (u32 i = list.count; i != 0; --i) {
+    reach->stack[reach->depth] = items[i - 1];
+    reach->depth += 1;
+  }
+}
+
+// Reaches the called functions in the order the calls appear in the body
+static void find_calls(const Ast* ast, NodeId body, Reach* reach) {
+  push_call_search(reach, body);
+  while (reach->depth != 0) {
+    reach->depth -= 1;
+    Node* node = ast_get(ast, reach->stack[reach->depth]);
+    switch (node->kind) {
+      case ND_Operation:
+        push_call_search(reach, node->operation.rhs);
+        push_call_search(reach, node->operation.lhs);
+        break;
+      case ND_Negation:
+      case ND_Return:
+        push_call_search(reach, node->unary);
+        break;
+      case ND_Block:
+        push_call_list(ast, reach, node->block);
+        break;
+      case ND_Decl:
+        push_call_search(reach, node->declaration.value);
+        break;
+      case ND_Value: {
+        TypeKind kind = ast_get(ast, node->value.type)->type.kind;
+        if (kind == TP_Ptr || kind == TP_Arr) {
+          push_call_list(ast, reach, node->value.elements);
+        }
+        break;
+      }
+      case ND_If:
+        push_call_search(reach, node->if_node.elseb);
+        push_call_search(reach, node->if_node.then);
+        push_call_search(reach, node->if_node.cond);
+        break;
+      case ND_While:
+        push_call_search(reach, node->while_node.then);
+        push_call_search(reach, node->while_node.cond);
+        break;
+      case ND_Call:
+        reach_function(reach, node->call_node.name);
+        push_call_list(ast, reach, node->call_node.args);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// Private functions are only kept when a call reaches them from a public or
+// external one, their bodies are parsed as they are reached. The rest are
+// dropped from the tree without their bodies ever being parsed, the kept
+// ones move up to the front of its list in their order.
+static NodeList parse_reachable(
+  Arena* arena, Ast* ast, NodeList tree, StrView input
+) {
+  usize capacity = symbol_count() + 1;
+  Reach reach = {
+    .arena = arena,
+    .functions = arena_alloc(arena, sizeof(NodeId) * capacity),
+    .reached = arena_alloc(arena, sizeof(bool) * capacity),
+    .queue = arena_alloc(arena, sizeof(NodeId) * (tree.count + 1)),
+  };
+  memset(reach.functions, 0, sizeof(NodeId) * capacity);
+  memset(reach.reached, 0, sizeof(bool) * capacity);
+  SymbolTable symbols = symbol_table_make(arena, capacity);
+  ListStack lists = list_stack_make(arena);
+  TokenStream window = token_stream_make(arena, input, 256);
+  const NodeId* functions = ast_list(ast, tree);
+  for (u32 i = 0; i < tree.count; ++i) {
+    Node* node = ast_get(ast, functions[i]);
+    if (reach.functions[node->function.name] == 0) {
+      reach.functions[node->function.name] = functions[i];
+    }
+  }
+  for (u32 i = 0; i < tree.count; ++i) {
+    Node* node = ast_get(ast, functions[i]);
+    if (node->function.linkage != LN_Private) {
+      reach.reached[node->function.name] = true;
+      reach.queue[reach.queued] = functions[i];
+      reach.queued += 1;
     }
   }
-  hashmap_free(cx.scopes->buffer[cx.scopes->length - 1]);
-  free(cx.scopes);
-  return handle.next;
+  for (usize i = 0; i < reach.queued; ++i) {
+    NodeId func = reach.queue[i];
+    if (ast_get(ast, func)->function.pending != 0) {
+      parse_body(ast, func, input, &symbols, &lists, &window);
+    }
+    NodeId body = ast_get(ast, func)->function.body;
+    if (body != 0) {
+      find_calls(ast, body, &reach);
+    }
+  }
+
+  // Bodies parsed above may have moved the list buffer
+  NodeId* kept = ast_list(ast, tree);
+  u32 count = 0;
+  for (u32 i = 0; i < tree.count; ++i) {
+    NodeId func = kept[i];
+    Node* node = ast_get(ast, func);
+    if (node->function.linkage != LN_Private ||
+        (reach.reached[node->function.name] == true &&
+         reach.functions[node->function.name] == func)) {
+      kept[count] = func;
+      count += 1;
+    }
+  }
+  tree.count = count;
+  return tree;
 }
 
 // parse_type = "[" num "]" | "*" | "i"num | "f"num
-static Node* parse_type(Token** rest, Token* token, Context cx) {
-  if (token->kind == TK_Punct) {
-    if (consume(&token, token, PK_Mul)) {
-      return make_pointer_type(cx.arena, parse_type(rest, token, cx));
-
-    } else if (consume(&token, token, PK_LeftBracket)) {
-      Node* size = expr(&token, token, cx);
-      Token* expected = expect_info(cx.input, token, PK_RightBracket);
-      Node* type = parse_type(rest, expected, cx);
-      if (size->kind == ND_Value) {
-        return make_array_type(cx.arena, type, atoi(size->value.basic->array));
+static NodeId parse_type(TokenId* rest, TokenId token, Context cx) {
+  if (token_kind(cx.tokens, token) == TK_Punct) {
+    if (consume(&token, token, cx, PK_Mul)) {
+      return make_pointer_type(cx.ast, parse_type(rest, token, cx));
+
+    } else if (consume(&token, token, cx, PK_LeftBracket)) {
+      NodeId size = expr(&token, token, cx);
+      TokenId expected = expect_info(cx, token, PK_RightBracket);
+      NodeId type = parse_type(rest, expected, cx);
+      Node* value = ast_get(cx.ast, size);
+      if (value->kind == ND_Value &&
+          ast_get(cx.ast, value->value.type)->type.kind == TP_SInt &&
+          number_signed_width(value->value.number) <= 33) {
+        return make_array_type(cx.ast, type, value->value.number.words[0]);
       } else {
-        error_tok(cx.input, token, "Size value not found");
+        error_tok(cx.tokens, token, "Size value not found");
       }
     }
-  } else if (token->kind == TK_Ident) {
-    if (token->info == AD_SIntType) {
-      i32 width = atoi(token->pos + 1);
+  } else if (token_kind(cx.tokens, token) == TK_Ident) {
+    if (token_info(cx.tokens, token) == AD_SIntType) {
+      i32 width = atoi(token_pos(cx.tokens, token) + 1);
       if (width > 128) {
-        error_tok(cx.input, token, "Bit width too wide");
+        error_tok(cx.tokens, token, "Bit width too wide");
       }
-      Node* type = make_numeric_type(cx.arena, TP_SInt, width);
+      NodeId type = make_numeric_type(cx.ast, TP_SInt, width);
       *rest = token + 1;
       return type;
 
-    } else if (token->info == AD_UIntType) {
-      i32 width = atoi(token->pos + 1);
+    } else if (token_info(cx.tokens, token) == AD_UIntType) {
+      i32 width = atoi(token_pos(cx.tokens, token) + 1);
       if (width > 128) {
-        error_tok(cx.input, token, "Bit width too wide");
+        error_tok(cx.tokens, token, "Bit width too wide");
       }
-      Node* type = make_numeric_type(cx.arena, TP_UInt, width);
+      NodeId type = make_numeric_type(cx.ast, TP_UInt, width);
       *rest = token + 1;
       return type;
 
-    } else if (token->info == AD_BF16Type) {
-      Node* type = make_numeric_type(cx.arena, TP_Flt, 15);
+    } else if (token_info(cx.tokens, token) == AD_BF16Type) {
+      NodeId type = make_numeric_type(cx.ast, TP_Flt, 15);
       *rest = token + 1;
       return type;
 
-    } else if (token->info == AD_F16Type) {
-      Node* type = make_numeric_type(cx.arena, TP_Flt, 16);
+    } else if (token_info(cx.tokens, token) == AD_F16Type) {
+      NodeId type = make_numeric_type(cx.ast, TP_Flt, 16);
       *rest = token + 1;
       return type;
 
-    } else if (token->info == AD_F32Type) {
-      Node* type = make_numeric_type(cx.arena, TP_Flt, 32);
+    } else if (token_info(cx.tokens, token) == AD_F32Type) {
+      NodeId type = make_numeric_type(cx.ast, TP_Flt, 32);
       *rest = token + 1;
       return type;
 
-    } else if (token->info == AD_F64Type) {
-      Node* type = make_numeric_type(cx.arena, TP_Flt, 64);
+    } else if (token_info(cx.tokens, token) == AD_F64Type) {
+      NodeId type = make_numeric_type(cx.ast, TP_Flt, 64);
       *rest = token + 1;
       return type;
 
-    } else if (token->info == AD_F128Type) {
-      Node* type = make_numeric_type(cx.arena, TP_Flt, 128);
+    } else if (token_info(cx.tokens, token) == AD_F128Type) {
+      NodeId type = make_numeric_type(cx.ast, TP_Flt, 128);
       *rest = token + 1;
       return type;
     }
   }
-  error_tok(cx.input, token, "Invalid expression");
+  error_tok(cx.tokens, token, "Invalid expression");
 }
 
 // public_function = indent "(" args? ")" ":" ret_type
-static Node* public_function(Token** rest, Token* token, Context cx) {
-  StrView name = strview_from_token(token);
-  token = expect_ident(cx.input, token);
-  token = expect_info(cx.input, token, PK_LeftParen);
-  Scope_vector_push(&cx.scopes, hashmap_make(8));
+static NodeId public_function(TokenId* rest, TokenId token, Context cx) {
+  Symbol name = token_symbol(cx.tokens, token);
+  token = expect_ident(cx, token);
+  token = expect_info(cx, token, PK_LeftParen);
+  usize scope = scope_enter(cx.symbols);
 
-  Node* args = parse_list(&token, token, cx, PK_RightParen, argument);
-  Node* type = parse_type(&token, token + 1, cx);
-  Token* expected = expect_info(cx.input, token, PK_LeftBrace);
-  Node* body = compound_stmt(rest, expected, cx);
+  NodeList args = parse_list(&token, token, cx, PK_RightParen, argument);
+  NodeId type = parse_type(&token, token + 1, cx);
+  TokenId expected = expect_info(cx, token, PK_LeftBrace);
+  NodeId body = compound_stmt(rest, expected, cx);
 
-  hashmap_free(cx.scopes->buffer[cx.scopes->length - 1]);
-  Scope_vector_pop(cx.scopes);
-  return make_function(cx.arena, type, name, body, args, LN_Public);
+  scope_leave(cx.symbols, scope);
+  return make_function(cx.ast, type, name, body, args, LN_Public);
 }
 
 // extern_function = indent "(" args? ")" ":" ret_type
-static Node* extern_function(Token** rest, Token* token, Context cx) {
-  StrView name = strview_from_token(token);
-  token = expect_ident(cx.input, token);
-  token = expect_info(cx.input, token, PK_LeftParen);
+static NodeId extern_function(TokenId* rest, TokenId token, Context cx) {
+  Symbol name = token_symbol(cx.tokens, token);
+  token = expect_ident(cx, token);
+  token = expect_info(cx, token, PK_LeftParen);
+  usize scope = scope_enter(cx.symbols);
 
-  Node* args = parse_list(&token, token, cx, PK_RightParen, argument);
-  Node* type = parse_type(rest, token + 1, cx);
-  return make_function(cx.arena, type, name, nullptr, args, LN_Unspecified);
+  NodeList args = parse_list(&token, token, cx, PK_RightParen, argument);
+  NodeId type = parse_type(rest, token + 1, cx);
+
+  scope_leave(cx.symbols, scope);
+  return make_function(cx.ast, type, name, 0, args, LN_Unspecified);
+}
+
+// Skips a function body up to its closing brace, token is the first token
+// after the opening one
+static TokenId skip_body(Context cx, TokenId token) {
+  usize depth = 0;
+  for (; token_info(cx.tokens, token) != PK_RightBrace || depth != 0;
+       ++token) {
+    AddInfo info = token_info(cx.tokens, token);
+    if (token_kind(cx.tokens, token) == TK_Eof || resyncs(cx, token) == true) {
+      error_tok(cx.tokens, token, "Expected '}'");
+    } else if (info == PK_LeftBrace) {
+      depth += 1;
+    } else if (info == PK_RightBrace) {
+      depth -= 1;
+    }
+  }
+  return token + 1;
 }
 
 // function = indent "(" args? ")" ":" ret_type "{" body "}"
-static Node* function(Token** rest, Token* token, Context cx) {
-  StrView name = strview_from_token(token);
-  token = expect_ident(cx.input, token);
-  token = expect_info(cx.input, token, PK_LeftParen);
-  Scope_vector_push(&cx.scopes, hashmap_make(8));
+// A lazy parse only records where the body starts.
+static NodeId function(TokenId* rest, TokenId token, Context cx) {
+  Symbol name = token_symbol(cx.tokens, token);
+  token = expect_ident(cx, token);
+  token = expect_info(cx, token, PK_LeftParen);
+  usize scope = scope_enter(cx.symbols);
 
-  Node* args = parse_list(&token, token, cx, PK_RightParen, argument);
-  Node* type = parse_type(&token, token + 1, cx);
-  Token* expected = expect_info(cx.input, token, PK_LeftBrace);
-  Node* body = compound_stmt(rest, expected, cx);
+  NodeList args = parse_list(&token, token, cx, PK_RightParen, argument);
+  NodeId type = parse_type(&token, token + 1, cx);
+  TokenId expected = expect_info(cx, token, PK_LeftBrace);
+  if (cx.lazy == true) {
+    *rest = skip_body(cx, expected);
+    scope_leave(cx.symbols, scope);
+    NodeId node = make_function(cx.ast, type, name, 0, args, LN_Private);
+    rcstr brace = token_pos(cx.tokens, token);
+    ast_get(cx.ast, node)->function.pending =
+      (u32)(brace - token_stream_input(cx.tokens).pointer);
+    return node;
+  }
+  NodeId body = compound_stmt(rest, expected, cx);
 
-  hashmap_free(cx.scopes->buffer[cx.scopes->length - 1]);
-  Scope_vector_pop(cx.scopes);
-  return make_function(cx.arena, type, name, body, args, LN_Private);
+  scope_leave(cx.symbols, scope);
+  return make_function(cx.ast, type, name, body, args, LN_Private);
 }
 
 // argument = indent ":" type
-static Node* argument(Token** rest, Token* token, Context cx) {
-  StrView name = strview_from_token(token);
-  token = expect_ident(cx.input, token);
-  Node* type = parse_type(rest, token, cx);
-  return make_arg_var(cx, type, name);
+static NodeId argument(TokenId* rest, TokenId token, Context cx) {
+  Symbol name = token_symbol(cx.tokens, token);
+  rcstr location = token_pos(cx.tokens, token);
+  token = expect_ident(cx, token);
+  NodeId type = parse_type(rest, token, cx);
+  return make_arg_var(cx, type, name, location);
 }
 
 // declaration = indent ":" type "=" expr
-static Node* declaration(Token** rest, Token* token, Context cx) {
-  StrView name = strview_from_token(token);
-  token = expect_ident(cx.input, token);
-  Node* type = parse_type(&token, token, cx);
-  Token* x = expect_info(cx.input, token, PK_Assign);
-  Node* value = expr(rest, x, cx);
-  return make_declaration(cx, type, name, value);
+static NodeId declaration(TokenId* rest, TokenId token, Context cx) {
+  Symbol name = token_symbol(cx.tokens, token);
+  rcstr location = token_pos(cx.tokens, token);
+  token = expect_ident(cx, token);
+  NodeId type = parse_type(&token, token, cx);
+  TokenId x = expect_info(cx, token, PK_Assign);
+  NodeId value = expr(rest, x, cx);
+  return make_declaration(cx, type, name, value, location);
 }
 
 // stmt = "return" expr
@@ -284,242 +792,475 @@ static Node* declaration(Token** rest, Token* token, Context cx) {
 //      | "let" decl ":" type "=" expr
 //      | "{" compound-stmt
 //      | expr
-static Node* stmt(Token** rest, Token* token, Context cx) {
-  if (token->info == KW_Return) {
-    Node* node = make_unary(cx.arena, ND_Return, expr(&token, token + 1, cx));
-    *rest = expect_eol(cx.input, token - 1);
+static NodeId stmt(TokenId* rest, TokenId token, Context cx) {
+  rcstr location = token_pos(cx.tokens, token);
+  if (token_info(cx.tokens, token) == KW_Return) {
+    NodeId value = expr(&token, token + 1, cx);
+    NodeId node = make_unary(cx.ast, ND_Return, value, location);
+    *rest = expect_eol(cx, token - 1);
     return node;
 
-  } else if (token->info == KW_If) {
-    Node* cond = expr(&token, token + 1, cx);
-    Node* then = stmt(&token, token, cx);
-    Node* elseb = nullptr;
-    if (token->info == KW_Else) {
+  } else if (token_info(cx.tokens, token) == KW_If) {
+    NodeId cond = expr(&token, token + 1, cx);
+    NodeId then = stmt(&token, token, cx);
+    NodeId elseb = 0;
+    if (token_info(cx.tokens, token) == KW_Else) {
       elseb = stmt(&token, token + 1, cx);
     }
-    Node* node = make_if_node(cx.arena, cond, then, elseb);
+    NodeId node = make_if_node(cx.ast, cond, then, elseb, location);
     *rest = token;
     return node;
 
-  } else if (token->info == KW_While) {
-    Node* cond = expr(&token, token + 1, cx);
-    Node* then = stmt(rest, token, cx);
-    Node* node = make_while_node(cx.arena, cond, then);
+  } else if (token_info(cx.tokens, token) == KW_While) {
+    NodeId cond = expr(&token, token + 1, cx);
+    NodeId then = stmt(rest, token, cx);
+    NodeId node = make_while_node(cx.ast, cond, then, location);
     return node;
 
-  } else if (token->info == KW_Let) {
-    Node* decl = declaration(rest, token + 1, cx);
+  } else if (token_info(cx.tokens, token) == KW_Let) {
+    NodeId decl = declaration(rest, token + 1, cx);
     return decl;
 
-  } else if (token->info == PK_LeftBrace) {
+  } else if (token_info(cx.tokens, token) == PK_LeftBrace) {
     return compound_stmt(rest, token + 1, cx);
   }
   return expr(rest, token, cx);
 }
 
-// compound-stmt = stmt* "}"
-static Node* compound_stmt(Token** rest, Token* token, Context cx) {
-  Node handle = {};
-  Node* node_cursor = &handle;
-  while (token->info != PK_RightBrace) {
-    token = expect_eol(cx.input, token - 1);
-    node_cursor->next = stmt(&token, token, cx);
-    node_cursor = node_cursor->next;
-  }
-  Node* node = make_unary(cx.arena, ND_Block, handle.next);
-  *rest = token + 1;
-  return node;
+// Skips the rest of a statement that failed to parse: up to the first token
+// of the next line, or up to the "}" closing the enclosing block, or up to
+// an item starting a line
+static TokenId skip_stmt(Context cx, TokenId token) {
+  usize depth = 0;
+  for (; token_kind(cx.tokens, token) != TK_Eof && resyncs(cx, token) != true;
+       ++token) {
+    AddInfo info = token_info(cx.tokens, token);
+    if (info == PK_LeftBrace) {
+      depth += 1;
+    } else if (info == PK_RightBrace) {
+      if (depth == 0) {
+        break;
+      }
+      depth -= 1;
+    }
+    if (depth == 0 && token_is_eol(cx.tokens, token) == true) {
+      return token + 1;
+    }
+  }
+  return token;
 }
 
-// expr = assign
-static Node* expr(Token** rest, Token* token, Context cx) {
-  return assign(rest, token, cx);
+// block-stmt = stmt at the start of a line
+static NodeId block_stmt(TokenId* rest, TokenId token, Context cx) {
+  TokenId start = expect_eol(cx, token - 1);
+  return stmt(rest, start, cx);
 }
 
-// assign = equality ("=" assign)?
-static Node* assign(Token** rest, Token* token, Context cx) {
-  Node* node = equality(&token, token, cx);
-  if (token->info == PK_Assign) {
-    node = make_oper(cx.arena, OP_Asg, node, assign(&token, token + 1, cx));
+// Parses one statement of a block, an error inside it is collected and the
+// statement is left out along with the lists it left open
+static NodeId recover_stmt(TokenId* rest, TokenId token, Context cx) {
+  // volatile keeps gcc from reporting the token as clobbered by longjmp
+  const volatile TokenId start = token;
+  usize mark = scope_enter(cx.symbols);
+  usize items = cx.lists->length;
+  jmp_buf point;
+  jmp_buf* outer = diag_recover(&point);
+  if (setjmp(point) != 0) {
+    diag_recover(outer);
+    scope_leave(cx.symbols, mark);
+    cx.lists->length = items;
+    *rest = skip_stmt(cx, start);
+    return 0;
   }
-  *rest = token;
+  NodeId node = block_stmt(rest, token, cx);
+  diag_recover(outer);
   return node;
 }
 
-// equality = relational ("==" relational | "!=" relational)*
-static Node* equality(Token** rest, Token* token, Context cx) {
-  Node* node = relational(&token, token, cx);
-
-  while (true) {
-    if (token->info == PK_Eq) {
-      node =
-        make_oper(cx.arena, OP_Eq, node, relational(&token, token + 1, cx));
-    } else if (token->info == PK_NEq) {
-      node =
-        make_oper(cx.arena, OP_NEq, node, relational(&token, token + 1, cx));
-    } else {
-      *rest = token;
-      return node;
+// compound-stmt = stmt* "}"
+// Every block is a scope of its own, names declared in it end with it.
+static NodeId compound_stmt(TokenId* rest, TokenId token, Context cx) {
+  usize scope = scope_enter(cx.symbols);
+  usize mark = cx.lists->length;
+  while (token_info(cx.tokens, token) != PK_RightBrace) {
+    if (token_kind(cx.tokens, token) == TK_Eof || resyncs(cx, token) == true) {
+      error_tok(cx.tokens, token, "Expected '}'");
+    }
+    NodeId node = recover_stmt(&token, token, cx);
+    if (node != 0) {
+      list_push(cx.lists, node);
     }
   }
+  scope_leave(cx.symbols, scope);
+  NodeId node = make_block(cx.ast, list_close(cx.lists, cx.ast, mark));
+  *rest = token + 1;
+  return node;
 }
 
-// relational = add ("<" add | "<=" add | ">" add | ">=" add)*
-static Node* relational(Token** rest, Token* token, Context cx) {
-  Node* node = add(&token, token, cx);
+// Binary operators are parsed by precedence climbing over one table indexed
+// by the operator's AddInfo. An operator continues the current expression
+// while its left power is at least the minimum, its right side is parsed with
+// the right power: one above the left for left associative operators and
+// equal to it for assignment. Entries left at zero are not binary operators.
+typedef struct BindingPower BindingPower;
+struct BindingPower {
+  u8 left;
+  u8 right;
+  OperKind oper;
+};
 
-  while (true) {
-    if (token->info == PK_Lt) {
-      node = make_oper(cx.arena, OP_Lt, node, add(&token, token + 1, cx));
-    } else if (token->info == PK_Lte) {
-      node = make_oper(cx.arena, OP_Lte, node, add(&token, token + 1, cx));
-    } else if (token->info == PK_Gt) {
-      node = make_oper(cx.arena, OP_Gt, node, add(&token, token + 1, cx));
-    } else if (token->info == PK_Gte) {
-      node = make_oper(cx.arena, OP_Gte, node, add(&token, token + 1, cx));
+#define BP_LEFT(power, op) \
+  { .left = (power), .right = (power) + 1, .oper = (op) }
+#define BP_RIGHT(power, op) \
+  { .left = (power), .right = (power), .oper = (op) }
+
+static const BindingPower binding_power[KW_Return + 1] = {
+  [PK_Assign] = BP_RIGHT(1, OP_Asg),
+  [PK_Or] = BP_LEFT(2, OP_Or),
+  [PK_And] = BP_LEFT(3, OP_And),
+  [PK_Pipe] = BP_LEFT(4, OP_BitOr),
+  [PK_Xor] = BP_LEFT(5, OP_BitXor),
+  [PK_Ampersand] = BP_LEFT(6, OP_BitAnd),
+  [PK_Eq] = BP_LEFT(7, OP_Eq),
+  [PK_NEq] = BP_LEFT(7, OP_NEq),
+  [PK_Lt] = BP_LEFT(8, OP_Lt),
+  [PK_Lte] = BP_LEFT(8, OP_Lte),
+  [PK_Gt] = BP_LEFT(8, OP_Gt),
+  [PK_Gte] = BP_LEFT(8, OP_Gte),
+  [PK_LeftShift] = BP_LEFT(9, OP_Shl),
+  [PK_RightShift] = BP_LEFT(9, OP_Shr),
+  [PK_Add] = BP_LEFT(10, OP_Add),
+  [PK_Sub] = BP_LEFT(10, OP_Sub),
+  [PK_Mul] = BP_LEFT(11, OP_Mul),
+  [PK_Div] = BP_LEFT(11, OP_Div),
+  [PK_Percent] = BP_LEFT(11, OP_Mod),
+};
+
+#define BP_ASSIGN 1
+#define BP_LOGIC_OR 2
+// Above every binary operator, an expression parsed with it ends at its
+// first operand
+#define BP_UNARY UINT8_MAX
+
+// Expressions are parsed without recursing once per level of nesting. The
+// operators waiting for their right side and the parentheses, calls, indexes
+// and array literals waiting for their closing token are frames on a stack,
+// kept in place until an expression nests deeper than EXPR_FRAMES and moved
+// to the lex arena from then on.
+typedef enum ExprFrameKind ExprFrameKind;
+enum ExprFrameKind {
+  EF_Operator,
+  EF_Negation,
+  EF_Paren,
+  EF_Call,
+  EF_Index,
+  EF_Array,
+};
+
+// power is the minimum power of the enclosing expression, restored once the
+// frame closes. node is the left side of an operator or the indexed
+// variable. token is the operator, the minus, the called name or the opening
+// bracket, which the node made from the frame is located at. The arguments or
+// elements parsed so far are on the list stack above items.
+typedef struct ExprFrame ExprFrame;
+struct ExprFrame {
+  ExprFrameKind kind;
+  u8 power;
+  OperKind oper;
+  Symbol name;
+  TokenId token;
+  NodeId node;
+  usize items;
+};
+
+#define EXPR_FRAMES 32
+
+typedef struct ExprStack ExprStack;
+struct ExprStack {
+  ExprFrame* frames;
+  usize length;
+  usize capacity;
+  ExprFrame room[EXPR_FRAMES];
+};
+
+static void push_frame(Context cx, ExprStack* stack, ExprFrame frame) {
+  if (stack->length == stack->capacity) {
+    usize size = sizeof(ExprFrame) * stack->capacity;
+    if (stack->frames == stack->room) {
+      stack->frames = arena_alloc(cx.symbols->arena, size * 2);
+      memcpy(stack->frames, stack->room, size);
     } else {
-      *rest = token;
-      return node;
+      stack->frames =
+        arena_realloc(cx.symbols->arena, stack->frames, size, size * 2);
     }
+    stack->capacity *= 2;
   }
+  stack->frames[stack->length] = frame;
+  stack->length += 1;
 }
 
-// add = mul ("+" mul | "-" mul)*
-static Node* add(Token** rest, Token* token, Context cx) {
-  Node* node = mul(&token, token, cx);
+static ExprFrame* top_frame(ExprStack* stack) {
+  return stack->length != 0 ? &stack->frames[stack->length - 1] : nullptr;
+}
 
-  while (true) {
-    if (token->info == PK_Add) {
-      // node = make_add(node, mul(&token, token + 1), token);
-      node = make_oper(cx.arena, OP_Add, node, mul(&token, token + 1, cx));
-    } else if (token->info == PK_Sub) {
-      // node = make_sub(node, mul(&token, token + 1), token);
-      node = make_oper(cx.arena, OP_Sub, node, mul(&token, token + 1, cx));
+// Opens the frame of a nested expression parsed with the given power
+static void open_frame(
+  Context cx, ExprStack* stack, u8* power, ExprFrame frame, u8 inner
+) {
+  frame.power = *power;
+  push_frame(cx, stack, frame);
+  *power = inner;
+}
+
+// Closes a call or an array literal once its last operand is parsed
+static NodeId close_list(
+  TokenId* rest, TokenId token, Context cx, const ExprFrame* frame
+) {
+  if (frame->kind == EF_Call) {
+    NodeList args = list_close(cx.lists, cx.ast, frame->items);
+    rcstr location = token_pos(cx.tokens, frame->token);
+    NodeId call = make_call_node(cx.ast, frame->name, args, location);
+    *rest = expect_info(cx, token, PK_RightParen);
+    return call;
+  }
+  const NodeId* elements = cx.lists->items + frame->items;
+  usize count = cx.lists->length - frame->items;
+  NodeId first_type = ast_get(cx.ast, elements[0])->value.type;
+  TypeKind first_kind = ast_get(cx.ast, first_type)->type.kind;
+  u32 size = 0;
+  for (usize i = 0; i < count; ++i) {
+    Node* value = ast_get(cx.ast, elements[i]);
+    if (ast_get(cx.ast, value->value.type)->type.kind != first_kind) {
+      error_tok(
+        cx.tokens, frame->token, "Non uniform type found in initializer"
+      );
     } else {
-      *rest = token;
-      return node;
+      size += 1;
     }
   }
+  NodeId type = make_array_type(cx.ast, first_type, size);
+  *rest = expect_info(cx, token, PK_RightBracket);
+  NodeList list = list_close(cx.lists, cx.ast, frame->items);
+  return make_pointer_value(cx.ast, type, list);
 }
 
-// mul = unary ("*" unary | "/" unary)*
-static Node* mul(Token** rest, Token* token, Context cx) {
-  Node* node = unary(&token, token, cx);
+// binary  = unary (binary-op binary)*
+// unary   = ("+" | "-") unary | "(" expr ")" | call | index | array | primary
+// call    = ident "(" (operand ("," operand)* ","?)? ")"
+// index   = ident "[" expr "]"
+// array   = "[" unary ("," unary)* ","? "]"
+static NodeId binary(TokenId* rest, TokenId token, Context cx, u8 power) {
+  ExprStack stack = {
+    .capacity = EXPR_FRAMES,
+  };
+  stack.frames = stack.room;
+  NodeId node = 0;
 
   while (true) {
-    if (token->info == PK_Mul) {
-      node = make_oper(cx.arena, OP_Mul, node, unary(&token, token + 1, cx));
-    } else if (token->info == PK_Div) {
-      node = make_oper(cx.arena, OP_Div, node, unary(&token, token + 1, cx));
-    } else {
-      *rest = token;
-      return node;
+    // Prefixes and openings up to the operand they apply to
+    AddInfo info = token_info(cx.tokens, token);
+    AddInfo next = token_info(cx.tokens, token + 1);
+    if (info == PK_Add) {
+      token += 1;
+      continue;
+    } else if (info == PK_Sub) {
+      ExprFrame frame = {
+        .kind = EF_Negation,
+        .token = token,
+      };
+      push_frame(cx, &stack, frame);
+      token += 1;
+      continue;
+    }
+    if (token_kind(cx.tokens, token) == TK_Punct) {
+      if (info == PK_LeftParen) {
+        ExprFrame frame = { .kind = EF_Paren };
+        open_frame(cx, &stack, &power, frame, BP_ASSIGN);
+        token += 1;
+        continue;
+      } else if (info == PK_LeftBracket && next != PK_RightBracket) {
+        ExprFrame frame = {
+          .kind = EF_Array,
+          .token = token,
+          .items = cx.lists->length,
+        };
+        open_frame(cx, &stack, &power, frame, BP_UNARY);
+        token += 1;
+        continue;
+      }
+    } else if (token_kind(cx.tokens, token) == TK_Ident) {
+      if (next == PK_LeftParen) {
+        Symbol name = token_symbol(cx.tokens, token);
+        token += 2;
+        if (token_info(cx.tokens, token) != PK_RightParen) {
+          ExprFrame frame = {
+            .kind = EF_Call,
+            .name = name,
+            .token = token - 2,
+            .items = cx.lists->length,
+          };
+          open_frame(cx, &stack, &power, frame, BP_LOGIC_OR);
+          continue;
+        }
+        rcstr location = token_pos(cx.tokens, token - 2);
+        node = make_call_node(cx.ast, name, (NodeList){}, location);
+        token += 1;
+      } else if (next == PK_LeftBracket) {
+        NodeId var = find_variable(token, cx);
+        if (var == 0) {
+          error_tok(cx.tokens, token, "Variable not found in scope");
+        }
+        ExprFrame frame = {
+          .kind = EF_Index,
+          .token = token + 1,
+          .node = var,
+        };
+        open_frame(cx, &stack, &power, frame, BP_ASSIGN);
+        token += 2;
+        continue;
+      }
+    }
+    if (node == 0) {
+      node = primary(&token, token, cx);
+    }
+
+    // Operators and closings following a complete operand
+    while (node != 0) {
+      ExprFrame* top = top_frame(&stack);
+      if (top != nullptr && top->kind == EF_Negation) {
+        rcstr location = token_pos(cx.tokens, top->token);
+        node = make_unary(cx.ast, ND_Negation, node, location);
+        stack.length -= 1;
+        continue;
+      }
+      BindingPower binding = binding_power[token_info(cx.tokens, token)];
+      if (binding.left != 0 && binding.left >= power) {
+        ExprFrame frame = {
+          .kind = EF_Operator,
+          .oper = binding.oper,
+          .token = token,
+          .node = node,
+        };
+        open_frame(cx, &stack, &power, frame, binding.right);
+        token += 1;
+        node = 0;
+        break;
+      }
+      if (top == nullptr) {
+        *rest = token;
+        return node;
+      }
+
+      if (top->kind == EF_Call || top->kind == EF_Array) {
+        AddInfo closing =
+          top->kind == EF_Call ? PK_RightParen : PK_RightBracket;
+        list_push(cx.lists, node);
+        node = 0;
+        if (token_info(cx.tokens, token) != closing) {
+          token = expect_info(cx, token, PK_Comma);
+        }
+        if (token_info(cx.tokens, token) != closing) {
+          break;
+        }
+        node = close_list(&token, token, cx, top);
+      } else if (top->kind == EF_Operator) {
+        rcstr location = token_pos(cx.tokens, top->token);
+        node = make_oper(cx.ast, top->oper, top->node, node, location);
+      } else if (top->kind == EF_Index) {
+        rcstr location = token_pos(cx.tokens, top->token);
+        node = make_oper(cx.ast, OP_ArrIdx, top->node, node, location);
+        token = expect_info(cx, token, PK_RightBracket);
+      } else {
+        token = expect_info(cx, token, PK_RightParen);
+      }
+      power = top->power;
+      stack.length -= 1;
     }
   }
 }
 
-// unary = ("+" | "-") unary
-//       | primary
-static Node* unary(Token** rest, Token* token, Context cx) {
-  if (token->info == PK_Add) {
-    return unary(rest, token + 1, cx);
-  } else if (token->info == PK_Sub) {
-    return make_unary(cx.arena, ND_Negation, unary(rest, token + 1, cx));
-  }
-  return primary(rest, token, cx);
+// expr = binary
+static NodeId expr(TokenId* rest, TokenId token, Context cx) {
+  return binary(rest, token, cx, BP_ASSIGN);
 }
 
-// funcall = ident "(" (equality ("," equality).*)? ")"
-static Node* fn_call(Token** rest, Token* token, Context cx) {
-  StrView name = strview_from_token(token);
-  token = expect_ident(cx.input, token);
-  token = expect_info(cx.input, token, PK_LeftParen);
+// Integer literals take the narrowest of i32, i64 and i128 that holds them,
+// only values past the range of i128 are u128
+static NodeId int_literal(TokenId token, Context cx) {
+  Number number;
+  rcstr location = nullptr;
+  rcstr message =
+    number_parse_int(token_view(cx.tokens, token), &number, &location);
+  if (message != nullptr) {
+    error_at(token_stream_input(cx.tokens), location, "%s", message);
+  }
+  u32 width = number_signed_width(number);
+  NodeId type = width <= 32    ? make_numeric_type(cx.ast, TP_SInt, 32)
+                : width <= 64  ? make_numeric_type(cx.ast, TP_SInt, 64)
+                : width <= 128 ? make_numeric_type(cx.ast, TP_SInt, 128)
+                               : make_numeric_type(cx.ast, TP_UInt, 128);
+  return make_numeric_value(cx.ast, type, number);
+}
 
-  Node* args = parse_list(&token, token, cx, PK_RightParen, equality);
-  Node* call = make_call_node(cx.arena, name, args);
-  *rest = expect_info(cx.input, token, PK_RightParen);
-  return call;
+static NodeId flt_literal(TokenId token, Context cx) {
+  Number number;
+  rcstr location = nullptr;
+  rcstr message =
+    number_parse_flt(token_view(cx.tokens, token), &number, &location);
+  if (message != nullptr) {
+    error_at(token_stream_input(cx.tokens), location, "%s", message);
+  }
+  NodeId type = make_numeric_type(cx.ast, TP_Flt, 64);
+  return make_numeric_value(cx.ast, type, number);
 }
 
-// primary = "(" expr ")"
-//         | ident ( func-args? )
+// primary = "{" compound-stmt
+//         | "[" "]"
 //         | ident*
 //         | ident&
+//         | ident
 //         | num | flt | rstr
-static Node* primary(Token** rest, Token* token, Context cx) {
-  if (token->kind == TK_Punct) {
-    if (token->info == PK_LeftParen) {
-      Node* node = expr(&token, token + 1, cx);
-      *rest = expect_info(cx.input, token, PK_RightParen);
-      return node;
-
-    } else if (token->info == PK_LeftBrace) {
+static NodeId primary(TokenId* rest, TokenId token, Context cx) {
+  if (token_kind(cx.tokens, token) == TK_Punct) {
+    if (token_info(cx.tokens, token) == PK_LeftBrace) {
       return stmt(rest, token, cx);
 
-    } else if (token->info == PK_LeftBracket) {
-      if (token[1].info == PK_RightBracket) {
-        Node* type =
-          make_array_type(cx.arena, make_basic_type(cx.arena, TP_Undf), 0);
-        Node* node = make_pointer_value(cx.arena, type, nullptr);
-        *rest = token + 2;
-        return node;
-      }
-      Node* list = parse_list(rest, token, cx, PK_RightBracket, unary);
-      TypeKind first_type = list->value.type->type.kind;
-      usize size = 0;
-      for (Node* value = list; value != nullptr; value = value->next) {
-        if (value->value.type->type.kind != first_type) {
-          error_tok(cx.input, token, "Non uniform type found in initializer");
-        } else {
-          size += 1;
-        }
-      }
-      Node* type = make_array_type(cx.arena, list->value.type, size);
-      Node* node = make_pointer_value(cx.arena, type, list);
+    } else if (token_info(cx.tokens, token) == PK_LeftBracket) {
+      NodeId type =
+        make_array_type(cx.ast, make_basic_type(cx.ast, TP_Undf), 0);
+      NodeId node = make_pointer_value(cx.ast, type, (NodeList){});
+      *rest = token + 2;
       return node;
     }
 
-  } else if (token->kind == TK_Ident) {
-    if (token[1].info == PK_LeftParen) {
-      return fn_call(rest, token, cx);
-    }
-
-    Node* var = find_variable(token, cx);
-    if (var == nullptr) {
-      error_tok(cx.input, token, "Variable not found in scope");
+  } else if (token_kind(cx.tokens, token) == TK_Ident) {
+    NodeId var = find_variable(token, cx);
+    if (var == 0) {
+      error_tok(cx.tokens, token, "Variable not found in scope");
 
-    } else if (token[1].info == PK_AddrOf) {
+    } else if (token_info(cx.tokens, token + 1) == PK_AddrOf) {
       *rest = token + 2;
-      return make_unary(cx.arena, ND_Addr, var);
+      return make_unary(cx.ast, ND_Addr, var, token_pos(cx.tokens, token));
 
-    } else if (token[1].info == PK_Deref) {
+    } else if (token_info(cx.tokens, token + 1) == PK_Deref) {
       *rest = token + 2;
-      return make_unary(cx.arena, ND_Deref, var);
-
-    } else if (token[1].info == PK_LeftBracket) {
-      Node* index = expr(&token, token + 2, cx);
-      *rest = token + 1;
-      return make_oper(cx.arena, OP_ArrIdx, var, index);
+      return make_unary(cx.ast, ND_Deref, var, token_pos(cx.tokens, token));
     }
     *rest = token + 1;
     return var;
 
-  } else if (token->kind == TK_IntLiteral) {
-    Node* type = make_numeric_type(cx.arena, TP_SInt, 32);
-    Node* node = make_basic_value(cx.arena, type, strview_from_token(token));
+  } else if (token_kind(cx.tokens, token) == TK_IntLiteral) {
     *rest = token + 1;
-    return node;
+    return int_literal(token, cx);
 
-  } else if (token->kind == TK_FltLiteral) {
-    Node* type = make_numeric_type(cx.arena, TP_Flt, 64);
-    Node* node = make_basic_value(cx.arena, type, strview_from_token(token));
+  } else if (token_kind(cx.tokens, token) == TK_FltLiteral) {
     *rest = token + 1;
-    return node;
+    return flt_literal(token, cx);
 
-  } else if (token->kind == TK_StrLiteral) {
-    Node* node = make_str_value(cx.arena, strview_from_token(token));
+  } else if (token_kind(cx.tokens, token) == TK_StrLiteral) {
+    NodeId node = make_str_value(cx.ast, token_view(cx.tokens, token));
     *rest = token + 1;
     return node;
   }
-  error_tok(cx.input, token, "Expected an expression");
+  error_tok(cx.tokens, token, "Expected an expression");
 }
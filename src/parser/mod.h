@@ -1,11 +1,11 @@
 #pragma once
-#include <arena/mod.h>
-#include <hashmap/mod.h>
 #include <parser/lexer.h>
 #include <utility/mod.h>
 
+typedef struct NodeList NodeList;
 typedef struct OperNode OperNode;
 typedef struct TypeNode TypeNode;
+typedef struct Number Number;
 typedef struct ValueNode ValueNode;
 typedef struct DeclNode DeclNode;
 typedef struct FnNode FnNode;
@@ -13,19 +13,35 @@ typedef struct IfNode IfNode;
 typedef struct WhileNode WhileNode;
 typedef struct CallNode CallNode;
 typedef struct Node Node;
+typedef struct Ast Ast;
+typedef struct Binding Binding;
+typedef struct SymbolTable SymbolTable;
+typedef struct ListStack ListStack;
 typedef struct Context Context;
 typedef struct ParserOptions ParserOptions;
 typedef struct ParserOutput ParserOutput;
 
-typedef HashMap* Scope;
-DEFINE_VECTOR(Scope)
-
+typedef struct StrSpan StrSpan;
 typedef struct StrNode StrNode;
 struct StrNode {
   usize capacity;
   char array[];
 };
 
+// Nodes refer to each other by their 32-bit word offset into the Ast node
+// buffer and to their spellings by byte offset into its string buffer.
+// Offset 0 is never handed out, it stands for a missing node.
+typedef u32 NodeId;
+typedef u32 StrId;
+
+// The children of a block, a call, a function or an array value and the
+// functions of a tree are stored one after another in the list buffer of the
+// tree. A list refers to them by the offset of the first and their count.
+struct NodeList {
+  u32 offset;
+  u32 count;
+};
+
 #define strview_from_strnode(arr)                       \
   (StrView) {                                           \
     .pointer = (arr)->array, .length = (arr)->capacity, \
@@ -39,6 +55,14 @@ typedef enum {
   // OP_PtrPtrSub,
   OP_Mul,
   OP_Div,
+  OP_Mod,
+  OP_Shl,
+  OP_Shr,
+  OP_BitAnd,
+  OP_BitOr,
+  OP_BitXor,
+  OP_And,
+  OP_Or,
   OP_Eq,
   OP_NEq,
   OP_Lt,
@@ -49,10 +73,16 @@ typedef enum {
   OP_ArrIdx,
 } OperKind;
 
+// Expressions also hold their type, filled in by semantic analysis.
+// Operations, calls, declarations and statements keep the byte offset of
+// their first token, or of the operator, into the source of their tree in
+// location, which errors found after parsing point at.
 struct OperNode {
   OperKind kind;
-  Node* lhs;
-  Node* rhs;
+  NodeId lhs;
+  NodeId rhs;
+  NodeId type;
+  u32 location;
 };
 
 typedef enum {
@@ -66,31 +96,49 @@ typedef enum {
   TP_Arr,
 } TypeKind;
 
+// A copy of a type appended from another tree is left in place unreferenced
+// and keeps the node it resolves to in canonical
 struct TypeNode {
   TypeKind kind;
   union {
-    usize bit_width;
-    Node* base;
+    u32 bit_width;
+    NodeId base;
     struct {
-      Node* base;
-      usize size;
+      NodeId base;
+      u32 size;
     } array;
   };
+  NodeId canonical;
+};
+
+// Numeric literals are held in binary: integers as 128-bit two's complement
+// and floats as the bits of an f64, both in little-endian 32-bit words
+struct Number {
+  u32 words[4];
+};
+
+// A string literal without escapes is a span of the source of its tree, one
+// with escapes is decoded once into the string buffer of the tree
+struct StrSpan {
+  u32 offset;
+  u32 length;
+  bool decoded;
 };
 
 struct ValueNode {
-  Node* type;
+  NodeId type;
   union {
-    Node* base;
-    usize number;
-    StrNode* basic;
+    NodeList elements;
+    Number number;
+    StrSpan string;
   };
 };
 
 struct DeclNode {
-  Node* type;
-  Node* value;
-  StrNode* name;
+  NodeId type;
+  NodeId value;
+  Symbol name;
+  u32 location;
 };
 
 typedef enum Linkage {
@@ -99,31 +147,38 @@ typedef enum Linkage {
   LN_Unspecified,
 } Linkage;
 
+// A private function parsed lazily has no body yet, pending holds the byte
+// offset of its opening brace in the input until the body is parsed
 struct FnNode {
-  Node* ret_type;
-  Node* args;
-  Node* body;
-  StrNode* name;
+  NodeId ret_type;
+  NodeList args;
+  NodeId body;
+  Symbol name;
   Linkage linkage;
+  u32 pending;
 };
 
 struct IfNode {
-  Node* cond;
-  Node* then;
-  Node* elseb;
+  NodeId cond;
+  NodeId then;
+  NodeId elseb;
+  u32 location;
 };
 
 struct WhileNode {
-  Node* cond;
-  Node* then;
+  NodeId cond;
+  NodeId then;
+  u32 location;
 };
 
 struct CallNode {
-  Node* args;
-  StrNode* name;
+  NodeList args;
+  Symbol name;
+  NodeId type;
+  u32 location;
 };
 
-typedef enum {
+typedef enum NodeKind : u16 {
   ND_None,
   ND_Operation,
   ND_Negation,
@@ -142,12 +197,28 @@ typedef enum {
   ND_Call,
 } NodeKind;
 
+// Whether an expression stands for a place in memory, which is read with a
+// load when its value is needed, or for a value
+typedef enum ValueCategory : u16 {
+  VC_RValue,
+  VC_LValue,
+} ValueCategory;
+
+// A node is only allocated up to the end of the union member its kind uses,
+// so nodes are filled in member by member and never copied whole.
+// Variables only hold their declaration in unary, returns their location
+// after it. Negations, addresses and dereferences keep their type last.
 struct Node {
   NodeKind kind;
-  Node* next;
+  ValueCategory category;
   union {
     OperNode operation;
-    Node* unary;
+    struct {
+      NodeId unary;
+      u32 location;
+      NodeId unary_type;
+    };
+    NodeList block;
     TypeNode type;
     ValueNode value;
     DeclNode declaration;
@@ -158,20 +229,164 @@ struct Node {
   };
 };
 
-struct Context {
+// The tree holds no pointers, the node array, the list buffer and the string
+// buffer can be moved or written out as they are. Type nodes are hash-consed
+// through the types table, so equal types share one node and compare by id.
+// The buffers live in the tree's own arena, which lasts until codegen is done
+// with it. A tree loaded from the cache points into the mapped file instead.
+// Literals are read from the source the tree was parsed from, which outlives
+// it, and node locations are byte offsets into it.
+struct Ast {
+  u32 length;
+  u32 capacity;
+  u32 lists_length;
+  u32 lists_capacity;
+  u32 strings_length;
+  u32 strings_capacity;
+  u32 types_length;
+  u32 types_capacity;
+  u32* words;
+  NodeId* lists;
+  u8* strings;
+  NodeId* types;
+  void* mapping;
+  usize mapping_size;
+  rcstr source;
+  Arena arena;
+};
+
+static inline Node* ast_get(const Ast* ast, NodeId id) {
+  return id != 0 ? (Node*)(ast->words + id) : nullptr;
+}
+
+// The ids of the list, only valid until the tree next grows
+static inline NodeId* ast_list(const Ast* ast, NodeList list) {
+  return ast->lists + list.offset;
+}
+
+static inline StrView ast_string(const Ast* ast, StrSpan span) {
+  rcstr base = span.decoded == true ? (rcstr)ast->strings : ast->source;
+  return (StrView){
+    .pointer = base + span.offset,
+    .length = span.length,
+  };
+}
+
+// The byte offset into the source of the tree of the node at id. Variables
+// are shared by every use of their name and literals are too small to keep a
+// location, the other expressions and statements keep one.
+static inline bool node_location(const Ast* ast, NodeId id, u32* location) {
+  const Node* node = ast_get(ast, id);
+  switch (node->kind) {
+    case ND_Operation:
+      *location = node->operation.location;
+      return true;
+    case ND_Negation:
+    case ND_Return:
+    case ND_Addr:
+    case ND_Deref:
+      *location = node->location;
+      return true;
+    case ND_Decl:
+      *location = node->declaration.location;
+      return true;
+    case ND_If:
+      *location = node->if_node.location;
+      return true;
+    case ND_While:
+      *location = node->while_node.location;
+      return true;
+    case ND_Call:
+      *location = node->call_node.location;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Names in scope map straight from their symbol to the one variable node
+// referring to their declaration, every use of the name shares it.
+// Binding a name logs the node it shadows, leaving a scope undoes the log
+// back to the length it had on entry. Both grow inside the arena the table
+// was made in.
+struct Binding {
+  Symbol symbol;
+  NodeId shadowed;
+};
+
+struct SymbolTable {
   Arena* arena;
-  ScopeVector* scopes;
-  StrView input;
+  usize capacity;
+  NodeId* bindings;
+  usize log_length;
+  usize log_capacity;
+  Binding* log;
+};
+
+static inline NodeId scope_find(const SymbolTable* table, Symbol symbol) {
+  return symbol < table->capacity ? table->bindings[symbol] : 0;
+}
+
+// Children of the lists being parsed, those of a list are above the length
+// the stack had when the list was opened. Lists nest, every one closes
+// before the lists opened ahead of it and takes its children off the top.
+struct ListStack {
+  Arena* arena;
+  NodeId* items;
+  usize length;
+  usize capacity;
+};
+
+struct Context {
+  Ast* ast;
+  SymbolTable* symbols;
+  ListStack* lists;
+  const TokenStream* tokens;
+  bool lazy;
 };
 
 struct ParserOptions {
   StrView input;
+  StrView cache_dir;
+  usize threads;
+  usize error_limit;
   bool verbose;
+  bool eager;
 };
 
+// Tokens and the scratch of parsing live in a lex arena released before
+// parse_string returns, only its high-water mark is kept
 struct ParserOutput {
-  Node* tree;
-  Arena arena;
+  NodeList tree;
+  Ast ast;
+  usize lex_peak;
 };
 
+// A top-level item starts at "pub", "ext" or a "fn" not preceded by either,
+// when outside of braces
+static inline bool starts_item(AddInfo info, AddInfo prev) {
+  return info == KW_Pub || info == KW_Ext ||
+         (info == KW_Fn && prev != KW_Pub && prev != KW_Ext);
+}
+
+// Functions do not nest, so an item starting a line also closes the braces
+// left open before it. A function missing its closing brace ends there, the
+// way a statement that failed to parse ends with its line, instead of taking
+// in the rest of the source. line is whether the token before ends a line,
+// depth the braces open since the item being split started.
+static inline bool splits_item(
+  AddInfo info, AddInfo prev, bool line, usize depth
+) {
+  return starts_item(info, prev) == true && (depth == 0 || line == true);
+}
+
 extern ParserOutput parse_string(ParserOptions options);
+// Parses the items starting in [begin, end) of an already lexed stream
+// eagerly, errors are collected. Names bound by the items are unbound again,
+// so one table serves any number of calls, the scratch of parsing is taken
+// from arena.
+extern NodeList parse_tokens(
+  Arena* arena, SymbolTable* symbols, const TokenStream* tokens,
+  TokenId begin, TokenId end, Ast* ast
+);
+extern void ast_free(Ast* ast);
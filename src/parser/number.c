@@ -0,0 +1,398 @@
+#include <math.h>
+#include <parser/number.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility/mod.h>
+
+#define NUMBER_WORDS sizeof_arr(((Number){}).words)
+
+static u32 digit_value(char ref) {
+  if (ref >= '0' && ref <= '9') {
+    return (u32)(ref - '0');
+  } else if (ref >= 'a' && ref <= 'z') {
+    return (u32)(ref - 'a' + 10);
+  } else if (ref >= 'A' && ref <= 'Z') {
+    return (u32)(ref - 'A' + 10);
+  }
+  return UINT32_MAX;
+}
+
+// number = number * base + digit, returns false when the result overflows
+static bool number_mul_add(Number* number, u32 base, u32 digit) {
+  u64 carry = digit;
+  for (usize i = 0; i < NUMBER_WORDS; ++i) {
+    u64 word = (u64)number->words[i] * base + carry;
+    number->words[i] = (u32)word;
+    carry = word >> 32;
+  }
+  return carry == 0;
+}
+
+// number = number / base, returns the remainder
+static u32 number_div(Number* number, u32 base) {
+  u64 remainder = 0;
+  for (usize i = NUMBER_WORDS; i != 0; --i) {
+    u64 word = remainder << 32 | number->words[i - 1];
+    number->words[i - 1] = (u32)(word / base);
+    remainder = word % base;
+  }
+  return (u32)remainder;
+}
+
+static bool number_is_zero(Number number) {
+  for (usize i = 0; i < NUMBER_WORDS; ++i) {
+    if (number.words[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static Number number_negate(Number number) {
+  u64 carry = 1;
+  for (usize i = 0; i < NUMBER_WORDS; ++i) {
+    u64 word = (u64)(u32)~number.words[i] + carry;
+    number.words[i] = (u32)word;
+    carry = word >> 32;
+  }
+  return number;
+}
+
+const char* number_parse_int(StrView text, Number* number, rcstr* location) {
+  rcstr iter = text.pointer;
+  rcstr end = text.pointer + text.length;
+  u32 base = 10;
+  if (text.length >= 2 && iter[0] == '0') {
+    char prefix = iter[1] | 0x20;
+    base = prefix == 'x' ? 16 : prefix == 'o' ? 8 : prefix == 'b' ? 2 : 10;
+    iter += base != 10 ? 2 : 0;
+  }
+  *number = (Number){};
+  bool digits = false;
+  // Up to 19 decimal digits fit in one 64-bit word, most literals end there
+  u64 low = 0;
+  usize count = 0;
+  for (; iter != end && count < 19 && base == 10; ++iter) {
+    if (*iter == '_') {
+      continue;
+    } else if (*iter < '0' || *iter > '9') {
+      break;
+    }
+    low = low * 10 + (u64)(*iter - '0');
+    count += 1;
+  }
+  number->words[0] = (u32)low;
+  number->words[1] = (u32)(low >> 32);
+  digits = count != 0;
+  for (; iter != end; ++iter) {
+    if (*iter == '_') {
+      continue;
+    }
+    u32 digit = digit_value(*iter);
+    if (digit >= base) {
+      *location = iter;
+      return "Invalid digit in integer literal";
+    }
+    if (number_mul_add(number, base, digit) != true) {
+      *location = text.pointer;
+      return "Integer literal does not fit in 128 bits";
+    }
+    digits = true;
+  }
+  if (digits != true) {
+    *location = text.pointer;
+    return "Integer literal has no digits";
+  }
+  return nullptr;
+}
+
+// Integers below 2^53 and powers of ten up to 10^22 are exact doubles, so
+// one division of them is rounded correctly. Returns false for spellings
+// outside of that.
+static bool flt_exact(StrView text, f64* value) {
+  static const f64 powers[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  u64 mantissa = 0;
+  usize digits = 0;
+  usize fraction = 0;
+  bool dot = false;
+  for (usize i = 0; i < text.length; ++i) {
+    char ref = text.pointer[i];
+    if (ref == '_') {
+      continue;
+    } else if (ref == '.' && dot == false) {
+      dot = true;
+      continue;
+    } else if (ref < '0' || ref > '9' || digits == 15) {
+      return false;
+    }
+    mantissa = mantissa * 10 + (u64)(ref - '0');
+    digits += mantissa != 0;
+    fraction += dot == true;
+  }
+  if (fraction >= sizeof_arr(powers)) {
+    return false;
+  }
+  *value = (f64)mantissa / powers[fraction];
+  return true;
+}
+
+const char* number_parse_flt(StrView text, Number* number, rcstr* location) {
+  f64 exact = 0;
+  if (flt_exact(text, &exact) == true) {
+    *number = (Number){};
+    memcpy(number->words, &exact, sizeof(exact));
+    return nullptr;
+  }
+  // strtod needs a terminated spelling without separators
+  char small[64];
+  char* spelling = small;
+  if (text.length >= sizeof(small)) {
+    spelling = malloc(text.length + 1);
+    if (spelling == nullptr) {
+      perror("malloc");
+      exit(1);
+    }
+  }
+  usize length = 0;
+  for (usize i = 0; i < text.length; ++i) {
+    if (text.pointer[i] != '_') {
+      spelling[length] = text.pointer[i];
+      length += 1;
+    }
+  }
+  spelling[length] = 0;
+  char* stop = nullptr;
+  f64 value = strtod(spelling, &stop);
+  bool whole = stop == spelling + length;
+  if (spelling != small) {
+    free(spelling);
+  }
+  *location = text.pointer;
+  if (whole != true) {
+    return "Invalid float literal";
+  } else if (isinf(value) != 0) {
+    return "Float literal does not fit in 64 bits";
+  }
+  *number = (Number){};
+  memcpy(number->words, &value, sizeof(value));
+  return nullptr;
+}
+
+u32 number_signed_width(Number number) {
+  for (usize i = NUMBER_WORDS; i != 0; --i) {
+    u32 word = number.words[i - 1];
+    if (word != 0) {
+      return (u32)(i - 1) * 32 + (32 - (u32)__builtin_clz(word)) + 1;
+    }
+  }
+  return 1;
+}
+
+f64 number_flt(Number number) {
+  f64 value;
+  memcpy(&value, number.words, sizeof(value));
+  return value;
+}
+
+usize number_format(Number number, TypeKind kind, char* buffer) {
+  if (kind == TP_Flt) {
+    // The shortest spelling that reads back as the same value
+    f64 value = number_flt(number);
+    i32 length = 0;
+    for (i32 precision = 1; precision <= 17; ++precision) {
+      length = snprintf(buffer, NUMBER_FORMAT_SIZE, "%.*g", precision, value);
+      if (strtod(buffer, nullptr) == value) {
+        break;
+      }
+    }
+    return (usize)length;
+  }
+  bool negative =
+    kind == TP_SInt && (number.words[NUMBER_WORDS - 1] & 0x80000000) != 0;
+  if (negative == true) {
+    number = number_negate(number);
+  }
+  char digits[NUMBER_FORMAT_SIZE];
+  usize count = 0;
+  do {
+    digits[count] = (char)('0' + number_div(&number, 10));
+    count += 1;
+  } while (number_is_zero(number) != true);
+  usize length = 0;
+  if (negative == true) {
+    buffer[length] = '-';
+    length += 1;
+  }
+  while (count != 0) {
+    count -= 1;
+    buffer[length] = digits[count];
+    length += 1;
+  }
+  buffer[length] = 0;
+  return length;
+}
+
+// Constant arithmetic works on the whole 128 bits and fits the result back
+// to the width of its type, sign extended for signed types
+typedef unsigned __int128 Wide;
+typedef __int128 SignedWide;
+
+static Wide number_wide(Number number) {
+  Wide wide = 0;
+  for (usize i = NUMBER_WORDS; i != 0; --i) {
+    wide = wide << 32 | number.words[i - 1];
+  }
+  return wide;
+}
+
+static Number number_narrow(Wide wide) {
+  Number number = {};
+  for (usize i = 0; i < NUMBER_WORDS; ++i) {
+    number.words[i] = (u32)wide;
+    wide >>= 32;
+  }
+  return number;
+}
+
+static Wide wide_fit(Wide value, TypeKind kind, u32 width) {
+  if (width >= 128) {
+    return value;
+  }
+  Wide mask = ((Wide)1 << width) - 1;
+  value &= mask;
+  if (kind == TP_SInt && (value >> (width - 1) & 1) != 0) {
+    value |= ~mask;
+  }
+  return value;
+}
+
+static SignedWide wide_signed(Wide value, u32 width) {
+  return (SignedWide)wide_fit(value, TP_SInt, width);
+}
+
+bool number_binary(
+  OperKind oper, TypeKind kind, u32 width, Number lhs, Number rhs,
+  Number* result
+) {
+  Wide left = wide_fit(number_wide(lhs), TP_UInt, width);
+  Wide right = wide_fit(number_wide(rhs), TP_UInt, width);
+  SignedWide signed_left = wide_signed(left, width);
+  SignedWide signed_right = wide_signed(right, width);
+  SignedWide signed_min = (SignedWide)((Wide)1 << 127) >> (128 - width);
+  bool is_signed = kind == TP_SInt;
+  Wide value = 0;
+  switch (oper) {
+    case OP_Add:
+      value = left + right;
+      break;
+    case OP_Sub:
+      value = left - right;
+      break;
+    case OP_Mul:
+      value = left * right;
+      break;
+    case OP_Div:
+      if (right == 0) {
+        return false;
+      } else if (is_signed == true) {
+        if (signed_left == signed_min && signed_right == -1) {
+          return false;
+        }
+        value = (Wide)(signed_left / signed_right);
+      } else {
+        value = left / right;
+      }
+      break;
+    case OP_Mod:
+      if (right == 0) {
+        return false;
+      } else if (is_signed == true) {
+        if (signed_left == signed_min && signed_right == -1) {
+          return false;
+        }
+        value = (Wide)(signed_left % signed_right);
+      } else {
+        value = left % right;
+      }
+      break;
+    case OP_Shl:
+      if (right >= width) {
+        return false;
+      }
+      value = left << right;
+      break;
+    case OP_Shr:
+      if (right >= width) {
+        return false;
+      }
+      value = is_signed == true ? (Wide)(signed_left >> right) : left >> right;
+      break;
+    case OP_BitAnd:
+      value = left & right;
+      break;
+    case OP_BitOr:
+      value = left | right;
+      break;
+    case OP_BitXor:
+      value = left ^ right;
+      break;
+    case OP_And:
+      *result = number_narrow(left != 0 && right != 0);
+      return true;
+    case OP_Or:
+      *result = number_narrow(left != 0 || right != 0);
+      return true;
+    case OP_Eq:
+      *result = number_narrow(left == right);
+      return true;
+    case OP_NEq:
+      *result = number_narrow(left != right);
+      return true;
+    case OP_Lt:
+      *result = number_narrow(
+        is_signed == true ? signed_left < signed_right : left < right
+      );
+      return true;
+    case OP_Lte:
+      *result = number_narrow(
+        is_signed == true ? signed_left <= signed_right : left <= right
+      );
+      return true;
+    case OP_Gte:
+      *result = number_narrow(
+        is_signed == true ? signed_left >= signed_right : left >= right
+      );
+      return true;
+    case OP_Gt:
+      *result = number_narrow(
+        is_signed == true ? signed_left > signed_right : left > right
+      );
+      return true;
+    case OP_Asg:
+    case OP_ArrIdx:
+      return false;
+  }
+  *result = number_narrow(wide_fit(value, kind, width));
+  return true;
+}
+
+Number number_negative(Number number, TypeKind kind, u32 width) {
+  return number_narrow(wide_fit(-number_wide(number), kind, width));
+}
+
+bool number_is(Number number, u64 value) {
+  return number_wide(number) == value;
+}
+
+bool number_fits(Number number, TypeKind from, TypeKind kind, u32 width) {
+  Wide value = number_wide(number);
+  if (from == TP_SInt && (SignedWide)value < 0) {
+    return kind == TP_SInt && wide_fit(value, TP_SInt, width) == value;
+  }
+  u32 bits = kind == TP_SInt ? width - 1 : width;
+  return bits >= 128 || value >> bits == 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <parser/mod.h>
+#include <utility/mod.h>
+
+// Literals are converted from their spelling once, while parsing. Integers
+// take an optional 0x, 0o or 0b prefix and '_' separators between digits,
+// floats take '_' separators. A failed conversion returns the message to
+// report and sets location to the character at fault, otherwise nullptr.
+extern const char* number_parse_int(StrView text, Number* number, rcstr* location);
+extern const char* number_parse_flt(StrView text, Number* number, rcstr* location);
+// Bits a signed integer needs to hold the value, 129 for the values only an
+// unsigned 128-bit integer holds
+extern u32 number_signed_width(Number number);
+extern f64 number_flt(Number number);
+// Writes the value as a value of kind, null terminated, and returns its
+// length. A buffer of NUMBER_FORMAT_SIZE bytes fits every value.
+#define NUMBER_FORMAT_SIZE 48
+extern usize number_format(Number number, TypeKind kind, char* buffer);
+// Integer operations on constants of a type of kind and width, as codegen
+// emits them: divisions, remainders, right shifts and orderings are signed
+// for signed kinds and unsigned otherwise, results wrap to the width.
+// Comparisons, "&&" and "||" give 0 or 1. Returns false where the result is
+// no constant: a division by zero, a signed overflow of a division or
+// remainder or a shift past the width.
+extern bool number_binary(
+  OperKind oper, TypeKind kind, u32 width, Number lhs, Number rhs,
+  Number* result
+);
+extern Number number_negative(Number number, TypeKind kind, u32 width);
+// Whether the integer is value at any width
+extern bool number_is(Number number, u64 value);
+// Whether an integer of a type of kind from keeps its value in a type of
+// kind and width
+extern bool number_fits(Number number, TypeKind from, TypeKind kind, u32 width);
@@ -1,17 +1,68 @@
 #include <parser/ctors.h>
+#include <parser/number.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <utility/mod.h>
+#include <utility/vec.h>
 
-static void print_indent(i32* indent) {
-  for (i32 i = 0; i < *indent; ++i) {
+// Lines still to be printed: a node with the lines under it, whose value is
+// its id, or a line printed after the subtree before it, a size has its
+// value. Trees are printed from an explicit stack, deep expressions do not
+// recurse.
+typedef enum PrintKind PrintKind;
+enum PrintKind {
+  PE_Node,
+  PE_Undefined,
+  PE_Size,
+};
+
+typedef struct PrintEntry PrintEntry;
+struct PrintEntry {
+  PrintKind kind;
+  i32 indent;
+  u32 value;
+};
+
+DEFINE_VECTOR(PrintEntry)
+DEFINE_VEC_FNS(PrintEntry, malloc, free)
+
+static void print_indent(i32 indent) {
+  for (i32 i = 0; i < indent; ++i) {
     eputc('|');
     eputc(' ');
   }
-  *indent += 1;
 }
 
-static void print_branch(Node* node, i32* indent) {
+static void push_line(
+  PrintEntryVector** stack, PrintKind kind, i32 indent, u32 value
+) {
+  PrintEntry entry = {
+    .kind = kind,
+    .indent = indent,
+    .value = value,
+  };
+  PrintEntry_vector_push(stack, entry);
+}
+
+static void push_list(
+  const Ast* ast, PrintEntryVector** stack, NodeList list, i32 indent
+) {
+  for (u32 i = 0; i < list.count; ++i) {
+    push_line(stack, PE_Node, indent, ast_list(ast, list)[i]);
+  }
+}
+
+// Prints the line of a node and pushes the lines under it in the order they
+// are printed. Nodes keeping a location print it under their line when the
+// lines of the source are indexed.
+static void print_node(
+  const Ast* ast, const LineIndex* index, PrintEntryVector** stack, NodeId id,
+  i32 indent
+) {
+  Node* node = ast_get(ast, id);
   print_indent(indent);
+  indent += 1;
 
   if (node->kind == ND_None) {
     eputs("None");
@@ -22,6 +73,14 @@ static void print_branch(Node* node, i32* indent) {
       case OP_Sub:    eputs("Operation: Sub");    break;
       case OP_Mul:    eputs("Operation: Mul");    break;
       case OP_Div:    eputs("Operation: Div");    break;
+      case OP_Mod:    eputs("Operation: Mod");    break;
+      case OP_Shl:    eputs("Operation: Shl");    break;
+      case OP_Shr:    eputs("Operation: Shr");    break;
+      case OP_BitAnd: eputs("Operation: BitAnd"); break;
+      case OP_BitOr:  eputs("Operation: BitOr");  break;
+      case OP_BitXor: eputs("Operation: BitXor"); break;
+      case OP_And:    eputs("Operation: And");    break;
+      case OP_Or:     eputs("Operation: Or");     break;
       case OP_Eq:     eputs("Operation: Eq");     break;
       case OP_NEq:    eputs("Operation: Not");    break;
       case OP_Lt:     eputs("Operation: Lt");     break;
@@ -31,32 +90,36 @@ static void print_branch(Node* node, i32* indent) {
       case OP_Asg:    eputs("Operation: Asg");    break;
       case OP_ArrIdx: eputs("Operation: ArrIdx"); break;
     }  // clang-format on
-    print_branch(node->operation.lhs, indent);
-    print_branch(node->operation.rhs, indent);
+    push_line(stack, PE_Node, indent, node->operation.lhs);
+    push_line(stack, PE_Node, indent, node->operation.rhs);
 
   } else if (node->kind == ND_Negation) {
     eputs("Negation");
-    print_branch(node->unary, indent);
+    push_line(stack, PE_Node, indent, node->unary);
 
   } else if (node->kind == ND_Return) {
     eputs("Return");
-    print_branch(node->unary, indent);
+    push_line(stack, PE_Node, indent, node->unary);
+
+  } else if (node->kind == ND_Addr) {
+    eputs("Address");
+    push_line(stack, PE_Node, indent, node->unary);
+
+  } else if (node->kind == ND_Deref) {
+    eputs("Dereference");
+    push_line(stack, PE_Node, indent, node->unary);
 
   } else if (node->kind == ND_Block) {
     eputs("Block:");
-    for (Node* branch = node->unary; branch != nullptr; branch = branch->next) {
-      print_branch(branch, indent);
-    }
+    push_list(ast, stack, node->block, indent);
 
   } else if (node->kind == ND_Decl) {
-    eprintf("Declaration = %s\n", node->declaration.name->array);
-    print_branch(node->declaration.type, indent);
-    if (node->declaration.value != nullptr) {
-      print_branch(node->declaration.value, indent);
+    eprintf("Declaration = %s\n", symbol_str(node->declaration.name));
+    push_line(stack, PE_Node, indent, node->declaration.type);
+    if (node->declaration.value != 0) {
+      push_line(stack, PE_Node, indent, node->declaration.value);
     } else {
-      print_indent(indent);
-      eputs("Value = Undefined");
-      *indent -= 1;
+      push_line(stack, PE_Undefined, indent, 0);
     }
 
   } else if (node->kind == ND_Type) {
@@ -73,75 +136,118 @@ static void print_branch(Node* node, i32* indent) {
     if (node->type.kind == TP_Flt ||  //
         node->type.kind == TP_SInt || node->type.kind == TP_UInt) {
       print_indent(indent);
-      eprintf("Width = %zu\n", node->type.bit_width);
-      *indent -= 1;
+      eprintf("Width = %u\n", node->type.bit_width);
     } else if (node->type.kind == TP_Ptr) {
-      print_branch(node->type.base, indent);
+      push_line(stack, PE_Node, indent, node->type.base);
     } else if (node->type.kind == TP_Arr) {
-      print_branch(node->type.array.base, indent);
-      print_indent(indent);
-      eprintf("Size = %zu\n", node->type.array.size);
-      *indent -= 1;
+      push_line(stack, PE_Node, indent, node->type.array.base);
+      push_line(stack, PE_Size, indent, node->type.array.size);
     }
 
   } else if (node->kind == ND_Value) {
-    if (node->value.type->type.kind == TP_Ptr) {
+    TypeKind kind = ast_get(ast, node->value.type)->type.kind;
+    if (kind == TP_Ptr) {
       eputs("Value = Ptr");
-      print_branch(node->value.base, indent);
-    } else if (node->value.type->type.kind == TP_Arr) {
+      push_list(ast, stack, node->value.elements, indent);
+    } else if (kind == TP_Arr) {
       eputs("Value = Arr");
-      for (Node* val = node->value.base; val != nullptr; val = val->next) {
-        print_branch(val, indent);
-      }
+      push_list(ast, stack, node->value.elements, indent);
+    } else if (kind == TP_Str) {
+      StrView string = ast_string(ast, node->value.string);
+      eprintf("Value = %.*s\n", (int)string.length, string.pointer);
     } else {
-      eprintf("Value = %s\n", node->value.basic->array);
+      char number[NUMBER_FORMAT_SIZE];
+      number_format(node->value.number, kind, number);
+      eprintf("Value = %s\n", number);
     }
 
   } else if (node->kind == ND_Variable) {
-    eprintf("Variable = %s\n", node->unary->declaration.name->array);
-    print_branch(node->unary->declaration.type, indent);
+    Node* decl = ast_get(ast, node->unary);
+    eprintf("Variable = %s\n", symbol_str(decl->declaration.name));
+    push_line(stack, PE_Node, indent, decl->declaration.type);
 
   } else if (node->kind == ND_ArgVar) {
-    eprintf("Argument = %s\n", node->declaration.name->array);
-    print_branch(node->declaration.type, indent);
+    eprintf("Argument = %s\n", symbol_str(node->declaration.name));
+    push_line(stack, PE_Node, indent, node->declaration.type);
 
   } else if (node->kind == ND_If) {
     eputs("If:");
-    print_branch(node->if_node.cond, indent);
-    print_branch(node->if_node.then, indent);
-    if (node->if_node.elseb != nullptr) {
-      print_branch(node->if_node.elseb, indent);
+    push_line(stack, PE_Node, indent, node->if_node.cond);
+    push_line(stack, PE_Node, indent, node->if_node.then);
+    if (node->if_node.elseb != 0) {
+      push_line(stack, PE_Node, indent, node->if_node.elseb);
     }
   } else if (node->kind == ND_While) {
     eputs("While:");
-    print_branch(node->while_node.cond, indent);
-    print_branch(node->while_node.then, indent);
+    push_line(stack, PE_Node, indent, node->while_node.cond);
+    push_line(stack, PE_Node, indent, node->while_node.then);
 
   } else if (node->kind == ND_Call) {
-    eprintf("Call = %s\n", node->call_node.name->array);
-    for (Node* branch = node->call_node.args; branch != nullptr;
-         branch = branch->next) {
-      print_branch(branch, indent);
+    eprintf("Call = %s\n", symbol_str(node->call_node.name));
+    push_list(ast, stack, node->call_node.args, indent);
+  }
+
+  u32 location = 0;
+  if (index != nullptr && node_location(ast, id, &location) == true) {
+    SourceLoc loc = line_index_find(index, location);
+    print_indent(indent);
+    eprintf("Location = %u:%u\n", loc.line, loc.column);
+  }
+}
+
+// Prints the subtree at id with its lines indented at least by indent
+static void print_branch(
+  const Ast* ast, const LineIndex* index, PrintEntryVector** stack, NodeId id,
+  i32 indent
+) {
+  usize base = (*stack)->length;
+  push_line(stack, PE_Node, indent, id);
+  while ((*stack)->length > base) {
+    (*stack)->length -= 1;
+    PrintEntry entry = (*stack)->buffer[(*stack)->length];
+    if (entry.kind == PE_Undefined) {
+      print_indent(entry.indent);
+      eputs("Value = Undefined");
+    } else if (entry.kind == PE_Size) {
+      print_indent(entry.indent);
+      eprintf("Size = %u\n", entry.value);
+    } else {
+      // Lines pushed in print order are reversed to be popped in it
+      usize mark = (*stack)->length;
+      print_node(ast, index, stack, entry.value, entry.indent);
+      PrintEntry* lines = (*stack)->buffer;
+      for (usize i = mark, j = (*stack)->length; i + 1 < j; ++i, --j) {
+        PrintEntry line = lines[i];
+        lines[i] = lines[j - 1];
+        lines[j - 1] = line;
+      }
     }
   }
-  *indent -= 1;
 }
 
-void print_ast(Node* prog) {
-  for (Node* branch = prog; branch != nullptr; branch = branch->next) {
-    if (branch != prog) {
+void print_ast(const Ast* ast, NodeList prog, StrView source) {
+  LineIndex lines = {};
+  const LineIndex* index = nullptr;
+  if (source.pointer != nullptr) {
+    lines = line_index_make(source);
+    index = &lines;
+  }
+  PrintEntryVector* stack = PrintEntry_vector_make(64);
+  for (u32 i = 0; i < prog.count; ++i) {
+    if (i != 0) {
       eputs("--------------------------------------");
     }
-    i32 indent = 0;
-    eprintf("Function = %s\n", branch->function.name->array);
-    indent += 1;
-    print_branch(branch->function.ret_type, &indent);
-    for (Node* arg = branch->function.args; arg != nullptr; arg = arg->next) {
-      print_branch(arg, &indent);
+    Node* branch = ast_get(ast, ast_list(ast, prog)[i]);
+    eprintf("Function = %s\n", symbol_str(branch->function.name));
+    print_branch(ast, index, &stack, branch->function.ret_type, 1);
+    NodeList args = branch->function.args;
+    for (u32 j = 0; j < args.count; ++j) {
+      print_branch(ast, index, &stack, ast_list(ast, args)[j], 1);
     }
-    indent -= 1;
-    if (branch->function.body != nullptr) {
-      print_branch(branch->function.body, &indent);
+    if (branch->function.body != 0) {
+      print_branch(ast, index, &stack, branch->function.body, 0);
     }
   }
+  free(stack);
+  line_index_free(&lines);
 }
@@ -0,0 +1,259 @@
+#include <parser/scan.h>
+#include <threads.h>
+#include <utility/mod.h>
+
+#if SCAN_SIMD && defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#else
+#define SCAN_X86 0
+#endif
+
+static inline bool is_space_class(char ref) {
+  return ref == ' ' || ref == '\t' || ref == '\r' || ref == '\f';
+}
+
+static inline bool is_digit_class(char ref) {
+  return (ref >= '0' && ref <= '9') || ref == '_';
+}
+
+static inline bool is_ident_class(char ref) {
+  return (ref >= 'a' && ref <= 'z') || (ref >= 'A' && ref <= 'Z') ||
+         (ref >= '0' && ref <= '9') || ref == '_';
+}
+
+static const char* scalar_skip_space(rcstr iter, rcstr end) {
+  while (iter != end && is_space_class(*iter) == true) {
+    iter += 1;
+  }
+  return iter;
+}
+
+static const char* scalar_skip_ident(rcstr iter, rcstr end) {
+  while (iter != end && is_ident_class(*iter) == true) {
+    iter += 1;
+  }
+  return iter;
+}
+
+static const char* scalar_skip_digits(rcstr iter, rcstr end) {
+  while (iter != end && is_digit_class(*iter) == true) {
+    iter += 1;
+  }
+  return iter;
+}
+
+#define SCALAR_FIND(NAME, CHAR)                             \
+  static const char* scalar_##NAME(rcstr iter, rcstr end) { \
+    while (iter != end && *iter != (CHAR)) {                \
+      iter += 1;                                            \
+    }                                                       \
+    return iter;                                            \
+  }
+
+SCALAR_FIND(find_newline, '\n')
+SCALAR_FIND(find_backslash, '\\')
+
+static usize scalar_count_newlines(rcstr iter, rcstr end) {
+  usize count = 0;
+  for (; iter != end; ++iter) {
+    count += *iter == '\n';
+  }
+  return count;
+}
+
+unused static const Scanner scalar_scanner = {
+  .skip_space = scalar_skip_space,
+  .skip_ident = scalar_skip_ident,
+  .skip_digits = scalar_skip_digits,
+  .find_newline = scalar_find_newline,
+  .find_backslash = scalar_find_backslash,
+  .count_newlines = scalar_count_newlines,
+};
+
+#if SCAN_X86
+
+// Range checks are done with signed compares: adding (0x80 - low) moves the
+// range [low, low + count) to the bottom of the signed byte range.
+#define SSE_RANGE(vec, low, count)                          \
+  _mm_cmplt_epi8(                                           \
+    _mm_add_epi8(vec, _mm_set1_epi8((char)(0x80 - (low)))), \
+    _mm_set1_epi8((char)(0x80 + (count)))                   \
+  )
+#define AVX_RANGE(vec, low, count)                               \
+  _mm256_cmpgt_epi8(                                             \
+    _mm256_set1_epi8((char)(0x80 + (count))),                    \
+    _mm256_add_epi8(vec, _mm256_set1_epi8((char)(0x80 - (low)))) \
+  )
+
+static inline __m128i sse_space_mask(__m128i vec) {
+  __m128i mask = _mm_cmpeq_epi8(vec, _mm_set1_epi8(' '));
+  mask = _mm_or_si128(mask, _mm_cmpeq_epi8(vec, _mm_set1_epi8('\t')));
+  mask = _mm_or_si128(mask, _mm_cmpeq_epi8(vec, _mm_set1_epi8('\r')));
+  return _mm_or_si128(mask, _mm_cmpeq_epi8(vec, _mm_set1_epi8('\f')));
+}
+
+static inline __m128i sse_digit_mask(__m128i vec) {
+  __m128i mask = SSE_RANGE(vec, '0', 10);
+  return _mm_or_si128(mask, _mm_cmpeq_epi8(vec, _mm_set1_epi8('_')));
+}
+
+static inline __m128i sse_ident_mask(__m128i vec) {
+  __m128i lower = _mm_or_si128(vec, _mm_set1_epi8(0x20));
+  __m128i mask = SSE_RANGE(lower, 'a', 26);
+  return _mm_or_si128(mask, sse_digit_mask(vec));
+}
+
+#define SSE_SKIP(NAME, MASK)                                  \
+  static const char* sse_##NAME(rcstr iter, rcstr end) {      \
+    while (end - iter >= 16) {                                \
+      __m128i vec = _mm_loadu_si128((const __m128i*)iter);    \
+      u32 miss = ~(u32)_mm_movemask_epi8(MASK(vec)) & 0xffff; \
+      if (miss != 0) {                                        \
+        return iter + __builtin_ctz(miss);                    \
+      }                                                       \
+      iter += 16;                                             \
+    }                                                         \
+    return scalar_##NAME(iter, end);                          \
+  }
+
+SSE_SKIP(skip_space, sse_space_mask)
+SSE_SKIP(skip_ident, sse_ident_mask)
+SSE_SKIP(skip_digits, sse_digit_mask)
+
+#define SSE_FIND(NAME, CHAR)                                    \
+  static const char* sse_##NAME(rcstr iter, rcstr end) {        \
+    while (end - iter >= 16) {                                  \
+      __m128i vec = _mm_loadu_si128((const __m128i*)iter);      \
+      __m128i found = _mm_cmpeq_epi8(vec, _mm_set1_epi8(CHAR)); \
+      u32 hit = (u32)_mm_movemask_epi8(found);                  \
+      if (hit != 0) {                                           \
+        return iter + __builtin_ctz(hit);                       \
+      }                                                         \
+      iter += 16;                                               \
+    }                                                           \
+    return scalar_##NAME(iter, end);                            \
+  }
+
+SSE_FIND(find_newline, '\n')
+SSE_FIND(find_backslash, '\\')
+
+static usize sse_count_newlines(rcstr iter, rcstr end) {
+  usize count = 0;
+  while (end - iter >= 16) {
+    __m128i vec = _mm_loadu_si128((const __m128i*)iter);
+    u32 hit = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(vec, _mm_set1_epi8('\n')));
+    count += __builtin_popcount(hit);
+    iter += 16;
+  }
+  return count + scalar_count_newlines(iter, end);
+}
+
+static const Scanner sse_scanner = {
+  .skip_space = sse_skip_space,
+  .skip_ident = sse_skip_ident,
+  .skip_digits = sse_skip_digits,
+  .find_newline = sse_find_newline,
+  .find_backslash = sse_find_backslash,
+  .count_newlines = sse_count_newlines,
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx_space_mask(__m256i vec) {
+  __m256i mask = _mm256_cmpeq_epi8(vec, _mm256_set1_epi8(' '));
+  mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(vec, _mm256_set1_epi8('\t')));
+  mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(vec, _mm256_set1_epi8('\r')));
+  return _mm256_or_si256(mask, _mm256_cmpeq_epi8(vec, _mm256_set1_epi8('\f')));
+}
+
+AVX2 static inline __m256i avx_digit_mask(__m256i vec) {
+  __m256i mask = AVX_RANGE(vec, '0', 10);
+  return _mm256_or_si256(mask, _mm256_cmpeq_epi8(vec, _mm256_set1_epi8('_')));
+}
+
+AVX2 static inline __m256i avx_ident_mask(__m256i vec) {
+  __m256i lower = _mm256_or_si256(vec, _mm256_set1_epi8(0x20));
+  __m256i mask = AVX_RANGE(lower, 'a', 26);
+  return _mm256_or_si256(mask, avx_digit_mask(vec));
+}
+
+#define AVX_SKIP(NAME, MASK)                                  \
+  AVX2 static const char* avx_##NAME(rcstr iter, rcstr end) { \
+    while (end - iter >= 32) {                                \
+      __m256i vec = _mm256_loadu_si256((const __m256i*)iter); \
+      u32 miss = ~(u32)_mm256_movemask_epi8(MASK(vec));       \
+      if (miss != 0) {                                        \
+        return iter + __builtin_ctz(miss);                    \
+      }                                                       \
+      iter += 32;                                             \
+    }                                                         \
+    return sse_##NAME(iter, end);                             \
+  }
+
+AVX_SKIP(skip_space, avx_space_mask)
+AVX_SKIP(skip_ident, avx_ident_mask)
+AVX_SKIP(skip_digits, avx_digit_mask)
+
+#define AVX_FIND(NAME, CHAR)                                          \
+  AVX2 static const char* avx_##NAME(rcstr iter, rcstr end) {         \
+    while (end - iter >= 32) {                                        \
+      __m256i vec = _mm256_loadu_si256((const __m256i*)iter);         \
+      __m256i found = _mm256_cmpeq_epi8(vec, _mm256_set1_epi8(CHAR)); \
+      u32 hit = (u32)_mm256_movemask_epi8(found);                     \
+      if (hit != 0) {                                                 \
+        return iter + __builtin_ctz(hit);                             \
+      }                                                               \
+      iter += 32;                                                     \
+    }                                                                 \
+    return sse_##NAME(iter, end);                                     \
+  }
+
+AVX_FIND(find_newline, '\n')
+AVX_FIND(find_backslash, '\\')
+
+AVX2 static usize avx_count_newlines(rcstr iter, rcstr end) {
+  usize count = 0;
+  while (end - iter >= 32) {
+    __m256i vec = _mm256_loadu_si256((const __m256i*)iter);
+    __m256i newline = _mm256_cmpeq_epi8(vec, _mm256_set1_epi8('\n'));
+    count += __builtin_popcount((u32)_mm256_movemask_epi8(newline));
+    iter += 32;
+  }
+  return count + sse_count_newlines(iter, end);
+}
+
+static const Scanner avx_scanner = {
+  .skip_space = avx_skip_space,
+  .skip_ident = avx_skip_ident,
+  .skip_digits = avx_skip_digits,
+  .find_newline = avx_find_newline,
+  .find_backslash = avx_find_backslash,
+  .count_newlines = avx_count_newlines,
+};
+
+#endif
+
+#if SCAN_X86
+static const Scanner* selected = nullptr;
+static once_flag select_once = ONCE_FLAG_INIT;
+
+static void scanner_select() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    selected = &avx_scanner;
+  } else {
+    selected = &sse_scanner;
+  }
+}
+#endif
+
+// The scanner is picked once, lexer threads may ask for it at the same time
+const Scanner* scanner_get() {
+#if SCAN_X86
+  call_once(&select_once, scanner_select);
+  return selected;
+#else
+  return &scalar_scanner;
+#endif
+}
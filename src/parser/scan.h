@@ -0,0 +1,22 @@
+#pragma once
+#include <utility/mod.h>
+
+#ifndef SCAN_SIMD
+#define SCAN_SIMD 1
+#endif
+
+// Every scanner returns the first position in [iter, end) whose character is
+// not part of the scanned class, or end if the whole range matched. The
+// find scanners return the first position holding their character, or end.
+// count_newlines returns the number of '\n' characters in [iter, end).
+typedef struct Scanner Scanner;
+struct Scanner {
+  fn(const char*(rcstr, rcstr)) skip_space;
+  fn(const char*(rcstr, rcstr)) skip_ident;
+  fn(const char*(rcstr, rcstr)) skip_digits;
+  fn(const char*(rcstr, rcstr)) find_newline;
+  fn(const char*(rcstr, rcstr)) find_backslash;
+  fn(usize(rcstr, rcstr)) count_newlines;
+};
+
+extern const Scanner* scanner_get();
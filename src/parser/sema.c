@@ -0,0 +1,671 @@
+#include <parser/ctors.h>
+#include <parser/diag.h>
+#include <parser/intern.h>
+#include <parser/number.h>
+#include <parser/sema.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility/mod.h>
+#include <utility/vec.h>
+
+#define TYPE_NAME_SIZE 64
+
+// What is required of the type of an expression once it is checked: nothing,
+// that it is assignable to the type wanted or that it is an integer
+typedef enum CheckUse CheckUse;
+enum CheckUse {
+  CU_Expr,
+  CU_Value,
+  CU_Truth,
+};
+
+// An expression waiting for its operands to be checked, they are checked one
+// at a time in the order the recursive checker took. stage counts operands
+// pushed so far, first holds the type of the first one. Calls and array
+// values count the arguments or elements pushed so far in count.
+typedef struct CheckFrame CheckFrame;
+struct CheckFrame {
+  NodeId id;
+  NodeId want;
+  NodeId first;
+  u32 count;
+  u16 stage;
+  CheckUse use;
+};
+
+DEFINE_VECTOR(CheckFrame)
+DEFINE_VEC_FNS(CheckFrame, malloc, free)
+
+// Errors point at the location of the expression they are found in, or of
+// the nearest expression or statement holding it that keeps one
+typedef struct Checker Checker;
+struct Checker {
+  Ast* ast;
+  StrView source;
+  // Every function by its name, calls are checked against them
+  SymbolTable functions;
+  NodeId function;
+  NodeId statement;
+  NodeId bool_type;
+  NodeId unit_type;
+  usize errors;
+  // Expressions are checked with an explicit stack rather than recursion
+  CheckFrameVector* frames;
+};
+
+static void report(StrView source, rcstr location, rcstr fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  diag_report(source, location, fmt, ap);
+  va_end(ap);
+}
+
+// The source the error at id points into, nullptr when neither it nor
+// anything holding it has a location
+static const char* error_location(const Checker* checker, NodeId id) {
+  const Ast* ast = checker->ast;
+  u32 location = 0;
+  bool found = node_location(ast, id, &location);
+  for (usize i = checker->frames->length; found != true && i != 0; --i) {
+    found = node_location(ast, checker->frames->buffer[i - 1].id, &location);
+  }
+  if (found != true && checker->statement != 0) {
+    found = node_location(ast, checker->statement, &location);
+  }
+  return found == true ? checker->source.pointer + location : nullptr;
+}
+
+// Errors without a location name the function they are found in
+static void sema_error(Checker* checker, NodeId id, rcstr fmt, ...) {
+  char message[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(message, sizeof(message), fmt, ap);
+  va_end(ap);
+  rcstr location = error_location(checker, id);
+  if (location != nullptr) {
+    report(checker->source, location, "%s", message);
+  } else {
+    Symbol name = ast_get(checker->ast, checker->function)->function.name;
+    rcstr function = symbol_str(name);
+    report((StrView){}, nullptr, "In function %s: %s", function, message);
+  }
+  checker->errors += 1;
+}
+
+// Spells the type the way sources write it
+static void type_name(const Ast* ast, NodeId id, char* buffer, usize size) {
+  const TypeNode* type = &ast_get(ast, id)->type;
+  i32 written = 0;
+  switch (type->kind) {
+    case TP_Undf:
+      snprintf(buffer, size, "undefined");
+      return;
+    case TP_Unit:
+      snprintf(buffer, size, "unit");
+      return;
+    case TP_SInt:
+      snprintf(buffer, size, "i%u", type->bit_width);
+      return;
+    case TP_UInt:
+      snprintf(buffer, size, "u%u", type->bit_width);
+      return;
+    case TP_Flt:
+      if (type->bit_width == 15) {
+        snprintf(buffer, size, "bf16");
+      } else {
+        snprintf(buffer, size, "f%u", type->bit_width);
+      }
+      return;
+    case TP_Str:
+      snprintf(buffer, size, "str");
+      return;
+    case TP_Ptr:
+      written = snprintf(buffer, size, "*");
+      break;
+    case TP_Arr:
+      written = snprintf(buffer, size, "[%u]", type->array.size);
+      break;
+  }
+  if (written >= 0 && (usize)written < size) {
+    type_name(ast, type->base, buffer + written, size - (usize)written);
+  }
+}
+
+static TypeKind type_kind(const Ast* ast, NodeId type) {
+  return ast_get(ast, type)->type.kind;
+}
+
+static bool is_integer_type(const Ast* ast, NodeId type) {
+  TypeKind kind = type_kind(ast, type);
+  return kind == TP_SInt || kind == TP_UInt;
+}
+
+// String literals are pointers to their first byte
+static bool is_assignable(const Ast* ast, NodeId from, NodeId to) {
+  if (from == to) {
+    return true;
+  }
+  if (type_kind(ast, from) != TP_Str || type_kind(ast, to) != TP_Ptr) {
+    return false;
+  }
+  const TypeNode* base = &ast_get(ast, ast_get(ast, to)->type.base)->type;
+  return (base->kind == TP_SInt || base->kind == TP_UInt) &&
+         base->bit_width == 8;
+}
+
+// Gives a literal the type its context expects when its value fits it,
+// returns the type the expression ends up with
+static NodeId coerce(Checker* checker, NodeId id, NodeId type, NodeId want) {
+  Ast* ast = checker->ast;
+  Node* node = ast_get(ast, id);
+  if (want == 0 || type == want || node->kind != ND_Value) {
+    return type;
+  }
+  const TypeNode* from = &ast_get(ast, type)->type;
+  const TypeNode* to = &ast_get(ast, want)->type;
+  bool integer = (from->kind == TP_SInt || from->kind == TP_UInt) &&
+                 (to->kind == TP_SInt || to->kind == TP_UInt) &&
+                 number_fits(
+                   node->value.number, from->kind, to->kind, to->bit_width
+                 ) == true;
+  if (integer == true || (from->kind == TP_Flt && to->kind == TP_Flt)) {
+    node->value.type = want;
+    return want;
+  }
+  return type;
+}
+
+static void mismatch(
+  Checker* checker, NodeId id, NodeId expected, NodeId found
+) {
+  char expected_name[TYPE_NAME_SIZE];
+  char found_name[TYPE_NAME_SIZE];
+  type_name(checker->ast, expected, expected_name, sizeof(expected_name));
+  type_name(checker->ast, found, found_name, sizeof(found_name));
+  sema_error(
+    checker, id, "Mismatched types, expected %s but found %s", expected_name,
+    found_name
+  );
+}
+
+static NodeId check_root(
+  Checker* checker, NodeId id, NodeId want, CheckUse use
+);
+static void check_stmt(Checker* checker, NodeId id);
+
+// Returns the type of the expression, 0 once an error was reported for it
+static NodeId check_expr(Checker* checker, NodeId id, NodeId want) {
+  return check_root(checker, id, want, CU_Expr);
+}
+
+// Checks the expression at id where a value of type want is required
+static void check_value(Checker* checker, NodeId id, NodeId want) {
+  check_root(checker, id, want, CU_Value);
+}
+
+static NodeId check_truth(Checker* checker, NodeId id) {
+  return check_root(checker, id, 0, CU_Truth);
+}
+
+// Applies what the context requires of the expression at id to the type it
+// was checked to have
+static NodeId check_use(
+  Checker* checker, NodeId id, CheckUse use, NodeId want, NodeId type
+) {
+  if (use == CU_Value && type != 0 &&
+      is_assignable(checker->ast, type, want) != true) {
+    mismatch(checker, id, want, type);
+  } else if (use == CU_Truth && type != 0 &&
+             is_integer_type(checker->ast, type) != true) {
+    char name[TYPE_NAME_SIZE];
+    type_name(checker->ast, type, name, sizeof(name));
+    sema_error(
+      checker, id, "Expected an integer condition but found %s", name
+    );
+    return 0;
+  }
+  return type;
+}
+
+static const char* oper_spelling(OperKind oper) {
+  switch (oper) {  // clang-format off
+    case OP_Add:    return "+";
+    case OP_Sub:    return "-";
+    case OP_Mul:    return "*";
+    case OP_Div:    return "/";
+    case OP_Mod:    return "%";
+    case OP_Shl:    return "<<";
+    case OP_Shr:    return ">>";
+    case OP_BitAnd: return "&";
+    case OP_BitOr:  return "|";
+    case OP_BitXor: return "^";
+    case OP_And:    return "&&";
+    case OP_Or:     return "||";
+    case OP_Eq:     return "==";
+    case OP_NEq:    return "!=";
+    case OP_Lt:     return "<";
+    case OP_Lte:    return "<=";
+    case OP_Gte:    return ">=";
+    case OP_Gt:     return ">";
+    case OP_Asg:    return "=";
+    case OP_ArrIdx: return "[]";
+  }  // clang-format on
+  return "";
+}
+
+static bool is_comparison(OperKind oper) {
+  return oper == OP_Eq || oper == OP_NEq || oper == OP_Lt || oper == OP_Lte ||
+         oper == OP_Gte || oper == OP_Gt;
+}
+
+// Both operands of an arithmetic operation or a comparison have one type, a
+// literal on either side takes the type of the other side. Takes the types
+// the operands were checked to have.
+static NodeId check_operands(
+  Checker* checker, NodeId id, NodeId lhs, NodeId rhs
+) {
+  Ast* ast = checker->ast;
+  OperNode operation = ast_get(ast, id)->operation;
+  bool comparison = is_comparison(operation.kind);
+  if (lhs == 0 || rhs == 0) {
+    return 0;
+  }
+  lhs = coerce(checker, operation.lhs, lhs, rhs);
+  if (lhs != rhs) {
+    char lhs_name[TYPE_NAME_SIZE];
+    char rhs_name[TYPE_NAME_SIZE];
+    type_name(ast, lhs, lhs_name, sizeof(lhs_name));
+    type_name(ast, rhs, rhs_name, sizeof(rhs_name));
+    sema_error(
+      checker, id, "Mismatched operand types %s and %s for %s", lhs_name,
+      rhs_name, oper_spelling(operation.kind)
+    );
+    return 0;
+  }
+  TypeKind kind = type_kind(ast, lhs);
+  if (kind != TP_SInt && kind != TP_UInt &&
+      (comparison != true || kind != TP_Ptr)) {
+    char name[TYPE_NAME_SIZE];
+    type_name(ast, lhs, name, sizeof(name));
+    sema_error(
+      checker, id, "Invalid operand type %s for %s", name,
+      oper_spelling(operation.kind)
+    );
+    return 0;
+  }
+  return comparison == true ? checker->bool_type : lhs;
+}
+
+// Pushes the expression at id to be checked. Variables and scalar literals
+// have nothing to descend into and are checked on the spot instead, their
+// type is left in type for the frame below as if a frame had finished.
+static void push_check(
+  Checker* checker, NodeId id, NodeId want, CheckUse use, NodeId* type
+) {
+  Ast* ast = checker->ast;
+  Node* node = ast_get(ast, id);
+  if (node->kind == ND_Variable) {
+    node->category = VC_LValue;
+    NodeId checked = ast_get(ast, node->unary)->declaration.type;
+    *type = check_use(checker, id, use, want, checked);
+    return;
+  } else if (node->kind == ND_Value) {
+    NodeId value_type = node->value.type;
+    TypeKind kind = type_kind(ast, value_type);
+    if (kind != TP_Ptr && kind != TP_Arr) {
+      NodeId checked = coerce(checker, id, value_type, want);
+      *type = check_use(checker, id, use, want, checked);
+      return;
+    }
+  }
+  CheckFrame frame = {
+    .id = id,
+    .want = want,
+    .use = use,
+  };
+  CheckFrame_vector_push(&checker->frames, frame);
+}
+
+static NodeId finish_operation(
+  Checker* checker, NodeId id, NodeId type, ValueCategory category
+) {
+  Node* node = ast_get(checker->ast, id);
+  node->operation.type = type;
+  node->category = category;
+  return type;
+}
+
+// Advances an operation, the operands of assignments are checked against
+// each other and those of "&&" and "||" as conditions
+static bool step_operation(
+  Checker* checker, CheckFrame frame, NodeId result, NodeId* type
+) {
+  Ast* ast = checker->ast;
+  OperNode operation = ast_get(ast, frame.id)->operation;
+  switch (operation.kind) {
+    case OP_Asg:
+      if (frame.stage == 0) {
+        push_check(checker, operation.lhs, 0, CU_Expr, type);
+        return false;
+      } else if (frame.stage == 1) {
+        if (result != 0 &&
+            ast_get(ast, operation.lhs)->category != VC_LValue) {
+          sema_error(
+            checker, frame.id, "Left side of an assignment is not assignable"
+          );
+        } else if (result != 0) {
+          push_check(checker, operation.rhs, result, CU_Value, type);
+          return false;
+        }
+      }
+      *type =
+        finish_operation(checker, frame.id, checker->unit_type, VC_RValue);
+      return true;
+
+    case OP_ArrIdx: {
+      if (frame.stage == 0) {
+        push_check(checker, operation.lhs, 0, CU_Expr, type);
+        return false;
+      } else if (frame.stage == 1) {
+        push_check(checker, operation.rhs, 0, CU_Expr, type);
+        return false;
+      }
+      NodeId base = frame.first;
+      NodeId index = result;
+      if (index != 0 && is_integer_type(ast, index) != true) {
+        char name[TYPE_NAME_SIZE];
+        type_name(ast, index, name, sizeof(name));
+        sema_error(checker, frame.id, "Invalid index type %s", name);
+      }
+      TypeKind kind = base != 0 ? type_kind(ast, base) : TP_Undf;
+      if (kind == TP_Ptr || kind == TP_Arr) {
+        *type = finish_operation(
+          checker, frame.id, ast_get(ast, base)->type.base, VC_LValue
+        );
+        return true;
+      } else if (base != 0) {
+        char name[TYPE_NAME_SIZE];
+        type_name(ast, base, name, sizeof(name));
+        sema_error(checker, frame.id, "Indexing a value of type %s", name);
+      }
+      *type = finish_operation(checker, frame.id, 0, VC_RValue);
+      return true;
+    }
+
+    case OP_And:
+    case OP_Or:
+      if (frame.stage < 2) {
+        NodeId operand = frame.stage == 0 ? operation.lhs : operation.rhs;
+        push_check(checker, operand, 0, CU_Truth, type);
+        return false;
+      }
+      *type = finish_operation(
+        checker, frame.id,
+        frame.first != 0 && result != 0 ? checker->bool_type : 0, VC_RValue
+      );
+      return true;
+
+    default: {
+      NodeId want = is_comparison(operation.kind) == true ? 0 : frame.want;
+      if (frame.stage == 0) {
+        push_check(checker, operation.lhs, want, CU_Expr, type);
+        return false;
+      } else if (frame.stage == 1) {
+        NodeId rhs_want = result != 0 ? result : want;
+        push_check(checker, operation.rhs, rhs_want, CU_Expr, type);
+        return false;
+      }
+      NodeId checked = check_operands(checker, frame.id, frame.first, result);
+      *type = finish_operation(checker, frame.id, checked, VC_RValue);
+      return true;
+    }
+  }
+}
+
+// Advances a call through its arguments, each is checked against the type
+// of its parameter while there is one
+static bool step_call(
+  Checker* checker, CheckFrame* top, CheckFrame frame, NodeId* type
+) {
+  Ast* ast = checker->ast;
+  CallNode call = ast_get(ast, frame.id)->call_node;
+  NodeId function = scope_find(&checker->functions, call.name);
+  if (function == 0) {
+    sema_error(
+      checker, frame.id, "Unknown function %s", symbol_str(call.name)
+    );
+    *type = 0;
+    return true;
+  }
+  NodeList params = ast_get(ast, function)->function.args;
+  if (frame.count < call.args.count) {
+    NodeId arg = ast_list(ast, call.args)[frame.count];
+    top->count = frame.count + 1;
+    if (frame.count < params.count) {
+      NodeId param = ast_list(ast, params)[frame.count];
+      NodeId want = ast_get(ast, param)->declaration.type;
+      push_check(checker, arg, want, CU_Value, type);
+    } else {
+      push_check(checker, arg, 0, CU_Expr, type);
+    }
+    return false;
+  }
+  if (call.args.count != params.count) {
+    sema_error(
+      checker, frame.id, "Function %s takes %u arguments but %u were given",
+      symbol_str(call.name), params.count, call.args.count
+    );
+  }
+  *type = ast_get(ast, function)->function.ret_type;
+  ast_get(ast, frame.id)->call_node.type = *type;
+  return true;
+}
+
+// Advances the frame on top of the stack, result is the type the operand it
+// pushed last was checked to have. Returns false after pushing another
+// operand, true once the frame is done with the type of its expression.
+static bool check_step(Checker* checker, NodeId result, NodeId* type) {
+  Ast* ast = checker->ast;
+  CheckFrame* top = &checker->frames->buffer[checker->frames->length - 1];
+  CheckFrame frame = *top;
+  if (frame.stage == 1) {
+    top->first = result;
+  }
+  top->stage += 1;
+  Node* node = ast_get(ast, frame.id);
+  switch (node->kind) {
+    case ND_Operation:
+      return step_operation(checker, frame, result, type);
+
+    case ND_Negation:
+      if (frame.stage == 0) {
+        push_check(checker, node->unary, frame.want, CU_Expr, type);
+        return false;
+      }
+      if (result != 0 && is_integer_type(ast, result) != true) {
+        char name[TYPE_NAME_SIZE];
+        type_name(ast, result, name, sizeof(name));
+        sema_error(
+          checker, frame.id, "Invalid operand type %s for negation", name
+        );
+        result = 0;
+      }
+      ast_get(ast, frame.id)->unary_type = result;
+      *type = result;
+      return true;
+
+    case ND_Addr:
+      if (frame.stage == 0) {
+        push_check(checker, node->unary, 0, CU_Expr, type);
+        return false;
+      }
+      if (result != 0) {
+        result = make_pointer_type(ast, result);
+      }
+      ast_get(ast, frame.id)->unary_type = result;
+      *type = result;
+      return true;
+
+    case ND_Deref:
+      if (frame.stage == 0) {
+        push_check(checker, node->unary, 0, CU_Expr, type);
+        return false;
+      }
+      if (result != 0 && type_kind(ast, result) != TP_Ptr) {
+        char name[TYPE_NAME_SIZE];
+        type_name(ast, result, name, sizeof(name));
+        sema_error(
+          checker, frame.id, "Dereferencing a value of type %s", name
+        );
+        result = 0;
+      } else if (result != 0) {
+        result = ast_get(ast, result)->type.base;
+      }
+      node = ast_get(ast, frame.id);
+      node->unary_type = result;
+      node->category = VC_LValue;
+      *type = result;
+      return true;
+
+    case ND_Value: {
+      // Only array literals get here, scalars are checked by push_check
+      NodeId value_type = node->value.type;
+      NodeList elements = node->value.elements;
+      if (frame.count < elements.count) {
+        NodeId element = ast_list(ast, elements)[frame.count];
+        top->count = frame.count + 1;
+        NodeId base = ast_get(ast, value_type)->type.base;
+        push_check(checker, element, base, CU_Value, type);
+        return false;
+      }
+      *type = value_type;
+      return true;
+    }
+
+    case ND_Variable:  // Checked by push_check without a frame
+      break;
+
+    case ND_Call:
+      return step_call(checker, top, frame, type);
+
+    case ND_Return:
+    case ND_Block:
+    case ND_Decl:
+    case ND_If:
+    case ND_While:
+      check_stmt(checker, frame.id);
+      sema_error(checker, frame.id, "Statement used as a value");
+      *type = 0;
+      return true;
+
+    case ND_None:
+    case ND_Type:
+    case ND_ArgVar:
+    case ND_Function:
+      sema_error(checker, frame.id, "Expected an expression");
+      *type = 0;
+      return true;
+  }
+  *type = 0;
+  return true;
+}
+
+// Checks the expression at id and its operands without recursing into them,
+// a statement used as a value is checked with a walk of its own
+static NodeId check_root(
+  Checker* checker, NodeId id, NodeId want, CheckUse use
+) {
+  usize base = checker->frames->length;
+  NodeId type = 0;
+  push_check(checker, id, want, use, &type);
+  while (checker->frames->length > base) {
+    if (check_step(checker, type, &type) == true) {
+      CheckFrame frame = checker->frames->buffer[checker->frames->length - 1];
+      checker->frames->length -= 1;
+      type = check_use(checker, frame.id, frame.use, frame.want, type);
+    }
+  }
+  return type;
+}
+
+static void check_stmt(Checker* checker, NodeId id) {
+  Ast* ast = checker->ast;
+  Node* node = ast_get(ast, id);
+  NodeId outer = checker->statement;
+  checker->statement = id;
+  switch (node->kind) {
+    case ND_Return: {
+      NodeId function = checker->function;
+      check_value(
+        checker, node->unary, ast_get(ast, function)->function.ret_type
+      );
+      break;
+    }
+
+    case ND_Block: {
+      NodeList stmts = node->block;
+      for (u32 i = 0; i < stmts.count; ++i) {
+        check_stmt(checker, ast_list(ast, stmts)[i]);
+      }
+      break;
+    }
+
+    case ND_Decl:
+      if (node->declaration.value != 0) {
+        check_value(checker, node->declaration.value, node->declaration.type);
+      }
+      break;
+
+    case ND_If: {
+      IfNode branches = node->if_node;
+      check_truth(checker, branches.cond);
+      check_stmt(checker, branches.then);
+      if (branches.elseb != 0) {
+        check_stmt(checker, branches.elseb);
+      }
+      break;
+    }
+
+    case ND_While: {
+      WhileNode loop = node->while_node;
+      check_truth(checker, loop.cond);
+      check_stmt(checker, loop.then);
+      break;
+    }
+
+    default:
+      check_expr(checker, id, 0);
+      break;
+  }
+  checker->statement = outer;
+}
+
+usize sema_check(Ast* ast, NodeList tree, StrView source) {
+  Arena arena = {};
+  Checker checker = {
+    .ast = ast,
+    .source = source,
+    .functions = symbol_table_make(&arena, symbol_count() + 1),
+    .bool_type = make_numeric_type(ast, TP_UInt, 1),
+    .unit_type = make_basic_type(ast, TP_Unit),
+    .frames = CheckFrame_vector_make(64),
+  };
+  for (u32 i = 0; i < tree.count; ++i) {
+    NodeId function = ast_list(ast, tree)[i];
+    Symbol name = ast_get(ast, function)->function.name;
+    scope_bind(&checker.functions, name, function);
+  }
+  for (u32 i = 0; i < tree.count; ++i) {
+    NodeId function = ast_list(ast, tree)[i];
+    NodeId body = ast_get(ast, function)->function.body;
+    if (body != 0) {
+      checker.function = function;
+      check_stmt(&checker, body);
+    }
+  }
+  free(checker.frames);
+  arena_free(&arena);
+  return checker.errors;
+}
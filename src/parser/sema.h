@@ -0,0 +1,31 @@
+#pragma once
+#include <parser/mod.h>
+#include <utility/mod.h>
+
+// Checks the types of every parsed function body and writes the type and the
+// value category of each expression onto its node. Integer and float
+// literals take the type their context expects when their value fits it.
+// Errors are reported to diag at their location in source, the input the
+// tree was parsed from. Returns their number.
+extern usize sema_check(Ast* ast, NodeList tree, StrView source);
+
+// The type of an expression after semantic analysis
+static inline NodeId expr_type(const Ast* ast, NodeId id) {
+  const Node* node = ast_get(ast, id);
+  switch (node->kind) {
+    case ND_Operation:
+      return node->operation.type;
+    case ND_Negation:
+    case ND_Addr:
+    case ND_Deref:
+      return node->unary_type;
+    case ND_Value:
+      return node->value.type;
+    case ND_Variable:
+      return ast_get(ast, node->unary)->declaration.type;
+    case ND_Call:
+      return node->call_node.type;
+    default:
+      return 0;
+  }
+}
@@ -0,0 +1,685 @@
+#include <parser/ctors.h>
+#include <parser/diag.h>
+#include <parser/lexer.h>
+#include <parser/mod.h>
+#include <parser/scan.h>
+#include <parser/session.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility/mod.h>
+#include <utility/vec.h>
+
+DEFINE_VEC_FNS(SessionError, malloc, free)
+DEFINE_VEC_FNS(SessionItem, malloc, free)
+
+// The text being lexed again: the touched items with the edit applied,
+// grown by the following items until the boundaries line up
+typedef struct Damage Damage;
+struct Damage {
+  char* text;
+  usize length;
+  usize first;
+  usize last;
+};
+
+typedef struct ErrorSink ErrorSink;
+struct ErrorSink {
+  SessionErrorVector** errors;
+  rcstr base;
+};
+
+static void collect_error(void* data, rcstr location, rcstr message) {
+  ErrorSink* sink = data;
+  char* copy = strdup(message);
+  if (copy == nullptr) {
+    perror("strdup");
+    exit(1);
+  }
+  SessionError_vector_push(
+    sink->errors,
+    (SessionError){
+      .offset = location != nullptr ? (u32)(location - sink->base) : 0,
+      .message = copy,
+    }
+  );
+}
+
+static void drop_error(unused void* data, unused rcstr location,
+                       unused rcstr message) {}
+
+static void free_errors(SessionErrorVector* errors) {
+  for (usize i = 0; i < errors->length; ++i) {
+    free(errors->buffer[i].message);
+  }
+  free(errors);
+}
+
+static void free_item(SessionItem* item) {
+  free(item->text);
+  ast_free(&item->ast);
+  free_errors(item->errors);
+}
+
+// Slot of the buffer holding the item at index
+static usize item_slot(const Session* session, usize index) {
+  const SessionItemVector* items = session->items;
+  return index < session->gap ? index
+                              : index + items->capacity - items->length;
+}
+
+static SessionItem* item_at(const Session* session, usize index) {
+  return &session->items->buffer[item_slot(session, index)];
+}
+
+// Sum of the counts of the slots before slot
+static usize sums_prefix(const usize* sums, usize slot) {
+  usize sum = 0;
+  for (; slot != 0; slot &= slot - 1) {
+    sum += sums[slot];
+  }
+  return sum;
+}
+
+// Adds delta to the count of a slot, a delta below zero wraps
+static void sums_add(usize* sums, usize capacity, usize slot, usize delta) {
+  for (slot += 1; slot <= capacity; slot += slot & -slot) {
+    sums[slot] += delta;
+  }
+}
+
+// Slot holding the count at rank, counted from 0 in slot order
+static usize sums_find(const usize* sums, usize capacity, usize rank) {
+  usize step = 1;
+  while (step * 2 <= capacity) {
+    step *= 2;
+  }
+  usize slot = 0;
+  for (; step != 0; step /= 2) {
+    if (slot + step <= capacity && sums[slot + step] <= rank) {
+      slot += step;
+      rank -= sums[slot];
+    }
+  }
+  return slot;
+}
+
+// Adds the lines and errors of the item in a slot to the sums, or takes
+// them out again
+static void count_item(Session* session, usize slot, bool counted) {
+  const SessionItem* item = &session->items->buffer[slot];
+  usize capacity = session->items->capacity;
+  usize lines = counted == true ? item->lines : -(usize)item->lines;
+  usize errors =
+    counted == true ? item->errors->length : -item->errors->length;
+  sums_add(session->line_sums, capacity, slot, lines);
+  sums_add(session->error_sums, capacity, slot, errors);
+}
+
+// Made again whenever the buffer grows, the slots of the gap count nothing
+static void sums_build(Session* session) {
+  const SessionItemVector* items = session->items;
+  usize capacity = items->capacity;
+  usize gap = capacity - items->length;
+  usize* lines = realloc(session->line_sums, sizeof(usize) * (capacity + 1));
+  usize* errors = realloc(session->error_sums, sizeof(usize) * (capacity + 1));
+  if (lines == nullptr || errors == nullptr) {
+    perror("realloc");
+    exit(1);
+  }
+  memset(lines, 0, sizeof(usize) * (capacity + 1));
+  memset(errors, 0, sizeof(usize) * (capacity + 1));
+  for (usize slot = 0; slot < capacity; ++slot) {
+    if (slot >= session->gap && slot < session->gap + gap) {
+      continue;
+    }
+    lines[slot + 1] = items->buffer[slot].lines;
+    errors[slot + 1] = items->buffer[slot].errors->length;
+  }
+  for (usize slot = 1; slot <= capacity; ++slot) {
+    usize parent = slot + (slot & -slot);
+    if (parent <= capacity) {
+      lines[parent] += lines[slot];
+      errors[parent] += errors[slot];
+    }
+  }
+  session->line_sums = lines;
+  session->error_sums = errors;
+}
+
+// Moves the gap to index, the items between the two cross it. A few items
+// are counted out and in again one at a time, many make the sums again.
+static void move_gap(Session* session, usize index) {
+  SessionItemVector* items = session->items;
+  usize gap = items->capacity - items->length;
+  usize from = index < session->gap ? index : session->gap + gap;
+  usize to = index < session->gap ? index + gap : session->gap;
+  usize moved = index < session->gap ? session->gap - index
+                                     : index - session->gap;
+  session->gap = index;
+  if (gap == 0 || moved == 0) {
+    return;
+  }
+  bool recount = moved > items->capacity / 64;
+  for (usize i = 0; recount != true && i < moved; ++i) {
+    count_item(session, from + i, false);
+  }
+  memmove(
+    items->buffer + to, items->buffer + from, sizeof(SessionItem) * moved
+  );
+  for (usize i = 0; recount != true && i < moved; ++i) {
+    count_item(session, to + i, true);
+  }
+  if (recount == true) {
+    sums_build(session);
+  }
+}
+
+// Makes room for count more items in the gap, the items after it move to
+// the end of a buffer at least twice as large
+static void reserve_items(Session* session, usize count) {
+  const SessionItemVector* items = session->items;
+  if (items->length + count <= items->capacity) {
+    return;
+  }
+  SessionItemVector* grown = SessionItem_vector_make(items->length + count);
+  usize after = items->length - session->gap;
+  memcpy(grown->buffer, items->buffer, sizeof(SessionItem) * session->gap);
+  memcpy(
+    grown->buffer + grown->capacity - after,
+    items->buffer + items->capacity - after, sizeof(SessionItem) * after
+  );
+  grown->length = items->length;
+  free(items);
+  session->items = grown;
+  sums_build(session);
+}
+
+Session session_make(StrView text) {
+  // Errors are taken out after every item, a limit would end the session
+  diag_set_limit(SIZE_MAX);
+  Arena* arena = malloc(sizeof(Arena));
+  if (arena == nullptr) {
+    perror("malloc");
+    exit(1);
+  }
+  *arena = (Arena){};
+  Session session = {
+    .items = SessionItem_vector_make(16),
+    .open = SIZE_MAX,
+    .symbols = symbol_table_make(arena, symbol_count() + 1),
+  };
+  sums_build(&session);
+  session_edit(&session, 0, 0, text);
+  return session;
+}
+
+static Lexer tolerant_lexer(StrView input, usize offset) {
+  Lexer lexer = lexer_make_from(input, offset);
+  lexer.tolerant = true;
+  return lexer;
+}
+
+// Lexes the whole damaged text, a failure is reported and lexing picks up
+// on the next line. Sets open to the first literal left open, which would
+// run on into any text after it. Returns whether the text ends where an item
+// following it is lexed and split off the same way as in the whole source:
+// at the end of a line, with no literal left open and not after "pub" or
+// "ext". An item starting a line splits off even with braces left open, see
+// splits_item, so a brace left open ends the damage with its item.
+static bool lex_damage(StrView input, TokenStream* tokens, rcstr* open) {
+  const Scanner* scan = scanner_get();
+  rcstr end = input.pointer + input.length;
+  tokens->length = 0;
+  *open = nullptr;
+  AddInfo last = AD_None;
+  usize offset = 0;
+  while (true) {
+    Lexer lexer = tolerant_lexer(input, offset);
+    while (true) {
+      Token token = lexer_next(&lexer);
+      if (token.kind == TK_Eof && lexer.failure != nullptr) {
+        if (*open == nullptr &&
+            (*lexer.failure == '"' || *lexer.failure == '\'')) {
+          *open = lexer.failure;
+        }
+        rcstr line = scan->find_newline(lexer.failure, end);
+        offset = (usize)(line - input.pointer);
+        // The rest of the line is skipped, the token before ends it
+        if (tokens->length != 0) {
+          tokens->kind[tokens->length - 1] |= TOKEN_EOL;
+        }
+        break;
+      }
+      token_stream_push(tokens, token);
+      if (token.kind == TK_Eof) {
+        return input.length != 0 && end[-1] == '\n' && *open == nullptr &&
+               last != KW_Pub && last != KW_Ext;
+      }
+      last = token.info;
+    }
+  }
+}
+
+static void grow_damage(Damage* damage, const char* text, usize length) {
+  char* grown = realloc(damage->text, damage->length + length + 1);
+  if (grown == nullptr) {
+    perror("realloc");
+    exit(1);
+  }
+  memcpy(grown + damage->length, text, length);
+  damage->text = grown;
+  damage->length += length;
+  damage->text[damage->length] = 0;
+}
+
+static SessionItem make_item(StrView input, usize begin, usize end) {
+  SessionItem item = {
+    .length = (u32)(end - begin),
+    .text = malloc(end - begin + 1),
+    .errors = SessionError_vector_make(0),
+  };
+  if (item.text == nullptr) {
+    perror("malloc");
+    exit(1);
+  }
+  memcpy(item.text, input.pointer + begin, item.length);
+  item.text[item.length] = 0;
+  item.lines = (u32)scanner_get()->count_newlines(
+    item.text, item.text + item.length
+  );
+  return item;
+}
+
+// Last newline in [begin, end), nullptr when there is none
+static const char* find_last_newline(rcstr begin, rcstr end) {
+  while (end != begin) {
+    end -= 1;
+    if (*end == '\n') {
+      return end;
+    }
+  }
+  return nullptr;
+}
+
+static i32 error_compare(const void* lhs_ptr, const void* rhs_ptr) {
+  const SessionError* lhs = lhs_ptr;
+  const SessionError* rhs = rhs_ptr;
+  return lhs->offset < rhs->offset ? -1 : lhs->offset > rhs->offset;
+}
+
+// Cuts the lexed text at item starts, the same way the parser splits its
+// input, and parses every item into a tree of its own. Errors from lexing
+// go to the item their location falls in.
+static SessionItemVector* parse_damage(
+  Arena* arena, SymbolTable* symbols, StrView input,
+  const TokenStream* tokens, const SessionErrorVector* lexed
+) {
+  SessionItemVector* items = SessionItem_vector_make(4);
+  TokenId eof = (TokenId)tokens->length - 1;
+  TokenId begin = 0;
+  usize lexed_index = 0;
+  usize depth = 0;
+  // Text without tokens still makes one item, so no text is dropped
+  for (TokenId token = min(eof, (TokenId)1); token <= eof; ++token) {
+    AddInfo prev = token != 0 ? token_info(tokens, token - 1) : AD_None;
+    if (prev == PK_LeftBrace) {
+      depth += 1;
+    } else if (prev == PK_RightBrace && depth != 0) {
+      depth -= 1;
+    }
+    if (token != eof &&
+        splits_item(
+          token_info(tokens, token), prev, token_is_eol(tokens, token - 1),
+          depth
+        ) != true) {
+      continue;
+    }
+    depth = 0;
+    usize start = items->length == 0 ? 0 : tokens->offset[begin];
+    usize stop = token == eof ? input.length : tokens->offset[token];
+    // Literals are spans of the item's own copy of its text, which is the
+    // same as the input from start on
+    SessionItem item = make_item(input, start, stop);
+    item.ast = ast_make(input.pointer + start, AST_CAPACITY(item.length));
+    item.tree = parse_tokens(arena, symbols, tokens, begin, token, &item.ast);
+    item.ast.source = item.text;
+    ErrorSink sink = {
+      .errors = &item.errors,
+      .base = input.pointer + start,
+    };
+    diag_drain(collect_error, &sink);
+    for (; lexed_index < lexed->length &&
+           (lexed->buffer[lexed_index].offset < stop || token == eof);
+         ++lexed_index) {
+      SessionError error = lexed->buffer[lexed_index];
+      error.offset -= (u32)start;
+      SessionError_vector_push(&item.errors, error);
+    }
+    qsort(
+      item.errors->buffer, item.errors->length, sizeof(SessionError),
+      error_compare
+    );
+    SessionItem_vector_push(&items, item);
+    begin = token;
+  }
+  return items;
+}
+
+// Index of the item holding the byte at offset, the last item holds the end
+// of the text. Sets begin to the offset the item starts at. Walks from the
+// item of the last edit, the next one is mostly made close to it.
+static usize find_item(const Session* session, usize offset, usize* begin) {
+  usize index = session->cursor;
+  usize start = session->cursor_offset;
+  while (index != 0 && start > offset) {
+    index -= 1;
+    start -= item_at(session, index)->length;
+  }
+  while (index + 1 < session->items->length &&
+         start + item_at(session, index)->length <= offset) {
+    start += item_at(session, index)->length;
+    index += 1;
+  }
+  *begin = start;
+  return index;
+}
+
+// Offset of the first byte of the item at index
+static usize item_offset(const Session* session, usize index) {
+  usize offset = session->cursor_offset;
+  for (usize i = session->cursor; i > index; --i) {
+    offset -= item_at(session, i - 1)->length;
+  }
+  for (usize i = session->cursor; i < index; ++i) {
+    offset += item_at(session, i)->length;
+  }
+  return offset;
+}
+
+// Whether the item before first still ends where it did, a token at the end
+// of it could be joined by what an edit put right after it
+static bool separated(const Session* session, usize first) {
+  if (first == 0) {
+    return true;
+  }
+  const SessionItem* item = item_at(session, first - 1);
+  char last = item->length != 0 ? item->text[item->length - 1] : '\n';
+  return last == ' ' || last == '\t' || last == '\n' || last == '\r';
+}
+
+// Items [first, last) with the edit applied, the edit starts offset bytes
+// into the first of them
+static void fill_damage(
+  const Session* session, Damage* damage, usize offset, usize removed,
+  StrView inserted
+) {
+  damage->length = 0;
+  usize begin = 0;
+  for (usize i = damage->first; i < damage->last; ++i) {
+    const SessionItem* item = item_at(session, i);
+    usize end = begin + item->length;
+    usize from = min(max(offset, begin), end) - begin;
+    usize to = min(max(offset + removed, begin), end) - begin;
+    grow_damage(damage, item->text, from);
+    if (offset >= begin && (offset < end || i + 1 == damage->last)) {
+      grow_damage(damage, inserted.pointer, inserted.length);
+    }
+    grow_damage(damage, item->text + to, item->length - to);
+    begin = end;
+  }
+  if (damage->first == damage->last) {
+    grow_damage(damage, inserted.pointer, inserted.length);
+  }
+}
+
+void session_edit(
+  Session* session, usize offset, usize removed, StrView inserted
+) {
+  offset = min(offset, session->length);
+  removed = min(removed, session->length - offset);
+  const SessionItemVector* items = session->items;
+
+  Damage damage = {};
+  if (items->length != 0) {
+    usize begin = 0;
+    damage.first = find_item(session, offset, &begin);
+    damage.last = find_item(session, offset + removed, &begin) + 1;
+    damage.first = min(damage.first, session->open);
+  }
+  while (separated(session, damage.first) != true) {
+    damage.first -= 1;
+  }
+
+  // Grown until the damaged text starts and ends on item boundaries of the
+  // edited source, the items outside of it lex and split the same as before.
+  // The end grows by twice as many items every time, a brace left open can
+  // take in the rest of the source and lexing it again per item would be
+  // quadratic. Once aligned the text stays aligned at any later item end, so
+  // growing past it only parses a few items more. The tokens of every
+  // attempt and the scratch of parsing live in one arena released with the
+  // edit.
+  SessionErrorVector* lexed = SessionError_vector_make(0);
+  Arena arena = {};
+  TokenStream tokens = {};
+  rcstr open = nullptr;
+  usize start = 0;
+  usize growth = 1;
+  while (true) {
+    start = item_offset(session, damage.first);
+    fill_damage(session, &damage, offset - start, removed, inserted);
+    StrView input = {
+      .pointer = damage.text,
+      .length = damage.length,
+    };
+    arena_reset(&arena);
+    tokens = token_stream_make(&arena, input, damage.length / 4 + 16);
+    bool aligned = lex_damage(input, &tokens, &open);
+    bool starts = damage.first == 0 ||
+                  starts_item(token_info(&tokens, 0), AD_None) == true;
+    if (starts != true) {
+      diag_drain(drop_error, nullptr);
+      damage.first -= 1;
+    } else if (aligned != true && damage.last != items->length) {
+      diag_drain(drop_error, nullptr);
+      damage.last = min(damage.last + growth, items->length);
+      growth *= 2;
+    } else {
+      ErrorSink sink = {
+        .errors = &lexed,
+        .base = damage.text,
+      };
+      diag_drain(collect_error, &sink);
+      break;
+    }
+  }
+  StrView input = {
+    .pointer = damage.text,
+    .length = damage.length,
+  };
+  SessionItemVector* fresh =
+    parse_damage(&arena, &session->symbols, input, &tokens, lexed);
+  arena_free(&arena);
+  free(lexed);
+
+  usize replaced = damage.last - damage.first;
+  if (session->open != SIZE_MAX && session->open >= damage.last) {
+    session->open = session->open - replaced + fresh->length;
+  } else {
+    session->open = SIZE_MAX;
+  }
+  usize open_offset = open != nullptr ? (usize)(open - damage.text) : 0;
+  for (usize i = 0; open != nullptr && i < fresh->length; ++i) {
+    if (open_offset < fresh->buffer[i].length || i + 1 == fresh->length) {
+      session->open = damage.first + i;
+      break;
+    }
+    open_offset -= fresh->buffer[i].length;
+  }
+  free(damage.text);
+
+  // The replaced items end up right before the gap, which then takes them
+  // in and is filled with the new ones from its start
+  move_gap(session, damage.last);
+  for (usize i = damage.first; i < damage.last; ++i) {
+    count_item(session, i, false);
+    session->errors -= session->items->buffer[i].errors->length;
+    free_item(&session->items->buffer[i]);
+  }
+  session->gap = damage.first;
+  session->items->length -= replaced;
+  reserve_items(session, fresh->length);
+  for (usize i = 0; i < fresh->length; ++i) {
+    session->items->buffer[session->gap] = fresh->buffer[i];
+    count_item(session, session->gap, true);
+    session->errors += fresh->buffer[i].errors->length;
+    session->gap += 1;
+    session->items->length += 1;
+  }
+  session->length = session->length - removed + inserted.length;
+  session->cursor = damage.first;
+  session->cursor_offset = start;
+  free(fresh);
+}
+
+// Text of the line starting offset bytes into the item at index, which can
+// run on into the items after it. Those lines are joined into joined, which
+// the caller frees.
+static StrView line_text(
+  const Session* session, usize index, usize offset, char** joined
+) {
+  const Scanner* scan = scanner_get();
+  const SessionItem* item = item_at(session, index);
+  rcstr begin = item->text + offset;
+  rcstr end = item->text + item->length;
+  rcstr newline = scan->find_newline(begin, end);
+  *joined = nullptr;
+  if (newline != end || index + 1 == session->items->length) {
+    return (StrView){
+      .pointer = begin,
+      .length = (usize)(newline - begin),
+    };
+  }
+  Damage line = {};
+  grow_damage(&line, begin, (usize)(end - begin));
+  for (index += 1; index < session->items->length; ++index) {
+    item = item_at(session, index);
+    end = item->text + item->length;
+    newline = scan->find_newline(item->text, end);
+    grow_damage(&line, item->text, (usize)(newline - item->text));
+    if (newline != end) {
+      break;
+    }
+  }
+  *joined = line.text;
+  return (StrView){
+    .pointer = line.text,
+    .length = line.length,
+  };
+}
+
+// Item and offset in it where the line holding the start of the item at
+// index begins, sets column to the column the item starts on
+static usize line_start(
+  const Session* session, usize index, usize* offset, u32* column
+) {
+  *column = 1;
+  *offset = 0;
+  for (; index != 0; --index) {
+    const SessionItem* item = item_at(session, index - 1);
+    rcstr end = item->text + item->length;
+    rcstr newline = find_last_newline(item->text, end);
+    if (newline != nullptr) {
+      *column += (u32)(end - newline - 1);
+      *offset = (usize)(newline + 1 - item->text);
+      return index - 1;
+    }
+    *column += item->length;
+  }
+  return 0;
+}
+
+// Goes straight to the items with errors, the lines before them are summed
+// up from line_sums
+usize session_report(
+  const Session* session, fn(void(void*, SourceLoc, StrView, rcstr)) sink,
+  void* data
+) {
+  const Scanner* scan = scanner_get();
+  const SessionItemVector* items = session->items;
+  usize count = 0;
+  while (count < session->errors) {
+    usize slot = sums_find(session->error_sums, items->capacity, count);
+    usize i = slot < session->gap ? slot
+                                  : slot - (items->capacity - items->length);
+    const SessionItem* item = &items->buffer[slot];
+    u32 line = 1 + (u32)sums_prefix(session->line_sums, slot);
+    u32 column = 1;
+    usize line_offset = 0;
+    usize line_item = line_start(session, i, &line_offset, &column);
+    for (usize j = 0; j < item->errors->length; ++j) {
+      const SessionError* error = &item->errors->buffer[j];
+      rcstr location = item->text + min(error->offset, item->length);
+      rcstr start = find_last_newline(item->text, location);
+      u32 lines = (u32)scan->count_newlines(item->text, location);
+      SourceLoc loc = {
+        .line = line + lines,
+        .column = start != nullptr ? (u32)(location - start)
+                                   : column + (u32)(location - item->text),
+      };
+      char* joined = nullptr;
+      StrView text =
+        start != nullptr
+          ? line_text(session, i, (usize)(start + 1 - item->text), &joined)
+          : line_text(session, line_item, line_offset, &joined);
+      sink(data, loc, text, error->message);
+      free(joined);
+      count += 1;
+    }
+  }
+  return count;
+}
+
+ParserOutput session_output(const Session* session) {
+  ParserOutput output = {
+    .ast = ast_make(nullptr, AST_CAPACITY(session->length)),
+  };
+  usize count = 0;
+  for (usize i = 0; i < session->items->length; ++i) {
+    count += item_at(session, i)->tree.count;
+  }
+  NodeId* functions = malloc(sizeof(NodeId) * max(count, (usize)1));
+  if (functions == nullptr) {
+    perror("malloc");
+    exit(1);
+  }
+  count = 0;
+  for (usize i = 0; i < session->items->length; ++i) {
+    const SessionItem* item = item_at(session, i);
+    if (item->tree.count == 0) {
+      continue;
+    }
+    u32 delta = ast_append(&output.ast, &item->ast);
+    const NodeId* items = ast_list(&item->ast, item->tree);
+    for (u32 j = 0; j < item->tree.count; ++j) {
+      functions[count] = items[j] + delta;
+      count += 1;
+    }
+  }
+  output.tree = make_list(&output.ast, functions, count);
+  free(functions);
+  return output;
+}
+
+void session_free(Session* session) {
+  for (usize i = 0; i < session->items->length; ++i) {
+    free_item(item_at(session, i));
+  }
+  free(session->items);
+  free(session->line_sums);
+  free(session->error_sums);
+  arena_free(session->symbols.arena);
+  free(session->symbols.arena);
+  *session = (Session){};
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <parser/lexer.h>
+#include <parser/mod.h>
+#include <utility/mod.h>
+#include <utility/vec.h>
+
+// A long-lived analysis of one source, kept up to date through text edits.
+// The text is held per top-level item, every item with a tree and errors of
+// its own. An edit lexes and parses again only the items it touches, and
+// the ones after them while the item boundaries have not lined up again.
+typedef struct SessionError SessionError;
+struct SessionError {
+  u32 offset;
+  char* message;
+};
+DEFINE_VECTOR(SessionError)
+
+typedef struct SessionItem SessionItem;
+struct SessionItem {
+  char* text;
+  u32 length;
+  u32 lines;
+  NodeList tree;
+  Ast ast;
+  SessionErrorVector* errors;
+};
+DEFINE_VECTOR(SessionItem)
+
+typedef struct Session Session;
+struct Session {
+  // Items are kept on both sides of a gap taking up the spare capacity, the
+  // ones from gap on at the end of the buffer. Edits move the gap to
+  // themselves, which shifts only the items between two edits.
+  SessionItemVector* items;
+  usize gap;
+  usize length;
+  usize errors;
+  // First item holding a literal left open, which any later edit can close
+  usize open;
+  // An item and the offset it starts at, items are found from there
+  usize cursor;
+  usize cursor_offset;
+  // Lines and errors of the items kept as Fenwick trees over the slots of
+  // the buffer, so the line an item starts on and the item holding the n-th
+  // error are found without walking the items
+  usize* line_sums;
+  usize* error_sums;
+  // Names bound while parsing, kept across edits so the table indexed by
+  // every interned symbol is grown once instead of made per edit. Lives in
+  // an arena of its own.
+  SymbolTable symbols;
+};
+
+extern Session session_make(StrView text);
+extern void session_edit(
+  Session* session, usize offset, usize removed, StrView inserted
+);
+// Passes every error with its location and the text of its line to sink in
+// source order, returns the number of errors
+extern usize session_report(
+  const Session* session, fn(void(void*, SourceLoc, StrView, rcstr)) sink,
+  void* data
+);
+// Joins the item trees into one tree of the whole source
+extern ParserOutput session_output(const Session* session);
+extern void session_free(Session* session);
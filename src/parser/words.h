@@ -0,0 +1,40 @@
+#pragma once
+#include <parser/lexer.h>
+#include <utility/mod.h>
+
+// Reserved words are found through a perfect hash over their first, second
+// and last character and their length. The seeds are fixed: the word-seeds
+// test checks them against the ENTRIES lists and prints new ones when an
+// entry added to a list makes two of them collide.
+#define KWRD_ENTRIES   \
+  X(KW_Ext, "ext")     \
+  X(KW_Pub, "pub")     \
+  X(KW_Let, "let")     \
+  X(KW_Fn, "fn")       \
+  X(KW_Use, "use")     \
+  X(KW_If, "if")       \
+  X(KW_Else, "else")   \
+  X(KW_For, "for")     \
+  X(KW_While, "while") \
+  X(KW_Match, "match") \
+  X(KW_Return, "ret")
+
+#define FLT_ENTRIES      \
+  X(AD_F16Type, "f16")   \
+  X(AD_BF16Type, "bf16") \
+  X(AD_F32Type, "f32")   \
+  X(AD_F64Type, "f64")   \
+  X(AD_F128Type, "f128")
+
+#define WORD_HASH_BITS 6
+#define KWRD_HASH_SEED 0x9e3779c3u
+#define FLT_HASH_SEED 0x9e3779b1u
+
+static inline u32 word_key(rcstr iter, usize size) {
+  return (u32)(u8)iter[0] | (u32)(u8)iter[size > 1] << 8 |
+         (u32)(u8)iter[size - 1] << 16 | (u32)size << 24;
+}
+
+static inline u32 word_slot(u32 seed, u32 key) {
+  return (key * seed) >> (32 - WORD_HASH_BITS);
+}
@@ -0,0 +1,54 @@
+// Checks that the reserved word hash seeds put every entry of their list in
+// a slot of its own. A seed that does not is replaced by the first one found
+// the way the lists were first seeded, which is printed to be copied into
+// parser/words.h.
+#include <parser/words.h>
+#include <stdio.h>
+#include <string.h>
+#include <utility/mod.h>
+
+#define WORD_SIZE 8
+
+#define X(info, str) str,
+static const char kwrd_table[][WORD_SIZE] = { KWRD_ENTRIES };
+static const char flt_table[][WORD_SIZE] = { FLT_ENTRIES };
+#undef X
+
+static bool is_perfect(u32 seed, const char (*names)[WORD_SIZE], usize count) {
+  bool used[1 << WORD_HASH_BITS] = {};
+  for (usize i = 0; i < count; ++i) {
+    u32 slot = word_slot(seed, word_key(names[i], strlen(names[i])));
+    if (used[slot] == true) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+
+static bool check_seed(
+  rcstr name, u32 seed, const char (*names)[WORD_SIZE], usize count
+) {
+  if (is_perfect(seed, names, count) == true) {
+    eprintln("%s 0x%08xu is perfect", name, seed);
+    return true;
+  }
+  for (u32 next = 0x9e3779b1; next != 0x9e3779b1 + (1 << 20); next += 2) {
+    if (is_perfect(next, names, count) == true) {
+      eprintln("%s 0x%08xu has collisions, use 0x%08xu", name, seed, next);
+      return false;
+    }
+  }
+  eprintln("%s has collisions and no seed was found", name);
+  return false;
+}
+
+int main() {
+  bool kwrd = check_seed(
+    "KWRD_HASH_SEED", KWRD_HASH_SEED, kwrd_table, sizeof_arr(kwrd_table)
+  );
+  bool flt = check_seed(
+    "FLT_HASH_SEED", FLT_HASH_SEED, flt_table, sizeof_arr(flt_table)
+  );
+  return kwrd == true && flt == true ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+
+# Lexes the test/src corpus scaled up with the bahr-bench of every build
+# directory given, only build by default
+# To compare with another revision of the lexer, build its bahr-bench target
+# into a directory of its own and pass both, the hashes must agree
+# The project needs to be built first
+# Usage: test/bench/corpus.sh [megabytes] [runs] [build-dir...]
+
+set -e
+megabytes=${1:-32}
+runs=${2:-5}
+builds=("${@:3}")
+if [ ${#builds[@]} -eq 0 ]; then
+  builds=(build)
+fi
+input=${TMPDIR:-/tmp}/bahr-bench-corpus.bh
+
+python3 test/bench/gen_corpus.py $megabytes > $input
+for build in "${builds[@]}"; do
+  ./$build/bahr-bench lex $input 1 $runs
+done
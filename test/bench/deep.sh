@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+
+# Compiles generated programs of one expression nested or chained a million
+# times with the native stack limited to 256 KiB, a recursion per level of
+# nesting in any phase would overflow it long before the end
+# Covers lexing, parsing, semantic analysis, constant folding and building
+# and verifying the LLVM module. Writing the object file is skipped with
+# --no-emit: LLVM's own code generation is superlinear in the length of one
+# function, 10k terms take seconds and 100k terms minutes
+# The project needs to be built first
+# Usage: test/bench/deep.sh [count] [shape...]
+
+set -e
+count=${1:-1000000}
+shapes=("${@:2}")
+if [ ${#shapes[@]} -eq 0 ]; then
+  shapes=(sum parens negations calls)
+fi
+input=${TMPDIR:-/tmp}/bahr-bench-deep.bh
+
+for shape in "${shapes[@]}"; do
+  python3 test/bench/gen_deep.py $shape $count > $input
+  TIMEFORMAT="$shape count=$count ok %R s"
+  time (ulimit -s 256 && ./build/bahrc -c $input --no-emit)
+done
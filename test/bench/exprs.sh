@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+
+# Parses a generated expression-heavy program on one thread with the
+# bahr-bench of every build directory given, only build by default
+# To compare with another revision of the parser, build its bahr-bench target
+# into a directory of its own and pass both, the tree hashes must agree
+# The project needs to be built first
+# Usage: test/bench/exprs.sh [functions] [runs] [build-dir...]
+
+set -e
+functions=${1:-5000}
+runs=${2:-5}
+builds=("${@:3}")
+if [ ${#builds[@]} -eq 0 ]; then
+  builds=(build)
+fi
+input=${TMPDIR:-/tmp}/bahr-bench-exprs.bh
+
+python3 test/bench/gen_exprs.py $functions > $input
+for build in "${builds[@]}"; do
+  ./$build/bahr-bench parse $input 1 $runs
+done
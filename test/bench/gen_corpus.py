@@ -0,0 +1,21 @@
+#!/usr/bin/env python3
+
+# Writes the test/src corpus repeated until it holds the given size to stdout
+# The corpus mixes every kind of token the lexer knows, it lexes but does not
+# parse as a whole
+# Usage: gen_corpus.py <megabytes>
+
+import pathlib
+import sys
+
+size = float(sys.argv[1]) if len(sys.argv) > 1 else 32
+root = pathlib.Path(__file__).resolve().parent.parent / "src"
+
+corpus = ""
+for path in sorted(root.glob("*.bh")):
+    text = path.read_text()
+    corpus += text if text.endswith("\n") else text + "\n"
+
+out = sys.stdout
+for _ in range(int(size * 1024 * 1024) // len(corpus) + 1):
+    out.write(corpus)
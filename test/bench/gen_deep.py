@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+
+# Writes a program of one expression nested or chained count times to stdout
+# Shapes: sum is a + a + ..., parens wraps a in count parentheses, negations
+# puts count minus signs in front of it and calls passes it through count
+# nested calls of a function returning its argument
+# Usage: gen_deep.py <sum|parens|negations|calls> [count]
+
+import sys
+
+shape = sys.argv[1] if len(sys.argv) > 1 else "sum"
+count = int(sys.argv[2]) if len(sys.argv) > 2 else 1000000
+
+if shape == "sum":
+    value = " + ".join(["a"] * count)
+elif shape == "parens":
+    value = "(" * count + "a" + ")" * count
+elif shape == "negations":
+    value = "- " * count + "a"
+elif shape == "calls":
+    value = "pass(" * count + "a" + ")" * count
+else:
+    sys.exit(f"Unknown shape {shape}")
+
+out = sys.stdout
+out.write("fn pass(x i64) i64 {\n  ret x\n}\n\n")
+out.write("pub fn main() i64 {\n  let a i64 = 1\n")
+out.write(f"  ret {value}\n")
+out.write("}\n")
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+
+# Writes a program of functions made of long expressions to stdout
+# Operands are mixed with every binary operator, negations, parentheses and
+# calls, so most of the parse goes through the operator precedence loop
+# The output only depends on the arguments
+# Usage: gen_exprs.py <functions> [terms]
+
+import random
+import sys
+
+count = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+terms = int(sys.argv[2]) if len(sys.argv) > 2 else 64
+
+OPERATORS = ["+", "-", "*", "/", "%", "<<", ">>", "&", "|", "^"]
+COMPARISONS = ["==", "!=", "<", ">", "<=", ">="]
+rand = random.Random(count * 7919 + terms)
+
+
+def operand(depth):
+    pick = rand.randrange(10)
+    if pick < 3:
+        return rand.choice(["a", "b", "c"])
+    if pick < 5:
+        return str(rand.randrange(1, 1000))
+    if pick < 6:
+        return "-" + operand(depth)
+    if pick < 8 and depth < 3:
+        return "(" + expression(rand.randrange(2, 6), depth + 1) + ")"
+    if pick < 9 and depth < 3:
+        return f"mix({expression(3, depth + 1)}, b, {operand(depth + 1)})"
+    return rand.choice(["a", "b", "c"])
+
+
+def expression(length, depth):
+    parts = [operand(depth)]
+    for _ in range(length - 1):
+        parts.append(rand.choice(OPERATORS))
+        parts.append(operand(depth))
+    return " ".join(parts)
+
+
+def comparison():
+    lhs = expression(3, 0)
+    return f"({lhs}) {rand.choice(COMPARISONS)} ({expression(3, 0)})"
+
+
+out = sys.stdout
+out.write("fn mix(a i32, b i32, c i32) i32 {\n    ret a * 31 + b ^ c\n}\n")
+for i in range(count):
+    out.write(
+        f"pub fn expr_{i}(a i32, b i32, c i32) i32 {{\n"
+        f"    let x i32 = {expression(terms, 0)}\n"
+        f"    let y u1 = ({comparison()}) && ({comparison()})\n"
+        f"    ret x + {expression(terms // 2, 0)}\n"
+        f"}}\n"
+    )
@@ -0,0 +1,25 @@
+#!/usr/bin/env python3
+
+# Writes a program of many small public functions to stdout
+# Every function declares, branches, calls and returns, so each phase of the
+# front end has work to do
+# Usage: gen_items.py <functions>
+
+import sys
+
+count = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+
+out = sys.stdout
+out.write("fn square(x i32) i32 {\n    ret x * x\n}\n")
+for i in range(count):
+    out.write(
+        f"// function number {i} with some comment text\n"
+        f"pub fn func_{i}(arg_{i} i32, other_value i64) i32 {{\n"
+        f"    let value_{i} i32 = 2 + 3 + ( 4 + 5 ) + 6 * arg_{i}\n"
+        f'    let message *i8 = "hello world string {i}"\n'
+        f"    if value_{i} == 1_000 {{\n"
+        f"        ret value_{i} * 32543234\n"
+        f"    }}\n"
+        f"    ret square(value_{i}) + 3\n"
+        f"}}\n"
+    )
@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+
+# Compares the SIMD scanners of the lexer with the scalar ones on one thread
+# The scalar build is configured in build-scalar with SCAN_SIMD=0, both
+# builds must report the same token hash
+# The project needs to be built first
+# Usage: test/bench/lex.sh [functions] [runs]
+
+set -e
+functions=${1:-100000}
+runs=${2:-5}
+input=${TMPDIR:-/tmp}/bahr-bench-items.bh
+
+python3 test/bench/gen_items.py $functions > $input
+cmake -S . -B build-scalar -DCMAKE_C_FLAGS=-DSCAN_SIMD=0 > /dev/null
+cmake --build build-scalar --target bahr-bench > /dev/null
+./build/bahr-bench lex $input 1 $runs
+./build-scalar/bahr-bench lex $input 1 $runs
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+
+# Lexes one generated input on 1, 2, 4, ... threads up to the number of
+# online processors, every line must report the same token hash
+# Inputs under LEX_PARALLEL_MIN bytes are lexed on one thread whatever the
+# thread count, the default input is well above it
+# The project needs to be built first
+# Usage: test/bench/lex_threads.sh [functions] [runs]
+
+set -e
+functions=${1:-100000}
+runs=${2:-5}
+input=${TMPDIR:-/tmp}/bahr-bench-items.bh
+cores=$(nproc)
+
+python3 test/bench/gen_items.py $functions > $input
+threads=1
+while [ $threads -lt $cores ]; do
+  ./build/bahr-bench lex $input $threads $runs
+  threads=$((threads * 2))
+done
+./build/bahr-bench lex $input $cores $runs
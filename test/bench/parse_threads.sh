@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+
+# Parses one generated program of many functions on 1, 2, 4, ... threads up
+# to the number of online processors, every line must report the same tree
+# hash as the first
+# The peak is the one of the lex arena, inputs parsed on threads keep all of
+# their tokens at once, see LEX_PARALLEL_MIN
+# The project needs to be built first
+# Usage: test/bench/parse_threads.sh [functions] [runs]
+
+set -e
+functions=${1:-60000}
+runs=${2:-5}
+input=${TMPDIR:-/tmp}/bahr-bench-items.bh
+cores=$(nproc)
+
+python3 test/bench/gen_items.py $functions > $input
+threads=1
+while [ $threads -lt $cores ]; do
+  ./build/bahr-bench parse $input $threads $runs
+  threads=$((threads * 2))
+done
+./build/bahr-bench parse $input $cores $runs
@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+
+# Replays a recorded typing session on generated programs of growing size
+# The session types a helper function at the top of the file and edits the
+# first items of gen_items.py output, so it applies to any size. The time of
+# an edit must not grow with the size of the file: the script fails when the
+# median edit on the largest input takes over four times the median edit on
+# the smallest one.
+# bahrc exits with 1 when errors are left after the replay, the session ends
+# on a source without errors
+# The project needs to be built first
+# Usage: test/bench/replay.sh [functions...]
+
+set -e -o pipefail
+sizes=("$@")
+if [ ${#sizes[@]} -eq 0 ]; then
+  sizes=(100 10000 100000)
+fi
+input=${TMPDIR:-/tmp}/bahr-bench-replay.bh
+
+medians=()
+for functions in "${sizes[@]}"; do
+  python3 test/bench/gen_items.py $functions > $input
+  summary=$(./build/bahrc -c $input -r test/bench/typing.edits 2>&1 | tail -n 1)
+  echo "$summary"
+  medians+=($(echo "$summary" | sed -n 's/.*median \([0-9.]*\) ms.*/\1/p'))
+done
+
+first=${medians[0]}
+last=${medians[${#medians[@]} - 1]}
+if awk "BEGIN { exit !($last > 4 * $first) }"; then
+  echo "Median edit went from $first ms to $last ms with the input size"
+  exit 1
+fi
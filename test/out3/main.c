@@ -0,0 +1,57 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+extern int fold_div();
+extern int fold_mod();
+extern int fold_shr();
+extern bool fold_lt();
+extern uint64_t fold_udiv();
+extern uint64_t fold_umod();
+extern uint64_t fold_ushr();
+extern bool fold_ugt();
+extern int sdiv(int, int);
+extern int smod(int, int);
+extern int sshr(int, int);
+extern bool slt(int, int);
+extern uint64_t udiv(uint64_t, uint64_t);
+extern uint64_t umod(uint64_t, uint64_t);
+extern uint64_t ushr(uint64_t, uint64_t);
+extern bool ugt(uint64_t, uint64_t);
+
+int main() {
+  printf("fold_div(): %d\n", fold_div());
+  assert(fold_div() == -7 / 2 + 0xff + 1000);
+  printf("fold_mod(): %d\n", fold_mod());
+  assert(fold_mod() == -7 % 2);
+  printf("fold_shr(): %d\n", fold_shr());
+  assert(fold_shr() == -4);
+  printf("fold_lt(): %d\n", fold_lt());
+  assert(fold_lt() == 1);
+  printf("fold_udiv(): %llx\n", (unsigned long long)fold_udiv());
+  assert(fold_udiv() == 0xfffffffffffffff0ULL / 16);
+  printf("fold_umod(): %llu\n", (unsigned long long)fold_umod());
+  assert(fold_umod() == 0xfffffffffffffff0ULL % 1000);
+  printf("fold_ushr(): %llx\n", (unsigned long long)fold_ushr());
+  assert(fold_ushr() == 0xfffffffffffffff0ULL >> 4);
+  printf("fold_ugt(): %d\n", fold_ugt());
+  assert(fold_ugt() == 1);
+  printf("sdiv(-7, 2): %d\n", sdiv(-7, 2));
+  assert(sdiv(-7, 2) == -3);
+  printf("smod(-7, 2): %d\n", smod(-7, 2));
+  assert(smod(-7, 2) == -1);
+  printf("sshr(-16, 2): %d\n", sshr(-16, 2));
+  assert(sshr(-16, 2) == -4);
+  printf("slt(-1, 1): %d\n", slt(-1, 1));
+  assert(slt(-1, 1) == true);
+  uint64_t big = 0xfffffffffffffff0ULL;
+  printf("udiv(big, 16): %llx\n", (unsigned long long)udiv(big, 16));
+  assert(udiv(big, 16) == big / 16);
+  printf("umod(big, 1000): %llu\n", (unsigned long long)umod(big, 1000));
+  assert(umod(big, 1000) == big % 1000);
+  printf("ushr(big, 4): %llx\n", (unsigned long long)ushr(big, 4));
+  assert(ushr(big, 4) == big >> 4);
+  printf("ugt(big, 1): %d\n", ugt(big, 1));
+  assert(ugt(big, 1) == true);
+  return 0;
+}
@@ -0,0 +1,11 @@
+#!/usr/bin/env bash
+
+# This generates an object file of integer operations on signed and unsigned
+# operands and links it to a c file checking their results
+# The project needs to be built first
+
+set -e
+./build/bahrc -c test/src/signed_test.bh -o test/out3/signed_test.o
+cd test/out3
+gcc -fuse-ld=mold -o signed_test main.c signed_test.o
+./signed_test